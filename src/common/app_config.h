@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+
+/**
+ * @brief 运行参数配置类，读取 key = value 格式的配置文件
+ * 以'#'开头的行为注释，未配置的参数使用调用方给出的默认值。
+ * 配置在main中启动时加载一次，之后只读，可在多线程中直接访问。
+ */
+class AppConfig
+{
+  private:
+    AppConfig() {}
+
+    std::map<std::string, std::string> m_values; // 配置项
+
+    static std::string trim(const std::string &s)
+    {
+        auto b = s.find_first_not_of(" \t\r\n");
+        if (b == std::string::npos)
+            return "";
+        auto e = s.find_last_not_of(" \t\r\n");
+        return s.substr(b, e - b + 1);
+    }
+
+  public:
+    static AppConfig &getinstance()
+    {
+        static AppConfig instance;
+        return instance;
+    }
+
+    /**
+     * @brief 加载配置文件
+     * @param file 配置文件路径
+     * @return 文件存在并读取成功返回true
+     */
+    bool load(const std::string &file)
+    {
+        std::ifstream fs(file);
+        if (!fs)
+            return false;
+
+        std::string line;
+        while (std::getline(fs, line))
+        {
+            line = trim(line);
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            auto pos = line.find('=');
+            if (pos == std::string::npos)
+                continue;
+
+            auto key = trim(line.substr(0, pos));
+            auto value = trim(line.substr(pos + 1));
+            if (!key.empty())
+                m_values[key] = value;
+        }
+        return true;
+    }
+
+    bool has(const std::string &key) const { return m_values.find(key) != m_values.end(); }
+
+    std::string get_string(const std::string &key, const std::string &def = "") const
+    {
+        auto iter = m_values.find(key);
+        return iter == m_values.end() ? def : iter->second;
+    }
+
+    long long get_int(const std::string &key, long long def = 0) const
+    {
+        auto iter = m_values.find(key);
+        if (iter == m_values.end() || iter->second.empty())
+            return def;
+        return atoll(iter->second.c_str());
+    }
+
+    bool get_bool(const std::string &key, bool def = false) const
+    {
+        auto iter = m_values.find(key);
+        if (iter == m_values.end())
+            return def;
+        const auto &v = iter->second;
+        return v == "on" || v == "true" || v == "yes" || v == "1";
+    }
+};
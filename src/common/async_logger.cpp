@@ -0,0 +1,314 @@
+#include "async_logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+
+// 填充记录的级别，表示缓冲区末尾剩余的空间不足一条记录
+#define ASYNC_LOG_PADDING -1
+// 丢弃告警的最小间隔(秒)
+#define ASYNC_LOG_REPORT_INTERVAL 10
+
+static inline size_t align8(size_t n) { return (n + 7) & ~static_cast<size_t>(7); }
+
+// 记录头，其后是格式化字符串和参数
+struct AsyncLogger::Header
+{
+    uint32_t size;  // 包括记录头和对齐的总长度
+    int32_t level;
+    int64_t time;   // 写入时间(纳秒)，用于多个线程的记录排序
+    log4cxx::Logger *logger;
+    FormatFn format;
+};
+
+// 单生产者单消费者环形缓冲区，写入位置和读取位置只增不减，取模得到偏移
+struct AsyncLogger::Ring
+{
+    explicit Ring(size_t capacity) : buf(new char[capacity]), capacity(capacity) {}
+
+    std::unique_ptr<char[]> buf;
+    size_t capacity;
+
+    char pad0[64];
+    std::atomic<uint64_t> head{0}; // 读取位置，只由后台线程修改
+    char pad1[64];
+    std::atomic<uint64_t> tail{0}; // 写入位置，只由所属线程修改
+    uint64_t reserved = 0;         // 已预留还没有提交的长度，包括末尾的填充
+    char pad2[64];
+
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> blocked{0};
+    std::atomic<bool> closed{false}; // 所属线程已退出
+};
+
+namespace
+{
+// 线程退出时标记缓冲区，后台线程取完剩余记录后释放
+struct LocalRing
+{
+    std::shared_ptr<void> ring;
+    std::atomic<bool> *closed = nullptr;
+
+    ~LocalRing()
+    {
+        if (closed)
+            closed->store(true, std::memory_order_release);
+    }
+};
+
+thread_local LocalRing t_ring;
+
+int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+} // namespace
+
+const log4cxx::LevelPtr &logger_util::to_log4cxx_level(int level)
+{
+    static const log4cxx::LevelPtr levels[] = {log4cxx::Level::getTrace(), log4cxx::Level::getDebug(),
+                                               log4cxx::Level::getInfo(), log4cxx::Level::getWarn(),
+                                               log4cxx::Level::getError()};
+    if (level < LEVEL_TRACE || level > LEVEL_ERROR)
+        level = LEVEL_ERROR;
+    return levels[level];
+}
+
+void AsyncLogger::start(size_t buffer_size, Overflow overflow, int flush_ms)
+{
+    if (m_running)
+        return;
+
+    size_t size = 4096;
+    while (size < buffer_size)
+        size <<= 1;
+    m_buffer_size = size;
+    m_overflow = overflow;
+    m_flush_ms = flush_ms > 0 ? flush_ms : 1;
+    m_running = true;
+    std::thread([this]() { run(); }).detach();
+}
+
+void AsyncLogger::stop()
+{
+    if (!m_running.exchange(false))
+        return;
+    wakeup();
+    drain();
+}
+
+AsyncLogStats AsyncLogger::stats()
+{
+    AsyncLogStats stats;
+    stats.written = m_written.load(std::memory_order_relaxed);
+    stats.fallback = m_fallback.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &ring : m_rings)
+    {
+        stats.dropped += ring->dropped.load(std::memory_order_relaxed);
+        stats.blocked += ring->blocked.load(std::memory_order_relaxed);
+    }
+    stats.dropped += m_dropped_base;
+    stats.blocked += m_blocked_base;
+    stats.threads = m_rings.size();
+    return stats;
+}
+
+AsyncLogger::Ring *AsyncLogger::local_ring()
+{
+    if (t_ring.ring)
+        return static_cast<Ring *>(t_ring.ring.get());
+
+    auto ring = std::make_shared<Ring>(m_buffer_size);
+    t_ring.ring = ring;
+    t_ring.closed = &ring->closed;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_rings.push_back(ring);
+    return ring.get();
+}
+
+// 在当前线程的缓冲区中预留一条记录，写入记录头，返回参数的写入位置
+char *AsyncLogger::reserve(log4cxx::Logger *logger, int level, FormatFn format, size_t payload, bool &dropped)
+{
+    size_t size = align8(sizeof(Header) + payload);
+    Ring *ring = local_ring();
+    if (size > ring->capacity / 4)
+    {
+        m_fallback.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    size_t offset = tail & (ring->capacity - 1);
+    size_t padding = offset + size > ring->capacity ? ring->capacity - offset : 0;
+
+    bool waited = false;
+    while (tail + padding + size - ring->head.load(std::memory_order_acquire) > ring->capacity)
+    {
+        // 等待期间切换回同步模式时由调用方同步输出
+        if (!m_running.load(std::memory_order_relaxed))
+            return nullptr;
+        if (m_overflow == OVERFLOW_DROP)
+        {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            dropped = true;
+            return nullptr;
+        }
+        if (!waited)
+        {
+            ring->blocked.fetch_add(1, std::memory_order_relaxed);
+            waited = true;
+        }
+        wakeup();
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    if (padding > 0)
+    {
+        auto pad = reinterpret_cast<Header *>(ring->buf.get() + offset);
+        pad->size = static_cast<uint32_t>(padding);
+        pad->level = ASYNC_LOG_PADDING;
+        offset = 0;
+    }
+
+    auto header = reinterpret_cast<Header *>(ring->buf.get() + offset);
+    header->size = static_cast<uint32_t>(size);
+    header->level = level;
+    header->time = now_ns();
+    header->logger = logger;
+    header->format = format;
+    ring->reserved = padding + size;
+
+    // 缓冲区过半时不等到下一个输出周期
+    if (tail + ring->reserved - ring->head.load(std::memory_order_relaxed) > ring->capacity / 2)
+        wakeup();
+    return reinterpret_cast<char *>(header + 1);
+}
+
+void AsyncLogger::commit()
+{
+    Ring *ring = static_cast<Ring *>(t_ring.ring.get());
+    ring->tail.store(ring->tail.load(std::memory_order_relaxed) + ring->reserved, std::memory_order_release);
+}
+
+// 唤醒后台线程，已经唤醒过时不重复加锁
+void AsyncLogger::wakeup()
+{
+    if (m_wakeup.exchange(true))
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+    }
+    m_cond.notify_one();
+}
+
+void AsyncLogger::run()
+{
+    while (m_running)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait_for(lock, std::chrono::milliseconds(m_flush_ms), [this]() { return m_wakeup.load(); });
+        }
+        m_wakeup = false;
+        drain();
+    }
+}
+
+// 取出所有缓冲区中的记录，按写入时间排序后输出，返回输出的记录数
+size_t AsyncLogger::drain()
+{
+    struct Item
+    {
+        int64_t time;
+        const Header *header;
+    };
+
+    std::lock_guard<std::mutex> drain_lock(m_drain_mutex);
+
+    std::vector<RingPtr> rings;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        rings = m_rings;
+    }
+
+    // 只取本次开始时已提交的记录，之后写入的留到下一次
+    std::vector<uint64_t> tails(rings.size());
+    std::vector<Item> items;
+    for (size_t i = 0; i < rings.size(); i++)
+    {
+        auto &ring = rings[i];
+        uint64_t head = ring->head.load(std::memory_order_relaxed);
+        tails[i] = ring->tail.load(std::memory_order_acquire);
+        while (head < tails[i])
+        {
+            auto header = reinterpret_cast<const Header *>(ring->buf.get() + (head & (ring->capacity - 1)));
+            if (header->level != ASYNC_LOG_PADDING)
+                items.push_back(Item{header->time, header});
+            head += header->size;
+        }
+    }
+
+    std::stable_sort(items.begin(), items.end(), [](const Item &a, const Item &b) { return a.time < b.time; });
+
+    for (auto &item : items)
+    {
+        item.header->format(reinterpret_cast<const char *>(item.header + 1), m_message);
+        item.header->logger->forcedLog(logger_util::to_log4cxx_level(item.header->level), m_message,
+                                       log4cxx::spi::LocationInfo::getLocationUnavailable());
+    }
+    m_written.fetch_add(items.size(), std::memory_order_relaxed);
+
+    // 输出完成后才释放空间，所属线程已退出的缓冲区取空后释放
+    bool closed = false;
+    for (size_t i = 0; i < rings.size(); i++)
+    {
+        rings[i]->head.store(tails[i], std::memory_order_release);
+        if (rings[i]->closed.load(std::memory_order_acquire) &&
+            rings[i]->tail.load(std::memory_order_acquire) == tails[i])
+            closed = true;
+    }
+    if (closed)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto it = m_rings.begin(); it != m_rings.end();)
+        {
+            auto &ring = *it;
+            if (ring->closed && ring->tail == ring->head)
+            {
+                m_dropped_base += ring->dropped;
+                m_blocked_base += ring->blocked;
+                it = m_rings.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    report_dropped();
+    return items.size();
+}
+
+// 有新的丢弃时输出告警，告警本身不经过缓冲区
+void AsyncLogger::report_dropped()
+{
+    uint64_t dropped = stats().dropped;
+    time_t now = time(nullptr);
+    if (dropped == m_reported_dropped || now - m_reported_time < ASYNC_LOG_REPORT_INTERVAL)
+        return;
+
+    static auto logger = log4cxx::Logger::getLogger("logger");
+    char buf[128];
+    snprintf(buf, sizeof(buf), "async log buffer full, dropped %llu records, total %llu",
+             static_cast<unsigned long long>(dropped - m_reported_dropped), static_cast<unsigned long long>(dropped));
+    logger->forcedLog(log4cxx::Level::getWarn(), buf, log4cxx::spi::LocationInfo::getLocationUnavailable());
+    m_reported_dropped = dropped;
+    m_reported_time = now;
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <log4cxx/level.h>
+#include <log4cxx/logger.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace logger_util
+{
+// 日志级别，与LOG_*宏对应
+enum LogLevel
+{
+    LEVEL_TRACE,
+    LEVEL_DEBUG,
+    LEVEL_INFO,
+    LEVEL_WARN,
+    LEVEL_ERROR
+};
+
+// 数值、枚举和指针参数按值保存，在后台线程中原样传给snprintf
+template <typename T, typename Enable = void> struct LogArg
+{
+    static_assert(std::is_scalar<T>::value, "log argument must be a number, pointer or string");
+    typedef T type;
+
+    static size_t size(const T &) { return sizeof(T); }
+    static char *write(char *p, const T &v)
+    {
+        memcpy(p, &v, sizeof(T));
+        return p + sizeof(T);
+    }
+    static T read(const char *&p)
+    {
+        T v;
+        memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+};
+
+// 字符串参数复制内容，调用返回后原字符串可以释放
+struct LogStringArg
+{
+    typedef const char *type;
+
+    static size_t size(size_t len) { return sizeof(uint32_t) + len + 1; }
+    static char *write(char *p, const char *s, size_t len)
+    {
+        uint32_t n = static_cast<uint32_t>(len);
+        memcpy(p, &n, sizeof(n));
+        memcpy(p + sizeof(n), s, len);
+        p[sizeof(n) + len] = '\0';
+        return p + sizeof(n) + len + 1;
+    }
+    static const char *read(const char *&p)
+    {
+        uint32_t n;
+        memcpy(&n, p, sizeof(n));
+        const char *s = p + sizeof(n);
+        p += sizeof(n) + n + 1;
+        return s;
+    }
+};
+
+struct LogCStringArg : LogStringArg
+{
+    static const char *str(const char *s) { return s ? s : "(null)"; }
+    static size_t size(const char *s) { return LogStringArg::size(strlen(str(s))); }
+    static char *write(char *p, const char *s) { return LogStringArg::write(p, str(s), strlen(str(s))); }
+};
+
+template <> struct LogArg<const char *> : LogCStringArg
+{
+};
+
+template <> struct LogArg<char *> : LogCStringArg
+{
+};
+
+template <> struct LogArg<std::string> : LogStringArg
+{
+    static size_t size(const std::string &s) { return LogStringArg::size(s.size()); }
+    static char *write(char *p, const std::string &s) { return LogStringArg::write(p, s.data(), s.size()); }
+};
+
+template <typename T> using LogArgOf = LogArg<typename std::decay<T>::type>;
+
+inline size_t args_size() { return 0; }
+
+template <typename T, typename... Args> inline size_t args_size(const T &v, const Args &...args)
+{
+    return LogArgOf<T>::size(v) + args_size(args...);
+}
+
+inline char *write_args(char *p) { return p; }
+
+template <typename T, typename... Args> inline char *write_args(char *p, const T &v, const Args &...args)
+{
+    return write_args(LogArgOf<T>::write(p, v), args...);
+}
+
+template <size_t... I> struct index_sequence
+{
+};
+
+template <size_t N, size_t... I> struct make_index_sequence : make_index_sequence<N - 1, N - 1, I...>
+{
+};
+
+template <size_t... I> struct make_index_sequence<0, I...>
+{
+    typedef index_sequence<I...> type;
+};
+
+// 按格式化字符串输出到out，out的容量不够时扩大后重试
+template <typename Tuple, size_t... I>
+inline void format_tuple(std::string &out, const char *fmt, const Tuple &args, index_sequence<I...>)
+{
+    if (out.size() < 256)
+        out.resize(256);
+    int n = snprintf(&out[0], out.size(), fmt, std::get<I>(args)...);
+    if (n < 0)
+    {
+        out.clear();
+        return;
+    }
+    if (static_cast<size_t>(n) >= out.size())
+    {
+        out.resize(n + 1);
+        snprintf(&out[0], out.size(), fmt, std::get<I>(args)...);
+    }
+    out.resize(n);
+}
+
+// 在后台线程中从记录还原参数并格式化
+template <typename... Args> struct RecordFormatter
+{
+    static void format(const char *fmt, const char *p, std::string &out)
+    {
+        // 花括号初始化保证参数按顺序读取
+        std::tuple<typename LogArgOf<Args>::type...> args{LogArgOf<Args>::read(p)...};
+        format_tuple(out, fmt, args, typename make_index_sequence<sizeof...(Args)>::type());
+    }
+};
+
+// 只有一个参数时原样输出，与同步模式一致
+template <> struct RecordFormatter<>
+{
+    static void format(const char *fmt, const char * /*p*/, std::string &out) { out.assign(fmt); }
+};
+
+template <typename... Args> inline void format_record(const char *payload, std::string &out)
+{
+    const char *p = payload;
+    const char *fmt = LogStringArg::read(p);
+    RecordFormatter<Args...>::format(fmt, p, out);
+}
+} // namespace logger_util
+
+// 异步日志的统计
+struct AsyncLogStats
+{
+    uint64_t written = 0;  // 已输出的记录数
+    uint64_t dropped = 0;  // 缓冲区满时丢弃的记录数
+    uint64_t blocked = 0;  // 缓冲区满时等待的记录数
+    uint64_t fallback = 0; // 记录过大，同步输出的记录数
+    size_t threads = 0;    // 写过日志的线程数(缓冲区数)
+};
+
+/**
+ * @brief 异步日志
+ *
+ * 每个写日志的线程有自己的单生产者单消费者无锁环形缓冲区，LOG_*宏只把日志级别、格式化字符串和参数
+ * 复制到缓冲区，不加锁、不分配内存、不调用snprintf。后台线程每隔flush_ms毫秒(缓冲区过半时立即)
+ * 取出所有线程的记录，按写入时间排序后格式化，批量交给log4cxx输出。
+ *
+ * 缓冲区满时按overflow策略丢弃或等待，并分别计数；丢弃时后台线程会输出告警。
+ * 异步模式下log4cxx记录的时间和线程为后台线程输出时的时间和线程。
+ */
+class AsyncLogger
+{
+  public:
+    typedef void (*FormatFn)(const char *payload, std::string &out);
+
+    // 缓冲区满时的处理策略
+    enum Overflow
+    {
+        OVERFLOW_DROP,  // 丢弃新的记录
+        OVERFLOW_BLOCK, // 等待后台线程取出记录
+    };
+
+    static AsyncLogger &getinstance()
+    {
+        static AsyncLogger *instance = new AsyncLogger();
+        return *instance;
+    }
+
+    /**
+     * @brief 开启异步日志
+     * @param buffer_size 每个线程的缓冲区大小(字节)，向上取整为2的幂
+     * @param overflow 缓冲区满时的处理策略
+     * @param flush_ms 后台线程输出的间隔(毫秒)
+     */
+    void start(size_t buffer_size, Overflow overflow, int flush_ms);
+
+    // 输出缓冲区中的全部日志并切换回同步模式，用于进程退出前
+    void stop();
+
+    bool running() const { return m_running.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 写入一条日志，调用方已经检查过日志级别
+     * @return 已写入或已按策略丢弃返回true，异步日志未开启或记录过大时返回false，由调用方同步输出
+     */
+    template <typename Msg, typename... Args>
+    bool append(log4cxx::Logger *logger, int level, const Msg &msg, const Args &...args)
+    {
+        size_t size = logger_util::args_size(msg, args...);
+        bool dropped = false;
+        char *p = reserve(logger, level, &logger_util::format_record<Args...>, size, dropped);
+        if (!p)
+            return dropped;
+
+        logger_util::write_args(p, msg, args...);
+        commit();
+        return true;
+    }
+
+    AsyncLogStats stats();
+
+  private:
+    struct Ring;
+    struct Header;
+    typedef std::shared_ptr<Ring> RingPtr;
+
+    AsyncLogger() {}
+
+    std::atomic<bool> m_running{false};
+    size_t m_buffer_size = 0;
+    Overflow m_overflow = OVERFLOW_DROP;
+    int m_flush_ms = 10;
+
+    std::mutex m_mutex; // 保护m_rings和已释放缓冲区的计数
+    std::condition_variable m_cond;
+    std::atomic<bool> m_wakeup{false}; // 需要立即输出
+    std::vector<RingPtr> m_rings;
+    uint64_t m_dropped_base = 0; // 已释放的缓冲区的丢弃数
+    uint64_t m_blocked_base = 0; // 已释放的缓冲区的等待数
+
+    std::atomic<uint64_t> m_written{0};
+    std::atomic<uint64_t> m_fallback{0};
+
+    std::mutex m_drain_mutex;        // 同一时间只有一个线程取出记录，保护以下成员
+    std::string m_message;           // 格式化缓冲区
+    uint64_t m_reported_dropped = 0; // 已告警的丢弃数
+    time_t m_reported_time = 0;
+
+    Ring *local_ring();
+    char *reserve(log4cxx::Logger *logger, int level, FormatFn format, size_t payload, bool &dropped);
+    void commit();
+    void wakeup();
+    void run();
+    size_t drain();
+    void report_dropped();
+};
+
+namespace logger_util
+{
+const log4cxx::LevelPtr &to_log4cxx_level(int level);
+} // namespace logger_util
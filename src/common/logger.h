@@ -3,6 +3,8 @@
 #include <log4cxx/logger.h>
 #include <log4cxx/propertyconfigurator.h>
 
+#include "async_logger.h"
+
 #include <cstdarg>
 #include <memory>
 #include <string>
@@ -63,11 +65,35 @@ template <typename... Args> inline std::string process_log_message(const char *f
 {
     return format_message(fmt, args...);
 }
+
+// 写入异步日志缓冲区，调用方已经检查过异步日志已开启和日志级别；
+// 记录过大或异步日志刚刚关闭时用已经求值的参数同步输出，参数不会再次求值
+template <typename... Args> inline void async_log(const log4cxx::LoggerPtr &logger, int level, const Args &...args)
+{
+    if (!AsyncLogger::getinstance().append(&*logger, level, args...))
+        logger->forcedLog(to_log4cxx_level(level), process_log_message(args...),
+                          log4cxx::spi::LocationInfo::getLocationUnavailable());
+}
 } // namespace logger_util
 
-// 最终宏定义
-#define LOG_TRACE(logger, ...) LOG4CXX_TRACE(logger, logger_util::process_log_message(__VA_ARGS__))
-#define LOG_DEBUG(logger, ...) LOG4CXX_DEBUG(logger, logger_util::process_log_message(__VA_ARGS__))
-#define LOG_INFO(logger, ...)  LOG4CXX_INFO(logger, logger_util::process_log_message(__VA_ARGS__))
-#define LOG_WARN(logger, ...)  LOG4CXX_WARN(logger, logger_util::process_log_message(__VA_ARGS__))
-#define LOG_ERROR(logger, ...) LOG4CXX_ERROR(logger, logger_util::process_log_message(__VA_ARGS__))
\ No newline at end of file
+// 最终宏定义，开启异步日志时写入线程本地缓冲区，否则同步输出
+// 先判断模式和日志级别再对参数求值，每条路径只求值一次，级别未开启时不求值
+#define LOG_MESSAGE(logger, level, LOG4CXX_MACRO, ...)                                                                 \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (AsyncLogger::getinstance().running())                                                                      \
+        {                                                                                                              \
+            if ((logger)->isEnabledFor(logger_util::to_log4cxx_level(level)))                                          \
+                logger_util::async_log(logger, level, __VA_ARGS__);                                                    \
+        }                                                                                                              \
+        else                                                                                                           \
+        {                                                                                                              \
+            LOG4CXX_MACRO(logger, logger_util::process_log_message(__VA_ARGS__));                                      \
+        }                                                                                                              \
+    } while (0)
+
+#define LOG_TRACE(logger, ...) LOG_MESSAGE(logger, logger_util::LEVEL_TRACE, LOG4CXX_TRACE, __VA_ARGS__)
+#define LOG_DEBUG(logger, ...) LOG_MESSAGE(logger, logger_util::LEVEL_DEBUG, LOG4CXX_DEBUG, __VA_ARGS__)
+#define LOG_INFO(logger, ...)  LOG_MESSAGE(logger, logger_util::LEVEL_INFO, LOG4CXX_INFO, __VA_ARGS__)
+#define LOG_WARN(logger, ...)  LOG_MESSAGE(logger, logger_util::LEVEL_WARN, LOG4CXX_WARN, __VA_ARGS__)
+#define LOG_ERROR(logger, ...) LOG_MESSAGE(logger, logger_util::LEVEL_ERROR, LOG4CXX_ERROR, __VA_ARGS__)
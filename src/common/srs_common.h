@@ -153,4 +153,27 @@ static int Fun_error(int err, std::string msg)
 #define ERROR_SOCKET_SETCLOSEEXEC           1080
 #define ERROR_SOCKET_ACCEPT                 1081
 
+///////////////////////////////////////////////////////
+// RTMP protocol error.
+///////////////////////////////////////////////////////
+#define ERROR_RTMP_PLAIN_REQUIRED           2000
+#define ERROR_RTMP_CHUNK_START              2001
+#define ERROR_RTMP_MSG_INVALID_SIZE         2002
+#define ERROR_RTMP_AMF0_DECODE              2003
+#define ERROR_RTMP_AMF0_INVALID             2004
+#define ERROR_RTMP_REQ_CONNECT              2005
+#define ERROR_RTMP_REQ_TCURL                2006
+#define ERROR_RTMP_MESSAGE_DECODE           2007
+#define ERROR_RTMP_CHUNK_SIZE               2010
+#define ERROR_RTMP_HANDSHAKE                2016
+#define ERROR_RTMP_STREAM_NOT_FOUND         2017
+
+///////////////////////////////////////////////////////
+// HLS and codec error.
+///////////////////////////////////////////////////////
+#define ERROR_HLS_DECODE_ERROR              3001
+#define ERROR_HLS_OPEN_FAILED               3003
+#define ERROR_HLS_WRITE_FAILED              3004
+#define ERROR_HLS_AVC_SAMPLE_SIZE           3006
+
 #endif
\ No newline at end of file
@@ -1,37 +1,260 @@
 #include "proxytaskmgr.h"
+#include "../common/app_config.h"
+#include "../http/hls_cache.h"
+#include "../http/wait_limiter.h"
+#include "../media/srs_app_rtmp_server.hpp"
+#include "../media/srs_app_transmux.hpp"
 #include "../process/srs_app_process.hpp"
+#include "../utils/dir_watcher.hpp"
+#include "../utils/file_system.hpp"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
 
 using namespace std;
 
-// IngestTask类实现 - 负责管理FFMPEG转码任务
+// 崩溃循环状态下探测源站的TCP连接超时(毫秒)
+#define TASK_PROBE_TIMEOUT_MS 1000
+// 定时检查的周期(毫秒)，与main中的定时器一致，单轮检查超过该时长时告警
+#define TASK_CHECK_INTERVAL_MS 3000
+// 切片间隔估计值的上限，为hls_time的倍数，源站偶尔卡顿不会让停滞检查长期失效
+#define TASK_SEGMENT_INTERVAL_MAX 4
+
+// IngestTask类实现 - 负责管理拉流转HLS任务
+
+// 指标对象在放入任务表之前创建，HTTP线程不持有任务锁也可以访问
+IngestTask::IngestTask(const std::string &dest) : metrics(std::make_shared<StreamMetrics>(dest)) {
+}
 
 IngestTask::~IngestTask() {
-    free(ffmpeg);
+    delete ingester;
 }
 
-// 启动FFMPEG进程
+// 启动拉流
 int IngestTask::start() {
-    return ffmpeg->start();
+    return ingester->start();
+}
+
+// 从配置文件读取重启策略
+void RestartPolicy::load() {
+    auto &conf = AppConfig::getinstance();
+    backoff_min = std::max(1, static_cast<int>(conf.get_int("restart_backoff_min", 1)));
+    backoff_max = std::max(backoff_min, static_cast<int>(conf.get_int("restart_backoff_max", 60)));
+    crash_loop = std::max(0, static_cast<int>(conf.get_int("crash_loop_threshold", 5)));
+    probe_interval = std::max(1, static_cast<int>(conf.get_int("crash_loop_probe_interval", 30)));
+    stable_time = std::max(0, static_cast<int>(conf.get_int("restart_stable_time", 30)));
+}
+
+// 给等待时长加上±20%的随机抖动
+static int add_jitter(int seconds) {
+    static thread_local std::minstd_rand rng(std::random_device{}());
+    int range = seconds / 5;
+    if (range <= 0)
+        return seconds;
+    return seconds - range + static_cast<int>(rng() % (2 * range + 1));
+}
+
+// 探测源站是否可以建立TCP连接，代价远小于启动一次拉流
+// url: 源地址，例如rtmp://host:port/app/stream，无法解析的地址视为可用
+static bool probe_source(const std::string &url) {
+    auto pos = url.find("://");
+    if (pos == std::string::npos)
+        return true;
+
+    auto scheme = url.substr(0, pos);
+    auto hostport = url.substr(pos + 3);
+    hostport = hostport.substr(0, hostport.find_first_of("/?"));
+
+    std::string port = scheme == "rtmp" ? "1935" : scheme == "rtsp" ? "554" : scheme == "https" ? "443" : "80";
+    auto colon = hostport.rfind(':');
+    if (colon != std::string::npos && hostport.find(']', colon) == std::string::npos) {
+        port = hostport.substr(colon + 1);
+        hostport = hostport.substr(0, colon);
+    }
+    if (hostport.size() > 2 && hostport.front() == '[' && hostport.back() == ']')
+        hostport = hostport.substr(1, hostport.size() - 2);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *result = nullptr;
+    if (getaddrinfo(hostport.c_str(), port.c_str(), &hints, &result) != 0 || !result)
+        return false;
+
+    bool ok = false;
+    int fd = ::socket(result->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd >= 0) {
+        int r = ::connect(fd, result->ai_addr, result->ai_addrlen);
+        if (r == 0) {
+            ok = true;
+        } else if (errno == EINPROGRESS) {
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            int error = 0;
+            socklen_t len = sizeof(error);
+            ok = ::poll(&pfd, 1, TASK_PROBE_TIMEOUT_MS) == 1 &&
+                 getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0;
+        }
+        ::close(fd);
+    }
+    freeaddrinfo(result);
+    return ok;
+}
+
+// 按重启策略检查任务
+// now: 当前时间
+void IngestTask::supervise(time_t now) {
+    auto logger = MyLogger::getLogger("task");
+
+    // 首次启动由启动调度器安排
+    if (queued)
+        return;
+
+    if (running) {
+        if (ingester->started())
+            return;
+
+        // 拉流结束，运行时间足够长时视为正常结束，不累计失败次数
+        running = false;
+        if (now - starttime >= policy.stable_time)
+            failures = 0;
+        failures++;
+
+        if (policy.crash_loop > 0 && failures >= policy.crash_loop) {
+            if (!parked) {
+                LOG_WARN(logger, "task %s crash loop, failures:%d, restarts:%d, probe source every %ds.",
+                         dest.c_str(), failures, restarts, policy.probe_interval);
+            }
+            parked = true;
+            backoff = add_jitter(policy.probe_interval);
+        } else if (failures <= 1) {
+            backoff = 0;
+        } else {
+            // 从backoff_min开始按2倍增长，移位次数有上限，避免溢出
+            int shift = std::min(failures - 2, 16);
+            backoff = add_jitter(std::min(policy.backoff_max, policy.backoff_min << shift));
+        }
+        next_start = now + backoff;
+        schedule_wakeup(now);
+    }
+
+    if (now < next_start)
+        return;
+
+    if (parked) {
+        // 崩溃循环状态下只探测源站，可以连接时再启动拉流，再失败一次就重新进入该状态
+        // 探测在探测线程池中进行，不持有任务锁，完成后由probe_task再次调用本函数
+        if (!probe_ok) {
+            if (!probing)
+                probing = ProxytaskMgr::getinstance().probe_task(dest, src);
+            return;
+        }
+        LOG_INFO(logger, "task %s source is reachable, leave crash loop.", dest.c_str());
+        probe_ok = false;
+        parked = false;
+        failures = policy.crash_loop - 1;
+    }
+
+    if (starttime > 0)
+        restarts++;
+    if (failures > 0) {
+        LOG_INFO(logger, "task %s restart, restarts:%d, failures:%d, backoff:%ds", dest.c_str(), restarts, failures,
+                 backoff);
+    }
+
+    // 停滞检查从本次启动开始计时
+    last_segment = 0;
+    segment_interval = 0;
+
+    // 启动失败时同样记为运行，下次检查发现未在运行时计入失败
+    int err = 0;
+    if ((err = start()) != srs_success) {
+        LOG_WARN(logger, "task %s start failed, err:%d", dest.c_str(), err);
+    }
+    running = true;
+    starttime = now;
+}
+
+// 到下次启动时间时再次检查
+// now: 当前时间
+void IngestTask::schedule_wakeup(time_t now) {
+    wakeup.cancel();
+    if (next_start <= now)
+        return;
+
+    auto dest = this->dest;
+    wakeup = TimingWheel::getinstance().schedule(static_cast<int64_t>(next_start - now) * 1000, [dest]() {
+        ProxytaskMgr::getinstance().on_task_timer(dest);
+    });
+}
+
+// 停止拉流并清除失败记录
+void IngestTask::reset() {
+    wakeup.cancel();
+    stop();
+    running = false;
+    failures = 0;
+    backoff = 0;
+    parked = false;
+    probing = false;
+    probe_ok = false;
+    next_start = 0;
+    starttime = 0;
+}
+
+// 任务当前状态
+const char *IngestTask::state() const {
+    if (!enable)
+        return "disabled";
+    if (!active)
+        return "idle";
+    if (queued)
+        return "queued";
+    if (parked)
+        return "crash_loop";
+    if (!running)
+        return "backoff";
+    return "running";
 }
 
-// 停止FFMPEG进程
+// 更新任务的指标
+void IngestTask::update_metrics() {
+    metrics->state.store(state(), std::memory_order_relaxed);
+    metrics->restarts.store(restarts, std::memory_order_relaxed);
+    metrics->stalls.store(stalls, std::memory_order_relaxed);
+    metrics->last_segment.store(running ? last_segment.load() : 0, std::memory_order_relaxed);
+}
+
+// 停止拉流
 void IngestTask::stop() {
-    ffmpeg->stop();
+    ingester->stop();
 }
 
-// 检查FFMPEG进程状态
+// 检查拉流状态
 srs_error_t IngestTask::cycle() {
-    return ffmpeg->cycle();
+    return ingester->cycle();
 }
 
-// 快速停止FFMPEG进程
+// 快速停止拉流
 void IngestTask::fast_stop() {
-    ffmpeg->fast_stop();
+    ingester->fast_stop();
 }
 
-// 强制终止FFMPEG进程
+// 强制终止拉流
 void IngestTask::fast_kill() {
-    ffmpeg->fast_kill();
+    ingester->fast_kill();
 }
 
 // 字符串替换工具函数
@@ -53,35 +276,117 @@ std::string replaceAll(const std::string& instr, const std::string& from, const
 // 初始化转码任务
 // src: 源RTMP流地址
 // dest: 目标HLS路径
-void IngestTask::init(std::string src, std::string dest) {
+// opts: 任务的可选参数
+void IngestTask::init(std::string src, std::string dest, const TaskOptions &opts) {
     this->src = src;
     this->dest = dest;
+    this->backend = opts.backend.empty() ? AppConfig::getinstance().get_string("ingest_backend", "ffmpeg") : opts.backend;
+    this->on_demand = opts.on_demand < 0 ? AppConfig::getinstance().get_bool("on_demand", false) : opts.on_demand != 0;
+    this->active = !on_demand;
+    this->priority = opts.priority;
+    auto type = opts.segment_type.empty() ? AppConfig::getinstance().get_string("hls_segment_type", "ts") : opts.segment_type;
+    this->segment_type = type == "fmp4" ? "fmp4" : "ts";
+    this->policy.load();
 
     // 创建HLS输出目录和文件路径
-    std::string m3u8_dir = "./html" + dest;
+    m3u8_dir = "./html" + dest;
     std::string m3u8 = m3u8_dir + std::string("/hls.m3u8");
-    string cmd = "mkdir -p " + string(m3u8_dir);
-    system(cmd.c_str());
+    FileSystem::getinstance().mkdirs(m3u8_dir);
 
-    // 设置FFMPEG路径并确保可执行
-    string ffmpeg_path = "./bin/ffmpeg";
-    string cmd1 = "chmod +x " + ffmpeg_path;
-    system(cmd.c_str());
+    // 监听输出目录，切片和播放列表更新时使HTTP缓存失效
+    HlsCache::getinstance().watch_dir(m3u8_dir);
+    Metrics::getinstance().add_stream(metrics);
 
-    // 创建FFMPEG实例
-    ffmpeg = new SrsFFMPEG(ffmpeg_path);
     // 将目标路径中的'/'替换为'_'用于日志文件名
     auto name = replaceAll(dest, "/", "_");
     string log_file = "./logs/ffmpeg" + name + ".log";
-    
-    // 初始化FFMPEG任务
-    ffmpeg->initialize(src, m3u8, log_file);
+
+    if (backend == "native") {
+        // 内置转封装引擎，所有任务共享线程池，不启动外部进程
+        ingester = new SrsNativeIngester();
+    } else {
+        // 设置FFMPEG路径并确保可执行，只在第一个任务时检查
+        string ffmpeg_path = "./bin/ffmpeg";
+        FileSystem::getinstance().ensure_executable(ffmpeg_path);
+
+        backend = "ffmpeg";
+        ingester = new SrsFFMPEG(ffmpeg_path);
+    }
+
+    // 初始化拉流任务
+    ingester->initialize(src, m3u8, log_file);
+    ingester->set_segment_type(segment_type);
+
+    // 进程退出时立即重启，按目标路径查找任务，任务删除后通知自然失效
+    ingester->set_exit_handler([dest]() {
+        ProxytaskMgr::getinstance().on_task_exit(dest);
+    });
 }
 
 // ProxytaskMgr类实现 - 负责管理所有转码任务
 
+thread_local std::string ProxytaskMgr::m_errmsg;
+
+static bool ends_with(const std::string &s, const std::string &suffix) {
+    return s.size() >= suffix.size() && !s.compare(s.size() - suffix.size(), suffix.size(), suffix);
+}
+
 // 初始化任务管理器
+// 启动内置RTMP推流服务，推流rtmp://host:rtmp_port/app/stream直接切片到./html/app/stream
 int ProxytaskMgr::init() {
+    auto &conf = AppConfig::getinstance();
+    m_idle_timeout = static_cast<int>(conf.get_int("on_demand_idle_timeout", 60));
+    m_wait_timeout = static_cast<int>(conf.get_int("on_demand_wait_timeout", 10));
+    m_hls_time = std::max(1, static_cast<int>(conf.get_int("hls_time", 2)));
+    m_stall_factor = std::max(0, static_cast<int>(conf.get_int("stall_timeout_factor", 4)));
+    m_stall_first_timeout = std::max(1, static_cast<int>(conf.get_int("stall_first_segment_timeout", 30)));
+
+    // 批量启动的速率和并发上限
+    m_startup.configure(static_cast<int>(conf.get_int("startup_rate", 50)),
+                        static_cast<int>(conf.get_int("startup_concurrency", 100)),
+                        static_cast<int>(conf.get_int("startup_ready_timeout", 15)));
+
+    // 任务检查线程池，启动和重启任务在这些线程中并行执行
+    auto threads = conf.get_int("supervise_threads", 4);
+    if (!m_supervisors)
+        m_supervisors.reset(new WorkerPool(threads > 0 ? static_cast<size_t>(threads) : 1));
+    auto probers = conf.get_int("crash_loop_probe_threads", 8);
+    if (!m_probers)
+        m_probers.reset(new WorkerPool(probers > 0 ? static_cast<size_t>(probers) : 1));
+
+    // 播放列表生成或更新时唤醒等待首个播放列表的请求，生成切片时记录任务的进度，需在监听任何目录之前注册
+    DirWatcher::getinstance().add_listener(
+        [this](const std::string &dir, const std::string &name, uint32_t mask) {
+            if (name == "hls.m3u8") {
+                std::lock_guard<std::mutex> lock(m_wait_mutex);
+                m_playlist_cond.notify_all();
+            } else if ((mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && (ends_with(name, ".ts") || ends_with(name, ".m4s"))) {
+                on_segment(dir, time(0));
+            }
+        });
+
+    m_rtmp_port = conf.get_int("rtmp_port", 1936);
+    if (m_rtmp_port <= 0 || m_rtmp_server)
+        return 0;
+
+    auto server = new SrsRtmpServer();
+    server->set_hls_options(static_cast<double>(conf.get_int("hls_time", 2)),
+                            static_cast<int>(conf.get_int("hls_list_size", 5)), conf.get_int("hls_part_ms", 0) / 1000.0,
+                            conf.get_string("hls_segment_type", "ts") == "fmp4");
+    // 目标路径已被拉流任务占用时拒绝推流，避免两路写同一个目录
+    server->set_publish_filter([this](const std::string &dest) {
+        return !m_tasks.contains(dest);
+    });
+
+    srs_error_t err = server->listen("0.0.0.0", m_rtmp_port);
+    if (err != srs_success) {
+        m_errmsg = "rtmp server listen failed. port:" + std::to_string(m_rtmp_port);
+        delete server;
+        return err;
+    }
+
+    // 推流服务随进程一直运行，不在析构时释放：退出时转封装引擎可能已先于管理器析构
+    m_rtmp_server = server;
     return 0;
 }
 
@@ -90,39 +395,598 @@ int ProxytaskMgr::load_from_db() {
     return 0;
 }
 
+// 检查源地址的协议
+// src: 源流地址
+bool ProxytaskMgr::is_allowed_src(const std::string &src) {
+    static const char *schemes[] = {"rtmp", "rtmps", "rtsp", "http", "https"};
+
+    auto pos = src.find("://");
+    if (pos == std::string::npos)
+        return false;
+    auto scheme = src.substr(0, pos);
+    std::transform(scheme.begin(), scheme.end(), scheme.begin(), ::tolower);
+    for (auto name : schemes) {
+        if (scheme == name)
+            return true;
+    }
+    return false;
+}
+
+// 创建任务并放入任务表
+// src: 源RTMP流地址
+// dest: 目标HLS路径
+// opts: 任务的可选参数
+ProxytaskMgr::TaskPtr ProxytaskMgr::create_task(const std::string &src, const std::string &dest,
+                                                const TaskOptions &opts) {
+    if (src.empty() || dest.empty()) {
+        m_errmsg = "failed. parameter is empty.";
+        return TaskPtr();
+    }
+    if (!is_allowed_src(src)) {
+        m_errmsg = "failed. unsupported src " + src;
+        return TaskPtr();
+    }
+    if (m_shutting_down) {
+        m_errmsg = "failed. server is shutting down.";
+        return TaskPtr();
+    }
+
+    // 先持有任务锁再放入任务表，其他线程查到该任务时会等到初始化完成
+    TaskPtr ptask = std::make_shared<IngestTask>(dest);
+    std::lock_guard<std::mutex> lock(ptask->mutex);
+    if (!m_tasks.insert(dest, ptask, [this](const std::string &d) { return is_publishing(d); })) {
+        m_errmsg = is_publishing(dest) ? "failed." + dest + " is being published." : "failed." + dest + " exists.";
+        return TaskPtr();
+    }
+
+    ptask->init(src, dest, opts);
+
+    // 按需启动的任务等到有人请求播放列表时再启动，其他任务由启动调度器启动
+    ptask->queued = ptask->active;
+    ptask->update_metrics();
+    return ptask;
+}
+
+// 添加新的转码任务
+// src: 源RTMP流地址
+// dest: 目标HLS路径
+// opts: 任务的可选参数
+int ProxytaskMgr::add_task(std::string src, std::string dest, const TaskOptions &opts) {
+    auto ptask = create_task(src, dest, opts);
+    if (!ptask)
+        return -1;
+
+    if (ptask->queued)
+        m_startup.submit(std::vector<TaskPtr>{ptask});
+    return 0;
+}
+
+// 批量添加任务
+// tasks: 任务配置
+// created: 按顺序返回创建的任务，可以为空
+int ProxytaskMgr::add_tasks(const std::vector<TaskConfig> &tasks, std::vector<TaskPtr> *created) {
+    auto logger = MyLogger::getLogger("task");
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<TaskPtr> queued;
+    int added = 0;
+
+    for (auto &conf : tasks) {
+        auto ptask = create_task(conf.src, conf.dest, conf.opts);
+        if (created)
+            created->push_back(ptask);
+        if (!ptask) {
+            LOG_WARN(logger, "add task %s failed. %s", conf.dest.c_str(), m_errmsg.c_str());
+            continue;
+        }
+        added++;
+        if (ptask->queued)
+            queued.push_back(ptask);
+    }
+
+    // 全部加入后再提交，保证整批任务按优先级排序
+    m_startup.submit(queued);
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    LOG_INFO(logger, "add %d tasks, %d to start, init cost:%dms", added, static_cast<int>(queued.size()),
+             static_cast<int>(elapsed));
+    return added;
+}
+
+// 删除转码任务
+// dest: 目标HLS路径
+// owner: 只删除该任务，为空时删除目标路径上的任意任务
+int ProxytaskMgr::del_task(std::string dest, const TaskPtr &owner) {
+    auto ptask = m_tasks.erase(dest, owner);
+    if (!ptask) {
+        m_errmsg = "dest not found. " + dest;
+        return -1;
+    }
+
+    retire(ptask.get());
+    return 0;
+}
+
+// 停止已从任务表删除的任务
+// task: 要停止的任务
+void ProxytaskMgr::retire(IngestTask *task) {
+    // 其他线程可能还持有该任务，标记后它们不会再启动它
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->enable = false;
+    task->wakeup.cancel();
+    task->stop();
+
+    // 在这里而不是析构时取消监听，同一目标路径的新任务可能已经开始监听该目录
+    HlsCache::getinstance().unwatch_dir(task->m3u8_dir);
+    Metrics::getinstance().remove_stream(task->metrics);
+}
+
+// 目标路径是否正在推流
+// dest: 目标HLS路径
+bool ProxytaskMgr::is_publishing(const std::string &dest) const {
+    return m_rtmp_server && m_rtmp_server->is_publishing(dest);
+}
+
+// 批量删除和添加任务
+// adds: 要添加的任务
+// dels: 要删除的目标路径
+int ProxytaskMgr::apply_batch(const std::vector<TaskConfig> &adds, const std::vector<std::string> &dels) {
+    if (m_shutting_down) {
+        m_errmsg = "failed. server is shutting down.";
+        return -1;
+    }
+    for (auto &conf : adds) {
+        if (conf.src.empty() || conf.dest.empty()) {
+            m_errmsg = "failed. parameter is empty.";
+            return -1;
+        }
+        if (!is_allowed_src(conf.src)) {
+            m_errmsg = "failed. unsupported src " + conf.src;
+            return -1;
+        }
+    }
+    for (auto &dest : dels) {
+        if (dest.empty()) {
+            m_errmsg = "failed. parameter is empty.";
+            return -1;
+        }
+    }
+
+    // 新任务先加锁再放入任务表，其他线程查到它们时会等到初始化完成
+    std::vector<std::pair<std::string, TaskPtr>> inserts;
+    std::vector<std::unique_lock<std::mutex>> locks;
+    inserts.reserve(adds.size());
+    locks.reserve(adds.size());
+    for (auto &conf : adds) {
+        auto ptask = std::make_shared<IngestTask>(conf.dest);
+        locks.emplace_back(ptask->mutex);
+        inserts.emplace_back(conf.dest, ptask);
+    }
+
+    std::vector<TaskPtr> erased;
+    std::string conflict;
+    if (!m_tasks.batch(inserts, dels, erased, conflict, [this](const std::string &d) { return is_publishing(d); })) {
+        m_errmsg = "failed. conflict on " + conflict + ", nothing changed.";
+        return -1;
+    }
+
+    // 先停止被删除的任务，被替换的目标路径由新任务重新监听
+    for (auto &ptask : erased)
+        retire(ptask.get());
+
+    std::vector<TaskPtr> queued;
+    for (size_t i = 0; i < adds.size(); i++) {
+        auto &ptask = inserts[i].second;
+        ptask->init(adds[i].src, adds[i].dest, adds[i].opts);
+        ptask->queued = ptask->active;
+        ptask->update_metrics();
+        if (ptask->queued)
+            queued.push_back(ptask);
+    }
+    locks.clear();
+
+    m_startup.submit(queued);
+
+    auto logger = MyLogger::getLogger("task");
+    LOG_INFO(logger, "apply batch. added:%d, deleted:%d", static_cast<int>(adds.size()), static_cast<int>(erased.size()));
+    return 0;
+}
+
+// 启动所有任务
+int ProxytaskMgr::startAll() {
+    for (auto &ptask : m_tasks.snapshot()) {
+        std::lock_guard<std::mutex> lock(ptask->mutex);
+        if (ptask->enable && ptask->active) {
+            ptask->supervise(time(0));
+            ptask->update_metrics();
+        }
+    }
+    return 0;
+}
+
 // 启动新的转码任务
 int ProxytaskMgr::start(std::string src, std::string dest) {
     return add_task(src, dest);
 }
 
+// 快速停止指定任务
+// dest: 目标HLS路径
+int ProxytaskMgr::fast(std::string dest) {
+    auto ptask = m_tasks.find(dest);
+    if (!ptask)
+        return 0;
+
+    std::lock_guard<std::mutex> lock(ptask->mutex);
+    ptask->stop();
+    return 0;
+}
+
 // 定期检查所有任务状态
 // timecnt: 检查计数器
 int ProxytaskMgr::check(int timecnt) {
-    // 检查SRS服务是否正常运行
-    if (m_srs_process) {
-        m_srs_process->cycle();  // 检查进程状态
-        m_srs_process->start();  // 如果进程不存在则重启
-    }
-
-    // 检查所有FFMPEG转码任务
-    for (auto &item : m_taskMap) {    
-        int err = 0;
-        auto task = item.second;
-        
-        // 检查FFMPEG状态
-        if ((err = task->cycle()) != srs_success) {
-            printf("ingest cycle. err:%d\n", err);
+    // 退出过程中不再检查和重启任务
+    if (m_shutting_down)
+        return 0;
+
+    // 关闭长时间没有数据的推流连接
+    if (m_rtmp_server) {
+        m_rtmp_server->cycle();
+    }
+
+    // 检查所有转码任务，进程退出已由回收线程处理，这里不再逐个waitpid
+    // 任务按目标路径的哈希值固定分给各个检查线程，每个线程依次处理自己的分区，一个任务启动慢只影响同一分区
+    auto begin = std::chrono::steady_clock::now();
+    auto tasks = m_tasks.entries();
+    time_t now = time(0);
+
+    // 按任务表中的目标路径分区，不读取可能正在初始化的任务
+    size_t n = m_supervisors ? m_supervisors->size() : 1;
+    std::vector<std::vector<TaskPtr>> partitions(n);
+    for (auto &task : tasks) {
+        partitions[std::hash<std::string>()(task.first) % n].push_back(task.second);
+    }
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t remaining = n;
+    for (auto &partition : partitions) {
+        auto job = [&, now]() {
+            for (auto &task : partition) {
+                check_task(task.get(), now);
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--remaining == 0)
+                cond.notify_one();
+        };
+        if (!m_supervisors || !m_supervisors->submit(job))
+            job();
+    }
+
+    // 等待所有分区检查完毕，下一轮检查不会与本轮重叠
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&remaining]() { return remaining == 0; });
+    }
+
+    auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+    auto elapsed = elapsed_us / 1000;
+    m_pass_ms = elapsed;
+    Metrics::getinstance().on_supervision_pass(elapsed_us, tasks.size());
+    m_pass_tasks = tasks.size();
+    if (elapsed > TASK_CHECK_INTERVAL_MS) {
+        auto logger = MyLogger::getLogger("task");
+        LOG_WARN(logger, "supervision falls behind. pass:%d, tasks:%d, cost:%dms, interval:%dms, threads:%d", timecnt,
+                 static_cast<int>(tasks.size()), static_cast<int>(elapsed), TASK_CHECK_INTERVAL_MS,
+                 static_cast<int>(n));
+    }
+
+    return 0;
+}
+
+// 退出前停止所有任务
+// timeout_ms: 等待退出的最长时间(毫秒)
+int ProxytaskMgr::shutdown(int timeout_ms) {
+    auto logger = MyLogger::getLogger("task");
+    m_shutting_down = true;
+
+    auto begin = std::chrono::steady_clock::now();
+    auto deadline = begin + std::chrono::milliseconds(timeout_ms);
+    std::vector<TaskPtr> pending = m_tasks.snapshot(); // 还没有发送SIGTERM的任务
+    std::vector<TaskPtr> stopping;                     // 已发送SIGTERM，等待退出的任务
+    size_t total = pending.size();
+    LOG_INFO(logger, "shutdown %d tasks, timeout:%dms", static_cast<int>(total), timeout_ms);
+
+    while (!pending.empty() || !stopping.empty()) {
+        // 任务锁被其他线程占用时不等待，下一轮再试，保证总耗时有上限
+        std::vector<TaskPtr> next;
+        for (auto &task : pending) {
+            std::unique_lock<std::mutex> lock(task->mutex, std::try_to_lock);
+            if (!lock.owns_lock()) {
+                next.push_back(task);
+                continue;
+            }
+            // 标记后其他线程不会再启动它，进程退出的回调也不会重启
+            task->enable = false;
+            task->wakeup.cancel();
+            task->fast_stop();
+            stopping.push_back(task);
         }
-        
-        // 尝试重启失败的任务
-        if ((err = task->start()) != srs_success) {
-            printf("ingester start. err:%d\n", err);
+        pending.swap(next);
+
+        // 进程由回收线程回收，这里只查询状态，不逐个等待
+        next.clear();
+        for (auto &task : stopping) {
+            std::unique_lock<std::mutex> lock(task->mutex, std::try_to_lock);
+            if (lock.owns_lock()) {
+                task->cycle();
+                if (!task->ingester->started())
+                    continue;
+            }
+            next.push_back(task);
         }
+        stopping.swap(next);
+
+        if ((pending.empty() && stopping.empty()) || std::chrono::steady_clock::now() >= deadline)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
 
-    return 0;
+    // 到时还没有退出的强制终止，不再等待任务锁
+    int killed = 0;
+    for (auto *tasks : {&pending, &stopping}) {
+        for (auto &task : *tasks) {
+            task->fast_kill();
+            killed++;
+        }
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    LOG_INFO(logger, "shutdown finished. tasks:%d, stopped:%d, killed:%d, cost:%dms", static_cast<int>(total),
+             static_cast<int>(total) - killed, killed, static_cast<int>(elapsed));
+    return killed;
 }
 
+// 检查单个任务，按需停止空闲任务并重启异常结束的任务
+// task: 要检查的任务
+// now: 本轮检查开始的时间
+void ProxytaskMgr::check_task(IngestTask *task, time_t now) {
+    int err = 0;
+    std::lock_guard<std::mutex> lock(task->mutex);
+    if (!task->enable) {
+        return;
+    }
 
+    // 按需启动的任务长时间没有切片请求时停止拉流
+    if (task->on_demand && task->active && now - task->last_access > m_idle_timeout) {
+        deactivate(task);
+    }
 
+    if (task->active) {
+        // 检查拉流状态
+        if ((err = task->cycle()) != srs_success) {
+            auto logger = MyLogger::getLogger("task");
+            LOG_WARN(logger, "task %s ingest cycle. err:%d", task->dest.c_str(), err);
+        }
 
+        // 按重启策略重启异常结束或停滞的任务
+        check_stall(task, now);
+        task->supervise(now);
+    }
+    task->update_metrics();
+}
+
+// 检查拉流是否停滞：源站卡住时ffmpeg可能不退出，但不再生成新切片
+// task: 要检查的任务
+// now: 本轮检查开始的时间
+bool ProxytaskMgr::check_stall(IngestTask *task, time_t now) {
+    if (m_stall_factor <= 0 || !task->running || !task->ingester->started())
+        return false;
+
+    // 已有切片时按切片时长和近期平均间隔中较大的计算，关键帧间隔大于切片时长时切片也会更长
+    time_t last = task->last_segment;
+    time_t since = last > 0 ? last : task->starttime;
+    int timeout = last > 0 ? m_stall_factor * std::max(m_hls_time, task->segment_interval.load())
+                           : m_stall_first_timeout;
+    if (now - since <= timeout)
+        return false;
+
+    // 目录监听不可用或丢失事件时以播放列表的修改时间为准，播放列表在每个新切片后更新
+    struct stat st;
+    if (::stat((task->m3u8_dir + "/hls.m3u8").c_str(), &st) == 0 && st.st_mtime > since) {
+        task->last_segment = st.st_mtime;
+        return false;
+    }
+
+    auto logger = MyLogger::getLogger("task");
+    LOG_WARN(logger, "task %s stalled, no new segment for %ds, restart it.", task->dest.c_str(),
+             static_cast<int>(now - since));
+    task->stalls++;
+    task->stop();
+    return true;
+}
+
+// 记录任务的最近一个切片
+// dir: 任务输出目录，例如./html/live/my
+// now: 当前时间
+void ProxytaskMgr::on_segment(const std::string &dir, time_t now) {
+    static const std::string prefix = "./html";
+    if (dir.compare(0, prefix.size(), prefix) != 0)
+        return;
+
+    auto task = m_tasks.find(dir.substr(prefix.size()));
+    if (!task)
+        return;
+
+    // 只有目录监听线程更新，不需要任务锁。间隔按3:1衰减平均，单次卡顿的影响几个切片后消失
+    time_t last = task->last_segment.exchange(now);
+    if (last <= 0)
+        return;
+    int interval = static_cast<int>(std::min<time_t>(now - last, TASK_SEGMENT_INTERVAL_MAX * m_hls_time));
+    int average = task->segment_interval;
+    task->segment_interval = average > 0 ? (average * 3 + interval) / 4 : interval;
+}
+
+// 拉流进程退出后立即重启对应的任务
+// dest: 目标HLS路径
+void ProxytaskMgr::on_task_exit(const std::string &dest) {
+    auto task = m_tasks.find(dest);
+    if (!task)
+        return;
+
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->cycle();  // 更新为未启动状态
+    if (!task->enable || !task->active)
+        return;
+
+    // 第一次失败立即重启，连续失败时按重启策略等待，到时由定时器重启
+    task->supervise(time(0));
+    task->update_metrics();
+}
+
+// 探测崩溃循环任务的源站
+// dest: 目标HLS路径
+// src: 源地址
+bool ProxytaskMgr::probe_task(const std::string &dest, const std::string &src) {
+    auto job = [this, dest, src]() {
+        bool ok = probe_source(src);
+
+        auto task = m_tasks.find(dest);
+        if (!task)
+            return;
+
+        // 探测期间任务可能被重置、删除后重新添加或停止，只把结果应用到仍在等待这次探测的任务
+        std::lock_guard<std::mutex> lock(task->mutex);
+        if (!task->probing)
+            return;
+        task->probing = false;
+        if (!task->enable || !task->active || !task->parked)
+            return;
+
+        time_t now = time(0);
+        if (ok) {
+            task->probe_ok = true;
+            task->supervise(now);
+        } else {
+            // 加上抖动，同时进入崩溃循环的任务不会每次都一起探测
+            task->next_start = now + add_jitter(task->policy.probe_interval);
+            task->schedule_wakeup(now);
+        }
+        task->update_metrics();
+    };
+    return m_probers && m_probers->submit(job);
+}
+
+// 重启等待时间已到，按重启策略检查任务
+// dest: 目标HLS路径
+void ProxytaskMgr::on_task_timer(const std::string &dest) {
+    // 检查可能探测源地址和启动进程，交给检查线程池执行，不占用时间轮的回调线程
+    if (!m_supervisors)
+        return;
+    m_supervisors->submit([this, dest]() {
+        auto task = m_tasks.find(dest);
+        if (!task)
+            return;
+
+        std::lock_guard<std::mutex> lock(task->mutex);
+        if (!task->enable || !task->active)
+            return;
+        task->supervise(time(0));
+        task->update_metrics();
+    });
+}
+
+// 停止按需启动的任务
+// task: 要停止的任务，调用时持有任务锁
+void ProxytaskMgr::deactivate(IngestTask *task) {
+    task->reset();
+    task->active = false;
+
+    // 拉流结束时会写出最后的播放列表，停止后再删除
+    ::unlink((task->m3u8_dir + "/hls.m3u8").c_str());
+
+    auto logger = MyLogger::getLogger("task");
+    LOG_INFO(logger, "on demand task %s idle for %ds, stopped.", task->dest.c_str(), m_idle_timeout);
+}
+
+// HTTP请求到达时按需启动任务
+// path: 请求路径，例如/live/my/hls.m3u8
+bool ProxytaskMgr::on_http_request(const std::string &path) {
+    bool is_m3u8 = ends_with(path, ".m3u8");
+    if (!is_m3u8 && !ends_with(path, ".ts") && !ends_with(path, ".m4s"))
+        return true;
+
+    auto pos = path.rfind('/');
+    if (pos == std::string::npos || pos == 0)
+        return true;
+    auto dest = path.substr(0, pos);
+
+    auto task = m_tasks.find(dest);
+    if (!task)
+        return true;
+
+    // 切片请求只刷新空闲计时，不等待任务锁
+    if (!is_m3u8) {
+        task->last_access = time(0);
+        return true;
+    }
+
+    std::string m3u8;
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        if (!task->on_demand || !task->enable)
+            return true;
+
+        if (!task->active) {
+            auto logger = MyLogger::getLogger("task");
+            LOG_INFO(logger, "on demand task %s requested, start it.", dest.c_str());
+
+            task->active = true;
+            task->last_access = time(0);
+            task->supervise(time(0));
+            task->update_metrics();
+        }
+        m3u8 = task->m3u8_dir + "/hls.m3u8";
+    }
+
+    if (::access(m3u8.c_str(), F_OK) == 0)
+        return true;
+
+    // 等待占用HTTP工作线程，同时等待的请求过多时不再等待，让播放器稍后重试
+    WaitLimiter::Slot slot;
+    if (!slot.acquired())
+        return false;
+
+    // 等待第一个播放列表生成，超时后按原流程返回(通常是404)，播放器会重试
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(m_wait_timeout);
+    std::unique_lock<std::mutex> lock(m_wait_mutex);
+    while (::access(m3u8.c_str(), F_OK) != 0) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline)
+            break;
+        // 定期重新检查，目录监听不可用时也能返回
+        m_playlist_cond.wait_until(lock, std::min(deadline, now + std::chrono::milliseconds(200)));
+    }
+    return true;
+}
+
+// 记录HTTP请求指标，播放列表和切片请求同时计入对应任务
+// path: 请求路径
+// status: 响应状态码
+// bytes: 响应字节数
+// latency_us: 请求耗时(微秒)
+void ProxytaskMgr::on_http_response(const std::string &path, int status, uint64_t bytes, int64_t latency_us) {
+    auto endpoint = Metrics::endpoint_of(path);
+    Metrics::getinstance().on_http_request(endpoint, status, bytes, latency_us);
+    if (endpoint != Metrics::ENDPOINT_PLAYLIST && endpoint != Metrics::ENDPOINT_SEGMENT)
+        return;
+
+    auto pos = path.rfind('/');
+    if (pos == std::string::npos || pos == 0)
+        return;
+
+    // 任务的指标对象在任务生命期内不变，不需要任务锁
+    auto task = m_tasks.find(path.substr(0, pos));
+    if (!task)
+        return;
+    task->metrics->requests.add();
+    task->metrics->bytes.add(bytes);
+}
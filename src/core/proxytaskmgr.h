@@ -1,21 +1,76 @@
 #pragma once
 
-#include <string>
-#include <map>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include "../common/srs_common.h"
 #include "../process/srs_app_process.hpp"
 #include "../process/srs_app_ffmpeg.hpp"
+#include "../process/srs_app_ingester.hpp"
+#include "../utils/thread_pool.hpp"
+#include "../utils/metrics.hpp"
+#include "../utils/timing_wheel.hpp"
+#include "startup_scheduler.h"
+#include "task_registry.h"
+
+class SrsRtmpServer;
+
+/**
+ * @brief 任务的可选参数，未设置的参数使用配置文件中的默认值
+ */
+struct TaskOptions
+{
+    std::string backend; // 拉流后端：ffmpeg或native，为空时使用配置项ingest_backend
+    int on_demand = -1;  // 是否按需启动：1是，0否，-1使用配置项on_demand
+    int priority = 0;    // 启动优先级，批量启动时数值大的先启动
+    std::string segment_type; // 切片格式：ts或fmp4，为空时使用配置项hls_segment_type
+};
+
+/**
+ * @brief 一条任务配置，例如tasks.csv中的一行
+ */
+struct TaskConfig
+{
+    std::string src;  // 源RTMP流地址
+    std::string dest; // 目标路径
+    TaskOptions opts;
+};
+
+/**
+ * @brief 任务异常结束后的重启策略，取自配置文件
+ *
+ * 运行不足stable_time就结束记为一次失败。第一次失败立即重启，之后等待时长从backoff_min开始
+ * 按2倍增长到backoff_max，并加上±20%的随机抖动，避免大量任务同时重启。
+ * 连续失败crash_loop次后任务进入崩溃循环状态，不再启动拉流，只按probe_interval
+ * 用TCP连接探测源站，源站可以连接时再恢复启动。
+ */
+struct RestartPolicy
+{
+    int backoff_min = 1;     // 首次等待时长(秒)
+    int backoff_max = 60;    // 等待时长上限(秒)
+    int crash_loop = 5;      // 进入崩溃循环状态的连续失败次数，0表示不限
+    int probe_interval = 30; // 崩溃循环状态下探测源站的间隔(秒)
+    int stable_time = 30;    // 运行超过该时长后结束不记为失败(秒)
+
+    // 从配置文件读取
+    void load();
+};
 
 /**
  * @brief 单个转码任务类，负责管理RTMP到HLS的转码过程
- * 使用FFMPEG进行实际的转码工作
+ * 可以使用FFMPEG进程或内置转封装引擎完成实际的工作
+ *
+ * 定时检查、进程回收线程和HTTP线程都可能操作同一个任务，
+ * 调用start/stop/cycle以及读写运行时状态前需持有mutex。
  */
 class IngestTask
 {
 public:
+    explicit IngestTask(const std::string &dest);
     virtual ~IngestTask();
 
     // 基本任务控制接口
@@ -26,38 +81,113 @@ public:
     void fast_kill(); // 强制终止任务
 
     // 初始化任务参数
-    void init(std::string src, std::string dest);
+    void init(std::string src, std::string dest, const TaskOptions &opts = TaskOptions());
+
+    /**
+     * @brief 按重启策略检查任务，未在运行且等待时间已到时启动，调用时持有mutex
+     * @param now 当前时间
+     */
+    void supervise(time_t now);
+
+    // 到next_start时通过定时器再次检查，不必等下一轮定时检查
+    void schedule_wakeup(time_t now);
 
-    // 任务配置参数
+    // 停止拉流并清除失败记录，用于按需启动的任务空闲时停止
+    void reset();
+
+    // 当前状态：running、backoff、crash_loop、queued(等待首次启动)、idle(按需启动未运行)或disabled
+    const char *state() const;
+
+    // 把状态和重启次数写入指标，输出指标时不需要持有mutex
+    void update_metrics();
+
+    std::mutex mutex;  // 串行化对任务的控制和运行时状态的访问
+
+    // 任务配置参数，init之后不再修改
     std::string src;   // 源RTMP流地址
     std::string dest;  // 目标路径，例如：/live/my
     std::string rtmp;  // RTMP服务地址，例如：rtmp://127.0.0.1:1936/live/my
     std::string hls;   // HLS播放地址，例如：http://127.0.0.1:8081/live/my.m3u8
-    bool enable = true;// 任务启用状态
+    std::string m3u8_dir; // HLS输出目录，例如：./html/live/my
+    std::string backend;  // 拉流后端：ffmpeg或native
+    bool on_demand = false; // 按需启动：首次请求播放列表时才开始拉流，空闲后自动停止
+    int priority = 0;       // 启动优先级
+    std::string segment_type; // 切片格式：ts或fmp4
 
     // 运行时状态
-    time_t starttime = time(0);  // 任务启动时间
-    SrsFFMPEG* ffmpeg = nullptr; // FFMPEG实例指针
+    bool enable = true;     // 任务启用状态，从任务表删除后为false，其他线程不再启动它
+    bool active = true;     // 是否正在拉流，按需启动的任务初始为false
+    bool queued = false;    // 是否在启动调度器中排队，排队期间supervise不会启动它
+    time_t starttime = 0;        // 最近一次启动拉流的时间，0表示还没有启动过
+    bool running = false;        // 上次检查时是否在拉流
+    int restarts = 0;            // 累计重启次数，不含首次启动
+    int failures = 0;            // 连续失败次数，运行超过stable_time后清零
+    int backoff = 0;             // 当前重启等待时长(秒)
+    bool parked = false;         // 是否处于崩溃循环状态
+    bool probing = false;        // 崩溃循环状态下正在后台探测源站
+    bool probe_ok = false;       // 后台探测成功，下次检查时离开崩溃循环并启动
+    time_t next_start = 0;       // 最早的下次启动时间
+    TimingWheel::Handle wakeup;  // 到next_start时再次检查的定时器
+    RestartPolicy policy;        // 重启策略
+    std::atomic<time_t> last_access{0}; // 最近一次请求切片的时间，按需启动的任务据此判断空闲，不需要持有mutex
+    std::atomic<time_t> last_segment{0};  // 本次启动后最近一次生成切片的时间，0表示还没有，由目录监听线程更新
+    std::atomic<int> segment_interval{0}; // 本次启动后相邻切片的平均间隔(秒)，近期间隔权重更大
+    int stalls = 0;                       // 累计因长时间没有新切片而重启的次数
+    ISrsIngester* ingester = nullptr; // 拉流后端实例指针
+    const std::shared_ptr<StreamMetrics> metrics; // 任务的指标，构造后不变，访问时不需要持有mutex
 };
 
 /**
  * @brief 转码任务管理器类，负责管理所有RTMP到HLS的转码任务
  * 采用单例模式实现，确保全局只有一个任务管理器实例
+ *
+ * 任务保存在分片加锁的TaskRegistry中，所有接口都可以在任意线程并发调用。
  */
 class ProxytaskMgr
 {
+public:
+    using TaskPtr = TaskRegistry::TaskPtr;
+
 private:
     // 私有构造函数，实现单例模式
     ProxytaskMgr() {}
 
     // 成员变量
-    std::map<std::string, IngestTask*> m_taskMap;  // 任务映射表，key为目标路径
-    SrsProcess* m_srs_process = nullptr;           // SRS服务进程指针
-    std::string m_errmsg;                         // 错误信息
+    TaskRegistry m_tasks;                          // 任务表，key为目标路径
+    StartupScheduler m_startup;                    // 启动调度器，限制任务的启动速率和并发数
+    std::mutex m_wait_mutex;                       // 与m_playlist_cond配合使用
+    std::condition_variable m_playlist_cond;       // 有播放列表生成时通知等待的请求
+    SrsRtmpServer* m_rtmp_server = nullptr;        // 内置RTMP推流服务
+    std::unique_ptr<WorkerPool> m_supervisors;     // 任务检查线程池，配置项supervise_threads
+    std::unique_ptr<WorkerPool> m_probers;         // 源站探测线程池，探测会阻塞在域名解析和连接上，不占用检查线程和任务锁
+    std::atomic<int64_t> m_pass_ms{0};             // 最近一轮检查的耗时(毫秒)
+    std::atomic<size_t> m_pass_tasks{0};           // 最近一轮检查的任务数
+    std::atomic<bool> m_shutting_down{false};      // 正在退出，不再添加任务和定时检查
+    static thread_local std::string m_errmsg;      // 错误信息，每个线程单独保存
 
     // 服务配置
     std::string m_hls_port = "8081";  // HLS服务端口
-    std::string m_rtmp_port = "1936"; // RTMP服务端口
+    int m_rtmp_port = 1936;           // RTMP服务端口，配置项rtmp_port
+    int m_idle_timeout = 60;          // 按需启动的任务没有切片请求多久后停止(秒)
+    int m_wait_timeout = 10;          // 首次请求等待播放列表生成的最长时间(秒)
+    int m_hls_time = 2;               // 切片时长(秒)，配置项hls_time
+    int m_stall_factor = 4;           // 超过切片时长的多少倍没有新切片时视为停滞，0表示不检查
+    int m_stall_first_timeout = 30;   // 启动后多久还没有第一个切片时视为停滞(秒)
+
+    // 创建任务并放入任务表，需要立即拉流的任务标记为排队，失败时返回空指针并设置错误信息
+    TaskPtr create_task(const std::string &src, const std::string &dest, const TaskOptions &opts);
+    // 停止已从任务表删除的任务，其他线程不会再启动它
+    void retire(IngestTask *task);
+    // 目标路径是否正在通过内置RTMP服务推流，推流中的目标路径不能添加拉流任务
+    bool is_publishing(const std::string &dest) const;
+    // 停止按需启动的任务，删除旧的播放列表，下次启动时请求会等到新的播放列表生成
+    void deactivate(IngestTask *task);
+    // 检查单个任务，在检查线程中执行
+    void check_task(IngestTask *task, time_t now);
+    // 进程还在但长时间没有生成新切片时停止拉流，由重启策略重启，调用时持有任务锁
+    bool check_stall(IngestTask *task, time_t now);
+    // 任务输出目录中生成了新切片，在目录监听线程中调用
+    void on_segment(const std::string &dir, time_t now);
 
 public:
     // 获取单例实例
@@ -68,11 +198,7 @@ public:
     }
 
     // 基本接口
-    int init();      // 初始化管理器
-    ~ProxytaskMgr()
-    {
-        delete m_srs_process;
-    }
+    int init();      // 初始化管理器，启动内置RTMP推流服务
 
     // 数据持久化接口
     int load_from_db(); // 从数据库加载任务配置
@@ -81,56 +207,52 @@ public:
      * @brief 添加新的转码任务
      * @param src 源RTMP流地址
      * @param dest 目标HLS路径
+     * @param opts 任务的可选参数
      * @return 成功返回0，失败返回-1
      */
-    int add_task(std::string src, std::string dest)
-    {
-        if (src.empty() || dest.empty())
-        {
-            m_errmsg = "failed. parameter is empty.";
-            return -1;
-        }
+    int add_task(std::string src, std::string dest, const TaskOptions &opts = TaskOptions());
 
-        // 检查任务是否已存在
-        if (m_taskMap.find(dest) != m_taskMap.end())
-        {
-            m_errmsg = "failed." + dest + " exists.";
-            return -1;
-        }
-
-        // 创建并初始化新任务
-        IngestTask* ptask = new IngestTask();
-        ptask->init(src, dest);
-        m_taskMap[dest] = ptask;
-        ptask->start();
-        return 0;
-    }
+    /**
+     * @brief 批量添加任务，全部加入任务表后按优先级交给启动调度器依次启动
+     * @param tasks 任务配置，添加失败的任务记录日志后跳过
+     * @param created 不为空时按tasks的顺序返回创建的任务，添加失败的为空指针
+     * @return 成功添加的任务数
+     */
+    int add_tasks(const std::vector<TaskConfig> &tasks, std::vector<TaskPtr> *created = nullptr);
 
     /**
-     * @brief 删除指定的转码任务
+     * @brief 删除指定的转码任务，等待拉流停止后返回
      * @param dest 目标HLS路径
+     * @param owner 不为空时只在目标路径上仍是该任务时删除，避免删除其他来源后来添加的同名任务
      * @return 成功返回0，失败返回-1
      */
-    int del_task(std::string dest)
+    int del_task(std::string dest, const TaskPtr &owner = TaskPtr());
+
+    /**
+     * @brief 在一个事务中删除和添加一批任务，全部成功或全部不生效
+     * 同一个目标路径可以同时出现在删除和添加中，表示替换该任务
+     * @param adds 要添加的任务
+     * @param dels 要删除的目标路径
+     * @return 成功返回0；参数为空、要删除的任务不存在或要添加的任务已存在时返回-1，任务表不变
+     */
+    int apply_batch(const std::vector<TaskConfig> &adds, const std::vector<std::string> &dels);
+
+    // 获取任务列表，返回调用时刻的任务指针副本
+    std::vector<TaskPtr> get_task_list()
     {
-        auto iter = m_taskMap.find(dest);
-        if (iter == m_taskMap.end())
-        {
-            m_errmsg = "dest not found. " + dest;
-            return -1;
-        }
+        return m_tasks.snapshot();
+    }
 
-        auto ptask = iter->second;
-        ptask->stop();
-        m_taskMap.erase(iter);
-        delete ptask;
-        return 0;
+    // 获取任务列表及其目标路径
+    std::vector<std::pair<std::string, TaskPtr>> get_task_entries()
+    {
+        return m_tasks.entries();
     }
 
-    // 获取任务列表
-    const decltype(m_taskMap)& get_task_list()
+    // 查找任务，不存在时返回空指针
+    TaskPtr find_task(const std::string &dest)
     {
-        return m_taskMap;
+        return m_tasks.find(dest);
     }
 
     /**
@@ -140,33 +262,27 @@ public:
      */
     std::string get_hls_path(const std::string &dest)
     {
-        auto iter = m_taskMap.find(dest);
-        if (iter == m_taskMap.end())
-            return "";
-
-        auto ptask = iter->second;
+        auto ptask = m_tasks.find(dest);
         if (ptask)
             return ptask->hls;
         else
             return "";
     }
 
-    // 获取错误信息
+    /**
+     * @brief 检查源地址的协议，只允许rtmp、rtmps、rtsp、http和https
+     * 源地址会原样交给ffmpeg，本地文件、concat等输入不能作为拉流地址
+     */
+    static bool is_allowed_src(const std::string &src);
+
+    // 获取当前线程最近一次的错误信息
     std::string get_errmsg() const
     {
         return m_errmsg;
     }
 
     // 任务控制接口
-    int startAll() // 启动所有任务
-    {
-        for (auto &item : m_taskMap)
-        {
-            auto task = item.second;
-            task->start();
-        }
-        return 0;
-    }
+    int startAll(); // 启动所有任务
 
     int start(std::string src, std::string dest); // 启动指定任务
 
@@ -175,24 +291,23 @@ public:
      * @param dest 目标HLS路径
      * @return 成功返回0
      */
-    int fast(std::string dest)
-    {
-        auto iter = m_taskMap.find(dest);
-        if (iter != m_taskMap.end())
-            return 0;
+    int fast(std::string dest);
 
-        auto ptask = iter->second;
-        ptask->stop();
-        return 0;
-    }
+    /**
+     * @brief 退出前停止所有任务：同时向所有拉流进程发送SIGTERM，在同一个截止时间前并发等待它们退出，
+     * 到时还没有退出的再发送SIGKILL。总耗时不超过timeout_ms，与任务数无关
+     * @param timeout_ms 等待退出的最长时间(毫秒)
+     * @return 被强制终止的任务数
+     */
+    int shutdown(int timeout_ms);
 
     // 强制终止所有任务
     int fast_kill()
     {
-        for (auto &item : m_taskMap)
+        // 只在退出时调用，不等待任务锁，避免与正在处理的线程互相等待
+        for (auto &ptask : m_tasks.snapshot())
         {
-            auto ptask = item.second;
-            if(ptask)
+            if (ptask)
                 ptask->fast_kill();
         }
         return 0;
@@ -204,4 +319,48 @@ public:
      * @return 成功返回0
      */
     int check(int timecnt);
-};
\ No newline at end of file
+
+    // 当前或最近一批任务的启动进度
+    StartupStats startup_stats() { return m_startup.stats(); }
+
+    // 最近一轮检查的耗时(毫秒)和任务数，耗时接近检查周期说明需要增加supervise_threads
+    int64_t last_pass_ms() const { return m_pass_ms; }
+    size_t last_pass_tasks() const { return m_pass_tasks; }
+
+    /**
+     * @brief 任务的拉流进程退出，在进程回收线程中调用，立即重启该任务
+     * @param dest 目标HLS路径
+     */
+    void on_task_exit(const std::string &dest);
+
+    /**
+     * @brief 在探测线程池中探测崩溃循环任务的源站，完成后持有任务锁应用结果，调用时持有任务锁
+     * @param dest 目标HLS路径
+     * @param src 源地址
+     * @return 已提交探测时返回true，探测线程池已关闭时返回false
+     */
+    bool probe_task(const std::string &dest, const std::string &src);
+
+    /**
+     * @brief 任务的重启等待时间已到，在定时器线程中调用，检查任务提交到检查线程池执行
+     * @param dest 目标HLS路径
+     */
+    void on_task_timer(const std::string &dest);
+
+    /**
+     * @brief HTTP请求到达时调用，在HTTP工作线程中执行
+     * 请求按需启动任务的播放列表时启动该任务，并等待播放列表生成后返回；请求切片时刷新空闲计时
+     * @param path 请求路径，例如/live/my/hls.m3u8
+     * @return 需要等待但同时等待的请求已达上限(WaitLimiter)时返回false，调用方返回503
+     */
+    bool on_http_request(const std::string &path);
+
+    /**
+     * @brief HTTP响应发送完后调用，记录请求指标，在HTTP工作线程中执行
+     * @param path 请求路径
+     * @param status 响应状态码
+     * @param bytes 响应字节数
+     * @param latency_us 请求耗时(微秒)
+     */
+    void on_http_response(const std::string &path, int status, uint64_t bytes, int64_t latency_us);
+};
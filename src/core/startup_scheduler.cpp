@@ -0,0 +1,249 @@
+#include "startup_scheduler.h"
+#include "../common/logger.h"
+#include "proxytaskmgr.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+
+using namespace std;
+
+// 没有任务可以启动时检查启动中任务的间隔(毫秒)
+#define STARTUP_POLL_INTERVAL_MS 100
+// 输出启动进度的间隔(毫秒)
+#define STARTUP_REPORT_INTERVAL_MS 5000
+
+StartupScheduler::~StartupScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void StartupScheduler::configure(int rate, int concurrency, int ready_timeout)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_rate = std::max(0, rate);
+    m_concurrency = std::max(0, concurrency);
+    m_ready_timeout = std::max(1, ready_timeout);
+}
+
+void StartupScheduler::submit(const std::vector<TaskPtr> &tasks)
+{
+    if (tasks.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // 上一批已全部结束时开始新的一批
+        if (m_stats.done)
+        {
+            m_stats = StartupStats();
+            m_stats.done = false;
+            m_begin = std::chrono::steady_clock::now();
+        }
+
+        for (auto &task : tasks)
+            m_queue.push(Pending{task->priority, m_seq++, task});
+        m_stats.total += tasks.size();
+        m_stats.pending = m_queue.size();
+
+        if (!m_thread.joinable())
+            m_thread = std::thread([this]() { run(); });
+    }
+    m_cond.notify_one();
+}
+
+StartupStats StartupScheduler::stats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    StartupStats stats = m_stats;
+    if (!stats.done)
+    {
+        stats.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                               std::chrono::steady_clock::now() - m_begin).count();
+    }
+    return stats;
+}
+
+void StartupScheduler::run()
+{
+    auto next_launch = std::chrono::steady_clock::now();
+    auto next_report = next_launch + std::chrono::milliseconds(STARTUP_REPORT_INTERVAL_MS);
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this]() { return m_stop || !m_queue.empty() || !m_inflight.empty(); });
+            if (m_stop)
+                return;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        check_inflight(now);
+
+        // 按速率和并发上限启动排队的任务
+        bool throttled = false;
+        while (true)
+        {
+            int rate, concurrency;
+            TaskPtr task;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_queue.empty())
+                    break;
+                rate = m_rate;
+                concurrency = m_concurrency;
+                if ((concurrency > 0 && m_inflight.size() >= static_cast<size_t>(concurrency)) || now < next_launch)
+                {
+                    throttled = true;
+                    break;
+                }
+                task = m_queue.top().task;
+                m_queue.pop();
+                m_stats.pending = m_queue.size();
+            }
+
+            time_t starttime = 0;
+            bool launched = launch(task, starttime);
+            if (launched)
+                m_inflight.push_back(Inflight{task, starttime, now});
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (launched)
+                {
+                    m_stats.started++;
+                    m_stats.inflight = m_inflight.size();
+                }
+                else
+                {
+                    m_stats.cancelled++;
+                }
+            }
+
+            // 取消的任务不占用启动速率
+            if (launched && rate > 0)
+            {
+                next_launch = std::max(next_launch, now) + std::chrono::microseconds(1000000 / rate);
+                now = std::chrono::steady_clock::now();
+            }
+        }
+
+        // 本批全部结束时输出总耗时
+        bool finished = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_queue.empty() && m_inflight.empty() && !m_stats.done)
+            {
+                m_stats.done = true;
+                m_stats.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_begin).count();
+                finished = true;
+            }
+        }
+        if (finished || now >= next_report)
+        {
+            report(finished);
+            next_report = now + std::chrono::milliseconds(STARTUP_REPORT_INTERVAL_MS);
+        }
+
+        // 受速率限制时等到下一个启动时刻，否则定期检查启动中的任务
+        auto wakeup = now + std::chrono::milliseconds(STARTUP_POLL_INTERVAL_MS);
+        if (throttled && next_launch > now)
+            wakeup = std::min(wakeup, next_launch);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait_until(lock, wakeup, [this]() { return m_stop; });
+    }
+}
+
+bool StartupScheduler::launch(const TaskPtr &task, time_t &starttime)
+{
+    std::lock_guard<std::mutex> lock(task->mutex);
+    if (!task->queued)
+        return false;
+
+    task->queued = false;
+    if (!task->enable || !task->active)
+        return false;
+
+    task->supervise(time(0));
+    task->update_metrics();
+    starttime = task->starttime;
+    return task->running;
+}
+
+void StartupScheduler::check_inflight(std::chrono::steady_clock::time_point now)
+{
+    size_t ready = 0, failed = 0, timeout = 0, cancelled = 0;
+
+    for (auto iter = m_inflight.begin(); iter != m_inflight.end();)
+    {
+        auto &task = iter->task;
+
+        // 播放列表在本次启动之后写入才算启动完成，忽略上次运行留下的文件
+        struct stat st;
+        std::string m3u8 = task->m3u8_dir + "/hls.m3u8";
+        if (::stat(m3u8.c_str(), &st) == 0 && st.st_mtime >= iter->starttime)
+        {
+            ready++;
+            iter = m_inflight.erase(iter);
+            continue;
+        }
+
+        int result = 0; // 0：启动中，1：已结束，2：已取消
+        {
+            std::lock_guard<std::mutex> lock(task->mutex);
+            if (!task->enable || !task->active)
+                result = 2;
+            else if (!task->running || task->starttime != iter->starttime)
+                result = 1;
+        }
+
+        if (result == 0 && now - iter->launched < std::chrono::seconds(m_ready_timeout))
+        {
+            ++iter;
+            continue;
+        }
+
+        if (result == 2)
+            cancelled++;
+        else if (result == 1)
+            failed++;
+        else
+            timeout++;
+        iter = m_inflight.erase(iter);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.ready += ready;
+    m_stats.failed += failed;
+    m_stats.timeout += timeout;
+    m_stats.cancelled += cancelled;
+    m_stats.inflight = m_inflight.size();
+}
+
+void StartupScheduler::report(bool finished)
+{
+    auto stats = this->stats();
+    auto logger = MyLogger::getLogger("task");
+    if (finished)
+    {
+        LOG_INFO(logger, "startup finished. tasks:%d, ready:%d, failed:%d, timeout:%d, cancelled:%d, cost:%dms",
+                 static_cast<int>(stats.total), static_cast<int>(stats.ready), static_cast<int>(stats.failed),
+                 static_cast<int>(stats.timeout), static_cast<int>(stats.cancelled), static_cast<int>(stats.elapsed_ms));
+    }
+    else
+    {
+        LOG_INFO(logger, "startup progress. started:%d/%d, ready:%d, failed:%d, timeout:%d, inflight:%d, elapsed:%dms",
+                 static_cast<int>(stats.started), static_cast<int>(stats.total), static_cast<int>(stats.ready),
+                 static_cast<int>(stats.failed), static_cast<int>(stats.timeout), static_cast<int>(stats.inflight),
+                 static_cast<int>(stats.elapsed_ms));
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "task_registry.h"
+
+/**
+ * @brief 一批任务的启动进度
+ */
+struct StartupStats
+{
+    size_t total = 0;     // 本批任务数
+    size_t started = 0;   // 已启动拉流
+    size_t ready = 0;     // 已生成播放列表
+    size_t failed = 0;    // 生成播放列表前拉流已结束，之后由重启策略接管
+    size_t timeout = 0;   // 超过startup_ready_timeout仍未生成播放列表
+    size_t cancelled = 0; // 启动前后被删除或停止
+    size_t pending = 0;   // 排队等待启动
+    size_t inflight = 0;  // 已启动、等待生成播放列表
+    int64_t elapsed_ms = 0; // 从本批第一个任务提交到全部结束的耗时，未结束时为当前已用时长
+    bool done = true;       // 本批是否已全部结束
+};
+
+/**
+ * @brief 任务启动调度器，限制任务的启动速率和同时启动的任务数
+ *
+ * 重启服务时tasks.csv中的全部任务不再同时拉流，而是按优先级从高到低排队，
+ * 每秒最多启动startup_rate个，已启动但还没有生成播放列表的任务不超过startup_concurrency个，
+ * 避免同时连接上游和同时启动大量进程。任务生成播放列表、拉流结束或超时后让出名额。
+ *
+ * 调度在单独的线程中执行，第一次提交任务时启动。
+ * 任务交给调度器前应设置IngestTask::queued，排队期间定时检查不会启动它。
+ */
+class StartupScheduler
+{
+  public:
+    using TaskPtr = TaskRegistry::TaskPtr;
+
+  private:
+    struct Pending
+    {
+        int priority;
+        uint64_t seq;
+        TaskPtr task;
+
+        // 优先级高的先启动，同优先级按提交顺序
+        bool operator<(const Pending &other) const
+        {
+            return priority != other.priority ? priority < other.priority : seq > other.seq;
+        }
+    };
+
+    struct Inflight
+    {
+        TaskPtr task;
+        time_t starttime;                               // 任务的启动时间，用于判断播放列表是否为本次生成
+        std::chrono::steady_clock::time_point launched; // 用于判断超时
+    };
+
+    // 调度参数
+    int m_rate = 50;           // 每秒最多启动的任务数，0表示不限
+    int m_concurrency = 100;   // 同时启动的任务数上限，0表示不限
+    int m_ready_timeout = 15;  // 启动后等待播放列表生成的最长时间(秒)
+
+    std::mutex m_mutex; // 保护以下成员
+    std::condition_variable m_cond;
+    std::priority_queue<Pending> m_queue;
+    uint64_t m_seq = 0;
+    StartupStats m_stats;
+    std::chrono::steady_clock::time_point m_begin;
+    bool m_stop = false;
+    std::thread m_thread;
+
+    std::list<Inflight> m_inflight; // 只在调度线程中访问
+
+    void run();
+    // 启动排队中的任务，任务已被删除或不再需要启动时返回false
+    bool launch(const TaskPtr &task, time_t &starttime);
+    // 检查已启动的任务，移除已生成播放列表、结束或超时的任务
+    void check_inflight(std::chrono::steady_clock::time_point now);
+    void report(bool finished);
+
+  public:
+    StartupScheduler() {}
+    ~StartupScheduler();
+
+    /**
+     * @brief 设置调度参数
+     * @param rate 每秒最多启动的任务数，0表示不限
+     * @param concurrency 同时启动的任务数上限，0表示不限
+     * @param ready_timeout 启动后等待播放列表生成的最长时间(秒)
+     */
+    void configure(int rate, int concurrency, int ready_timeout);
+
+    /**
+     * @brief 提交一批任务，按IngestTask::priority排序后依次启动
+     */
+    void submit(const std::vector<TaskPtr> &tasks);
+
+    // 当前一批任务的启动进度，没有任务在启动时为上一批的结果
+    StartupStats stats();
+};
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+class IngestTask;
+
+/**
+ * @brief 按目标路径分片加锁的任务表
+ *
+ * 任务按目标路径的哈希值分到固定数量的分片，每个分片一把锁，
+ * 不同分片上的查找、添加和删除可以并行执行，锁只在操作map期间持有。
+ * 遍历时逐个分片复制出任务指针(snapshot)，之后在锁外处理，
+ * 耗时的启动和停止不会阻塞其他线程访问任务表。
+ *
+ * 任务由shared_ptr持有，从表中删除后，正在使用它的线程处理完毕时才释放。
+ */
+class TaskRegistry
+{
+  public:
+    using TaskPtr = std::shared_ptr<IngestTask>;
+    // 返回true表示目标路径被其他来源(如推流)占用，不能添加任务
+    using BusyFilter = std::function<bool(const std::string &dest)>;
+
+  private:
+    static const size_t SHARD_COUNT = 32;
+
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, TaskPtr> tasks;
+    };
+
+    Shard m_shards[SHARD_COUNT];
+
+    static size_t shard_index(const std::string &dest) { return std::hash<std::string>()(dest) % SHARD_COUNT; }
+    Shard &shard(const std::string &dest) { return m_shards[shard_index(dest)]; }
+    const Shard &shard(const std::string &dest) const { return m_shards[shard_index(dest)]; }
+
+  public:
+    /**
+     * @brief 添加任务
+     * @param busy 在分片锁内检查目标路径是否被占用，可以为空
+     * @return 目标路径已存在或被占用时返回false
+     */
+    bool insert(const std::string &dest, const TaskPtr &task, const BusyFilter &busy = BusyFilter())
+    {
+        auto &s = shard(dest);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (busy && busy(dest))
+            return false;
+        return s.tasks.emplace(dest, task).second;
+    }
+
+    /**
+     * @brief 查找任务，不存在时返回空指针
+     */
+    TaskPtr find(const std::string &dest) const
+    {
+        auto &s = shard(dest);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto iter = s.tasks.find(dest);
+        return iter == s.tasks.end() ? TaskPtr() : iter->second;
+    }
+
+    bool contains(const std::string &dest) const { return find(dest) != nullptr; }
+
+    /**
+     * @brief 删除任务
+     * @param expected 不为空时只在目标路径上仍是该任务时删除
+     * @return 被删除的任务，不存在或不是expected时返回空指针
+     */
+    TaskPtr erase(const std::string &dest, const TaskPtr &expected = TaskPtr())
+    {
+        auto &s = shard(dest);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto iter = s.tasks.find(dest);
+        if (iter == s.tasks.end() || (expected && iter->second != expected))
+            return TaskPtr();
+
+        auto task = iter->second;
+        s.tasks.erase(iter);
+        return task;
+    }
+
+    /**
+     * @brief 在一个事务中删除和添加一批任务，全部生效或全部不生效
+     *
+     * 涉及的分片按下标顺序全部加锁后再检查和修改，其他线程看不到只完成了一部分的状态。
+     * 同一个目标路径可以同时出现在删除和添加中，表示替换。
+     * @param inserts 要添加的目标路径和任务
+     * @param erases 要删除的目标路径
+     * @param erased 被删除的任务
+     * @param conflict 失败时为冲突的目标路径
+     * @param busy 在分片锁内检查添加的目标路径是否被占用，可以为空
+     * @return 要删除的任务不存在、要添加的任务已存在或被占用、添加的目标路径重复时返回false，任务表不变
+     */
+    bool batch(const std::vector<std::pair<std::string, TaskPtr>> &inserts, const std::vector<std::string> &erases,
+               std::vector<TaskPtr> &erased, std::string &conflict, const BusyFilter &busy = BusyFilter())
+    {
+        bool used[SHARD_COUNT] = {false};
+        for (auto &item : inserts)
+            used[shard_index(item.first)] = true;
+        for (auto &dest : erases)
+            used[shard_index(dest)] = true;
+
+        std::vector<std::unique_lock<std::mutex>> locks;
+        for (size_t i = 0; i < SHARD_COUNT; i++)
+        {
+            if (used[i])
+                locks.emplace_back(m_shards[i].mutex);
+        }
+
+        std::unordered_set<std::string> erasing;
+        for (auto &dest : erases)
+        {
+            auto &tasks = shard(dest).tasks;
+            if (tasks.find(dest) == tasks.end())
+            {
+                conflict = dest;
+                return false;
+            }
+            erasing.insert(dest);
+        }
+
+        std::unordered_set<std::string> inserting;
+        for (auto &item : inserts)
+        {
+            auto &tasks = shard(item.first).tasks;
+            if ((tasks.find(item.first) != tasks.end() && erasing.find(item.first) == erasing.end()) ||
+                !inserting.insert(item.first).second || (busy && busy(item.first)))
+            {
+                conflict = item.first;
+                return false;
+            }
+        }
+
+        for (auto &dest : erasing)
+        {
+            auto &tasks = shard(dest).tasks;
+            auto iter = tasks.find(dest);
+            erased.push_back(iter->second);
+            tasks.erase(iter);
+        }
+        for (auto &item : inserts)
+            shard(item.first).tasks.emplace(item.first, item.second);
+        return true;
+    }
+
+    /**
+     * @brief 复制当前所有任务，各分片分别加锁，结果不是全局一致的快照
+     */
+    std::vector<TaskPtr> snapshot() const
+    {
+        std::vector<TaskPtr> tasks;
+        for (auto &s : m_shards)
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            for (auto &item : s.tasks)
+                tasks.push_back(item.second);
+        }
+        return tasks;
+    }
+
+    /**
+     * @brief 复制当前所有任务及其目标路径，目标路径可以在不持有任务锁时使用
+     */
+    std::vector<std::pair<std::string, TaskPtr>> entries() const
+    {
+        std::vector<std::pair<std::string, TaskPtr>> entries;
+        for (auto &s : m_shards)
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            for (auto &item : s.tasks)
+                entries.push_back(item);
+        }
+        return entries;
+    }
+
+    size_t size() const
+    {
+        size_t n = 0;
+        for (auto &s : m_shards)
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            n += s.tasks.size();
+        }
+        return n;
+    }
+};
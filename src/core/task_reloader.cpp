@@ -0,0 +1,253 @@
+#include "task_reloader.h"
+#include "../common/logger.h"
+#include "../utils/csv.hpp"
+#include "../utils/dir_watcher.hpp"
+
+#include <chrono>
+
+using namespace std;
+
+// 文件变化后等待的时间(毫秒)，合并编辑器连续写入产生的多个事件
+#define TASK_RELOAD_DELAY_MS 200
+
+TaskReloader::~TaskReloader()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+bool TaskReloader::parse(const std::string &file, std::vector<TaskConfig> &tasks, std::string &errmsg)
+{
+    try
+    {
+        // 设置CSV格式，去除空格和制表符
+        csv::CSVFormat format;
+        format.trim({' ', '\t'});
+
+        csv::CSVReader reader(file, format);
+        int src = reader.index_of("src");
+        int dest = reader.index_of("dest");
+        int backend = reader.index_of("backend");
+        int on_demand = reader.index_of("on_demand");
+        int priority = reader.index_of("priority");
+        int segment_type = reader.index_of("segment_type");
+        if (src < 0 || dest < 0)
+        {
+            errmsg = "column src or dest not found";
+            return false;
+        }
+
+        csv::CSVRow row;
+        while (reader.read_row(row))
+        {
+            if (row[dest].is_null() || row[src].is_null())
+                continue;
+
+            TaskConfig task;
+            task.dest = row[dest].get();
+            task.src = row[src].get();
+            if (backend >= 0 && !row[backend].is_null())
+                task.opts.backend = row[backend].get();
+            if (on_demand >= 0 && !row[on_demand].is_null())
+                task.opts.on_demand = atoi(row[on_demand].get().c_str()) != 0 ? 1 : 0;
+            if (priority >= 0 && !row[priority].is_null())
+                task.opts.priority = atoi(row[priority].get().c_str());
+            if (segment_type >= 0 && !row[segment_type].is_null())
+                task.opts.segment_type = row[segment_type].get();
+            tasks.push_back(std::move(task));
+        }
+    }
+    catch (exception &ex)
+    {
+        errmsg = ex.what();
+        return false;
+    }
+    return true;
+}
+
+bool TaskReloader::start(const std::string &file, bool watch)
+{
+    m_file = file;
+    auto pos = file.rfind('/');
+    m_dir = pos == std::string::npos ? "." : file.substr(0, pos);
+    m_name = pos == std::string::npos ? file : file.substr(pos + 1);
+
+    // 在添加任务之前监听，避免任务输出目录用完inotify的监听数上限
+    if (watch)
+    {
+        // 目录监听同时覆盖直接写入(IN_CLOSE_WRITE)和写临时文件后改名(IN_MOVED_TO)两种保存方式
+        DirWatcher::getinstance().add_listener(
+            [this](const std::string &dir, const std::string &name, uint32_t /*mask*/) {
+                // 事件队列溢出时dir为空，同样重新加载
+                if (!dir.empty() && (dir != m_dir || name != m_name))
+                    return;
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_dirty = true;
+                m_cond.notify_one();
+            });
+
+        if (DirWatcher::getinstance().watch(m_dir))
+        {
+            m_thread = std::thread([this]() { run(); });
+        }
+        else
+        {
+            auto logger = MyLogger::getLogger("task");
+            LOG_WARN(logger, "watch %s failed, hot reload disabled.", m_file.c_str());
+        }
+    }
+
+    return reload();
+}
+
+void TaskReloader::run()
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this]() { return m_stop || m_dirty; });
+            if (m_stop)
+                return;
+
+            // 等到一段时间内没有新的事件再加载
+            do
+            {
+                m_dirty = false;
+                m_cond.wait_for(lock, std::chrono::milliseconds(TASK_RELOAD_DELAY_MS), [this]() { return m_stop; });
+                if (m_stop)
+                    return;
+            } while (m_dirty);
+        }
+
+        reload();
+    }
+}
+
+bool TaskReloader::reload()
+{
+    auto logger = MyLogger::getLogger("task");
+    std::lock_guard<std::mutex> lock(m_reload_mutex);
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<TaskConfig> tasks;
+    std::string errmsg;
+    if (!parse(m_file, tasks, errmsg))
+    {
+        LOG_WARN(logger, "load %s failed, keep current tasks. %s", m_file.c_str(), errmsg.c_str());
+        return false;
+    }
+    auto parsed = std::chrono::steady_clock::now();
+
+    apply(tasks);
+
+    auto end = std::chrono::steady_clock::now();
+    LOG_INFO(logger, "load %s. rows:%d, parse:%dms, apply:%dms", m_file.c_str(), static_cast<int>(tasks.size()),
+             static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(parsed - begin).count()),
+             static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(end - parsed).count()));
+    return true;
+}
+
+ProxytaskMgr::TaskPtr TaskReloader::owned_task(const std::string &dest, const Entry &entry)
+{
+    auto task = entry.task.lock();
+    if (!task || ProxytaskMgr::getinstance().find_task(dest) != task)
+        return ProxytaskMgr::TaskPtr();
+    return task;
+}
+
+void TaskReloader::apply(std::vector<TaskConfig> &tasks)
+{
+    // 原地比较，本次出现的任务标记为当前代，未标记的即为被移除的任务，未变化的任务不产生内存分配
+    uint64_t generation = ++m_generation;
+    std::vector<TaskConfig> added;
+    std::vector<std::pair<std::string, ProxytaskMgr::TaskPtr>> removed; // 目标路径和本加载器创建的任务
+    size_t changed = 0;
+    size_t retried = 0;
+
+    for (auto &task : tasks)
+    {
+        auto iter = m_tasks.find(task.dest);
+        if (iter == m_tasks.end())
+        {
+            std::string dest = task.dest;
+            added.push_back(task);
+            m_tasks.emplace(std::move(dest), Entry{std::move(task), generation, std::weak_ptr<IngestTask>()});
+            continue;
+        }
+
+        // 目标路径重复时保留第一条
+        auto &entry = iter->second;
+        if (entry.generation == generation)
+            continue;
+        entry.generation = generation;
+
+        auto owner = owned_task(task.dest, entry);
+        if (!owner)
+        {
+            // 上次添加失败或任务已被其他接口删除，重新添加，目标路径仍被占用时再次失败
+            added.push_back(task);
+            retried++;
+        }
+        else if (entry.conf.src != task.src || entry.conf.opts.backend != task.opts.backend ||
+                 entry.conf.opts.on_demand != task.opts.on_demand ||
+                 entry.conf.opts.segment_type != task.opts.segment_type)
+        {
+            // 源地址或参数变化时重建任务，只修改优先级不影响正在运行的任务
+            removed.emplace_back(task.dest, owner);
+            added.push_back(task);
+            changed++;
+        }
+        entry.conf = std::move(task);
+    }
+
+    for (auto iter = m_tasks.begin(); iter != m_tasks.end();)
+    {
+        if (iter->second.generation != generation)
+        {
+            auto owner = owned_task(iter->first, iter->second);
+            if (owner)
+                removed.emplace_back(iter->first, owner);
+            iter = m_tasks.erase(iter);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+
+    // 先删除再添加，变化的任务使用同一个目标路径；只删除本加载器创建的任务
+    auto &mgr = ProxytaskMgr::getinstance();
+    for (auto &item : removed)
+        mgr.del_task(item.first, item.second);
+
+    int failed = 0;
+    if (!added.empty())
+    {
+        // 只记录实际添加成功的任务，失败的行在下次加载时重试
+        std::vector<ProxytaskMgr::TaskPtr> created;
+        mgr.add_tasks(added, &created);
+        for (size_t i = 0; i < added.size(); i++)
+        {
+            auto iter = m_tasks.find(added[i].dest);
+            if (iter != m_tasks.end())
+                iter->second.task = created[i];
+            if (!created[i])
+                failed++;
+        }
+    }
+
+    if (!added.empty() || !removed.empty())
+    {
+        auto logger = MyLogger::getLogger("task");
+        LOG_INFO(logger, "apply %s. added:%d, removed:%d, changed:%d, retried:%d, failed:%d, unchanged:%d",
+                 m_file.c_str(), static_cast<int>(added.size() - changed - retried),
+                 static_cast<int>(removed.size() - changed), static_cast<int>(changed), static_cast<int>(retried),
+                 failed, static_cast<int>(m_tasks.size() - added.size()));
+    }
+}
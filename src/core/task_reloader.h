@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "proxytaskmgr.h"
+
+/**
+ * @brief 任务列表文件的加载和热更新
+ *
+ * 启动时加载tasks.csv，之后监听文件所在目录，文件被写入或替换后在后台线程中重新解析，
+ * 与上次加载的内容按目标路径比较，只删除被移除的任务、重建源地址或参数变化的任务、添加新任务，
+ * 其余任务不受影响，继续拉流。
+ *
+ * 目标路径重复时以第一条为准。只删除本加载器创建且仍在任务表中的任务，通过其他接口添加的任务不会被热更新删除；
+ * 目标路径已被其他接口的任务占用时该行不生效，文件中的任务被其他接口删除后，下次加载时重新添加。文件解析失败时保留当前任务。
+ */
+class TaskReloader
+{
+  private:
+    TaskReloader() {}
+
+    std::string m_file; // 任务列表文件路径
+    std::string m_dir;  // 文件所在目录
+    std::string m_name; // 文件名
+
+    std::mutex m_mutex; // 保护以下成员
+    std::condition_variable m_cond;
+    bool m_dirty = false; // 文件有变化，等待重新加载
+    bool m_stop = false;
+    std::thread m_thread;
+
+    struct Entry
+    {
+        TaskConfig conf;
+        uint64_t generation;              // 最近一次出现在文件中的加载序号
+        std::weak_ptr<IngestTask> task;   // 本加载器为该行创建的任务，添加失败时为空
+    };
+
+    std::mutex m_reload_mutex;                      // 串行化加载，保护以下成员
+    std::unordered_map<std::string, Entry> m_tasks; // 上次加载的任务，key为目标路径
+    uint64_t m_generation = 0;                      // 加载序号
+
+    void run();
+    // 按目标路径比较并添加、删除任务
+    void apply(std::vector<TaskConfig> &tasks);
+    // 目标路径上仍是本加载器创建的任务时返回该任务，否则返回空指针
+    ProxytaskMgr::TaskPtr owned_task(const std::string &dest, const Entry &entry);
+
+  public:
+    static TaskReloader &getinstance()
+    {
+        static TaskReloader instance;
+        return instance;
+    }
+    ~TaskReloader();
+
+    /**
+     * @brief 加载任务列表并添加全部任务
+     * @param file 任务列表文件路径
+     * @param watch 是否监听文件变化并自动重新加载
+     * @return 文件解析失败时返回false
+     */
+    bool start(const std::string &file, bool watch);
+
+    /**
+     * @brief 立即重新加载任务列表，只应用变化的部分
+     * @return 文件解析失败时返回false
+     */
+    bool reload();
+
+    /**
+     * @brief 解析任务列表文件
+     * 必需列：src、dest；可选列：backend(ffmpeg或native)、on_demand(1按需启动，0立即启动)、
+     * priority(启动优先级，数值大的先启动)、segment_type(切片格式，ts或fmp4)
+     * @param tasks 解析出的任务，按文件中的顺序
+     * @param errmsg 失败原因
+     * @return 文件不存在或格式错误时返回false
+     */
+    static bool parse(const std::string &file, std::vector<TaskConfig> &tasks, std::string &errmsg);
+};
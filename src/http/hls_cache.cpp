@@ -0,0 +1,256 @@
+#include "hls_cache.h"
+#include "../common/logger.h"
+#include "../utils/dir_watcher.hpp"
+#include "../utils/metrics.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+HlsCache::HlsCache()
+{
+    DirWatcher::getinstance().add_listener(
+        [this](const std::string &dir, const std::string &name, uint32_t mask) { on_event(dir, name, mask); });
+}
+
+void HlsCache::set_capacity(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_capacity = bytes;
+    evict_locked();
+}
+
+size_t HlsCache::bytes()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+void HlsCache::watch_dir(const std::string &dir)
+{
+    DirWatcher::getinstance().watch(dir);
+}
+
+void HlsCache::unwatch_dir(const std::string &dir)
+{
+    DirWatcher::getinstance().unwatch(dir);
+    invalidate_dir(dir);
+}
+
+HlsCache::Buffer HlsCache::get(const std::string &path, struct stat *st)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto iter = m_entries.find(path);
+        if (iter != m_entries.end())
+        {
+            m_lru.splice(m_lru.begin(), m_lru, iter->second.lru_pos);
+            m_hits++;
+            Metrics::getinstance().on_cache_lookup(Metrics::CACHE_HIT);
+            if (st)
+                *st = iter->second.st;
+            return iter->second.data;
+        }
+    }
+
+    // 只处理被监听目录下的文件，其他文件无法得知何时失效
+    auto pos = path.rfind('/');
+    if (pos == string::npos || !DirWatcher::getinstance().is_watched(path.substr(0, pos)))
+        return nullptr;
+
+    std::shared_ptr<Loading> loading;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        // 等待期间其他请求可能已经加载完成
+        auto iter = m_entries.find(path);
+        if (iter != m_entries.end())
+        {
+            m_lru.splice(m_lru.begin(), m_lru, iter->second.lru_pos);
+            m_hits++;
+            Metrics::getinstance().on_cache_lookup(Metrics::CACHE_HIT);
+            if (st)
+                *st = iter->second.st;
+            return iter->second.data;
+        }
+
+        // 同一文件正在加载且内容没有变化时，等待这次加载的结果
+        auto &current = m_loading[path];
+        if (current && !current->stale)
+        {
+            auto waiting = current;
+            m_coalesced++;
+            Metrics::getinstance().on_cache_lookup(Metrics::CACHE_COALESCED);
+            m_loaded.wait(lock, [&waiting]() { return waiting->done; });
+            if (st && waiting->data)
+                *st = waiting->st;
+            return waiting->data;
+        }
+
+        // 之前的加载已经过期，由本次请求重新加载，之前的加载完成时不会移除本次的记录
+        current = std::make_shared<Loading>();
+        loading = current;
+    }
+
+    m_misses++;
+    Metrics::getinstance().on_cache_lookup(Metrics::CACHE_MISS);
+    Buffer data;
+    struct stat data_st = {};
+    if (!load(path, data, data_st))
+        data = nullptr;
+    if (st && data)
+        *st = data_st;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    loading->data = data;
+    loading->st = data_st;
+    loading->done = true;
+    auto it = m_loading.find(path);
+    if (it != m_loading.end() && it->second == loading)
+        m_loading.erase(it);
+    m_loaded.notify_all();
+
+    // 加载期间文件发生了变化，本次内容只给当前和已经在等待的请求使用
+    if (!data || loading->stale || m_capacity == 0 || data->size() > m_capacity / 4)
+        return data;
+
+    auto iter = m_entries.find(path);
+    if (iter != m_entries.end())
+    {
+        if (st)
+            *st = iter->second.st;
+        return iter->second.data;
+    }
+
+    m_lru.push_front(path);
+    m_entries[path] = Entry{data, data_st, m_lru.begin()};
+    m_bytes += data->size();
+    evict_locked();
+    return data;
+}
+
+bool HlsCache::load(const std::string &path, Buffer &data, struct stat &st)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    auto buf = std::make_shared<std::string>();
+    buf->resize(static_cast<size_t>(st.st_size));
+
+    size_t offset = 0;
+    while (offset < buf->size())
+    {
+        ssize_t n = ::read(fd, &(*buf)[offset], buf->size() - offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        offset += static_cast<size_t>(n);
+    }
+    ::close(fd);
+
+    // 读取过程中文件被截断，以实际读到的内容为准
+    buf->resize(offset);
+    data = buf;
+    return true;
+}
+
+void HlsCache::erase_locked(const std::string &path)
+{
+    auto it = m_loading.find(path);
+    if (it != m_loading.end())
+        it->second->stale = true;
+
+    auto iter = m_entries.find(path);
+    if (iter == m_entries.end())
+        return;
+
+    m_bytes -= iter->second.data->size();
+    m_lru.erase(iter->second.lru_pos);
+    m_entries.erase(iter);
+}
+
+void HlsCache::evict_locked()
+{
+    while (m_bytes > m_capacity && !m_lru.empty())
+    {
+        auto iter = m_entries.find(m_lru.back());
+        m_bytes -= iter->second.data->size();
+        m_entries.erase(iter);
+        m_lru.pop_back();
+    }
+}
+
+void HlsCache::invalidate(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    erase_locked(path);
+}
+
+void HlsCache::invalidate_dir(const std::string &dir)
+{
+    auto prefix = dir + "/";
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &item : m_loading)
+    {
+        if (!item.first.compare(0, prefix.size(), prefix))
+            item.second->stale = true;
+    }
+
+    for (auto iter = m_entries.begin(); iter != m_entries.end();)
+    {
+        if (iter->first.compare(0, prefix.size(), prefix))
+        {
+            ++iter;
+            continue;
+        }
+        m_bytes -= iter->second.data->size();
+        m_lru.erase(iter->second.lru_pos);
+        iter = m_entries.erase(iter);
+    }
+}
+
+void HlsCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &item : m_loading)
+    {
+        item.second->stale = true;
+    }
+    m_entries.clear();
+    m_lru.clear();
+    m_bytes = 0;
+}
+
+void HlsCache::on_event(const std::string &dir, const std::string &name, uint32_t mask)
+{
+    // 事件队列溢出，无法确定哪些文件发生了变化
+    if (mask & IN_Q_OVERFLOW)
+    {
+        auto logger = MyLogger::getLogger("hls");
+        LOG_WARN(logger, "inotify queue overflow, clear hls cache.");
+        clear();
+        return;
+    }
+
+    if (mask & (IN_IGNORED | IN_DELETE_SELF))
+    {
+        invalidate_dir(dir);
+        return;
+    }
+
+    if (!name.empty())
+        invalidate(dir + "/" + name);
+}
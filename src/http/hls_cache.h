@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief HLS切片和播放列表的内存缓存
+ *
+ * 只缓存被监听目录（每个任务的m3u8_dir）下的文件，文件内容以只读的
+ * shared_ptr缓冲区共享给所有请求，按字节数上限做LRU淘汰。
+ * 目录下文件写完、改名或删除时，由inotify事件使对应缓存失效，
+ * 因此每个切片只需从磁盘读取一次。
+ *
+ * 同一文件的并发请求合并为一次读取：新切片生成后所有播放器几乎同时请求，
+ * 第一个请求负责读盘，加载期间到达的请求等待并共享同一个缓冲区。
+ * 缓存关闭(上限为0)时仍然合并并发读取，只是不保留结果。
+ */
+class HlsCache
+{
+  public:
+    using Buffer = std::shared_ptr<const std::string>;
+
+  private:
+    HlsCache();
+
+    struct Entry
+    {
+        Buffer data;                              // 文件内容
+        struct stat st;                           // 读取时打开的文件的属性，用于生成ETag等校验值
+        std::list<std::string>::iterator lru_pos; // 在LRU链表中的位置
+    };
+
+    // 正在从磁盘加载的文件，加载期间收到失效事件则不写入缓存，之后的请求也不再等待这次加载
+    struct Loading
+    {
+        bool stale = false;
+        bool done = false;
+        Buffer data; // 加载结果，读取失败时为nullptr
+        struct stat st;
+    };
+
+    std::mutex m_mutex;                                // 保护以下成员
+    std::unordered_map<std::string, Entry> m_entries;  // 路径到缓存项
+    std::unordered_map<std::string, std::shared_ptr<Loading>> m_loading; // 正在加载的路径
+    std::condition_variable m_loaded;                  // 加载完成时通知等待的请求
+    std::list<std::string> m_lru;                      // 最近使用的在前
+    size_t m_bytes = 0;                                // 当前缓存字节数
+    size_t m_capacity = 0;                             // 缓存字节数上限，0表示不缓存
+
+    std::atomic<uint64_t> m_hits{0};   // 命中次数
+    std::atomic<uint64_t> m_misses{0}; // 未命中次数，即读盘次数
+    std::atomic<uint64_t> m_coalesced{0}; // 等待其他请求加载的次数
+
+    void on_event(const std::string &dir, const std::string &name, uint32_t mask);
+    void erase_locked(const std::string &path);
+    void evict_locked();
+    bool load(const std::string &path, Buffer &data, struct stat &st);
+
+  public:
+    static HlsCache &getinstance()
+    {
+        static HlsCache instance;
+        return instance;
+    }
+
+    /**
+     * @brief 设置缓存字节数上限，0表示关闭缓存(仍然合并并发读取)
+     */
+    void set_capacity(size_t bytes);
+
+    /**
+     * @brief 获取文件内容
+     * @param path 文件路径，与任务m3u8_dir拼接方式一致，例如./html/live/my/hls.m3u8
+     * @param st 不为空时返回读取内容时打开的文件的属性，与内容一致，缓存失效前文件被替换也不会错配
+     * @return 文件内容，文件不在监听目录或读取失败时返回nullptr，由调用方直接读磁盘
+     */
+    Buffer get(const std::string &path, struct stat *st = nullptr);
+
+    /**
+     * @brief 监听任务输出目录，目录下文件变化时使缓存失效
+     */
+    void watch_dir(const std::string &dir);
+
+    /**
+     * @brief 取消监听任务输出目录，并清除该目录下的缓存
+     */
+    void unwatch_dir(const std::string &dir);
+
+    // 使单个文件或整个目录的缓存失效
+    void invalidate(const std::string &path);
+    void invalidate_dir(const std::string &dir);
+    void clear();
+
+    // 统计信息
+    uint64_t hits() const { return m_hits; }
+    uint64_t misses() const { return m_misses; }
+    uint64_t coalesced() const { return m_coalesced; }
+    size_t bytes();
+};
@@ -0,0 +1,312 @@
+#include "hls_reload.h"
+#include "../common/app_config.h"
+#include "../utils/dir_watcher.hpp"
+#include "hls_cache.h"
+#include "wait_limiter.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+using namespace httplib;
+
+// 没有等待到更新时的超时，按目标时长的倍数
+#define HLS_RELOAD_TIMEOUT_FACTOR 3
+// 请求的切片比播放列表中最新的切片超前超过该数量时返回400
+#define HLS_RELOAD_MAX_AHEAD 2
+// 定期重新检查的间隔(毫秒)，目录监听不可用时也能返回
+#define HLS_RELOAD_RECHECK_MS 200
+// 任务和推流的输出根目录，目录监听事件中的目录以它开头
+#define HLS_RELOAD_OUTPUT_ROOT "./html"
+
+namespace
+{
+// 播放列表中与阻塞更新相关的信息
+struct PlaylistInfo
+{
+    bool valid = false;
+    int64_t target = 0;      // 目标时长(秒)
+    double part_target = 0;  // 分片目标时长(秒)，没有分片时为0
+    int64_t next_msn = 0;    // 第一个还没有完成的切片序号
+    int64_t parts = 0;       // 切片next_msn已经完成的分片数
+    std::string hint;        // 预加载提示的分片地址
+};
+
+bool starts_with(const std::string &s, const char *prefix, size_t n)
+{
+    return !s.compare(0, n, prefix);
+}
+
+bool ends_with(const std::string &s, const char *suffix, size_t n)
+{
+    return s.size() >= n && !s.compare(s.size() - n, n, suffix);
+}
+
+PlaylistInfo parse_playlist(const std::string &data)
+{
+    PlaylistInfo info;
+    int64_t sequence = 0;
+    int64_t segments = 0;
+
+    std::istringstream in(data);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        if (starts_with(line, "#EXTM3U", 7))
+        {
+            info.valid = true;
+        }
+        else if (starts_with(line, "#EXT-X-TARGETDURATION:", 22))
+        {
+            info.target = atoll(line.c_str() + 22);
+        }
+        else if (starts_with(line, "#EXT-X-MEDIA-SEQUENCE:", 22))
+        {
+            sequence = atoll(line.c_str() + 22);
+        }
+        else if (starts_with(line, "#EXT-X-PART-INF:PART-TARGET=", 28))
+        {
+            info.part_target = atof(line.c_str() + 28);
+        }
+        else if (starts_with(line, "#EXTINF:", 8))
+        {
+            // 切片之前列出的分片属于这个切片
+            segments++;
+            info.parts = 0;
+        }
+        else if (starts_with(line, "#EXT-X-PART:", 12))
+        {
+            info.parts++;
+        }
+        else if (starts_with(line, "#EXT-X-PRELOAD-HINT:", 20))
+        {
+            auto begin = line.find("URI=\"");
+            auto end = begin == std::string::npos ? begin : line.find('"', begin + 5);
+            if (end != std::string::npos)
+                info.hint = line.substr(begin + 5, end - begin - 5);
+        }
+    }
+
+    info.next_msn = sequence + segments;
+    return info;
+}
+
+// 读取播放列表，优先使用内存缓存
+std::string read_file(const std::string &path)
+{
+    auto data = HlsCache::getinstance().get(path);
+    if (data)
+        return *data;
+
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream out;
+    out << in.rdbuf();
+    return out.str();
+}
+
+// 解析非负整数参数，格式错误时返回false
+bool parse_param(const Request &req, const char *key, int64_t &value)
+{
+    auto s = req.get_param_value(key);
+    char *end = nullptr;
+    value = strtoll(s.c_str(), &end, 10);
+    return !s.empty() && *end == '\0' && value >= 0;
+}
+} // namespace
+
+HlsReload::HlsReload()
+{
+    // 需在缓存之后收到事件，被唤醒的请求不会读到已经失效的缓存
+    HlsCache::getinstance();
+    DirWatcher::getinstance().add_listener(
+        [this](const std::string &dir, const std::string &name, uint32_t mask) { on_event(dir, name, mask); });
+}
+
+void HlsReload::set_base_dir(const std::string &dir)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_base_dir = dir;
+}
+
+void HlsReload::on_event(const std::string &dir, const std::string & /*name*/, uint32_t /*mask*/)
+{
+    // 等待者按请求路径中的目录登记，与静态文件根目录无关
+    static const std::string root = HLS_RELOAD_OUTPUT_ROOT;
+    if (dir.compare(0, root.size(), root))
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto iter = m_waiters.find(dir.substr(root.size()));
+    if (iter == m_waiters.end())
+        return;
+    iter->second->version++;
+    iter->second->cond.notify_all();
+}
+
+std::shared_ptr<HlsReload::Waiters> HlsReload::acquire(const std::string &dir)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto &waiters = m_waiters[dir];
+    if (!waiters)
+        waiters = std::make_shared<Waiters>();
+    waiters->refs++;
+    return waiters;
+}
+
+void HlsReload::release(const std::string &dir, const std::shared_ptr<Waiters> &waiters)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (--waiters->refs == 0)
+        m_waiters.erase(dir);
+}
+
+Server::HandlerResponse HlsReload::on_request(const Request &req, Response &res)
+{
+    if ((req.method != "GET" && req.method != "HEAD") || !detail::is_valid_path(req.path))
+        return Server::HandlerResponse::Unhandled;
+
+    std::string base_dir;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        base_dir = m_base_dir;
+    }
+
+    auto dir = req.path.substr(0, req.path.rfind('/'));
+    int status = 200;
+    if (ends_with(req.path, ".ts", 3) || ends_with(req.path, ".m4s", 4))
+    {
+        if ((status = wait_part(base_dir + req.path, dir)) == 200)
+            return Server::HandlerResponse::Unhandled;
+
+        res.status = status;
+        res.set_header("Retry-After", "1");
+        return Server::HandlerResponse::Handled;
+    }
+
+    if (!ends_with(req.path, ".m3u8", 5) || (!req.has_param("_HLS_msn") && !req.has_param("_HLS_part")))
+        return Server::HandlerResponse::Unhandled;
+
+    // _HLS_part必须与_HLS_msn一起使用
+    int64_t msn = 0;
+    int64_t part = -1;
+    if (!parse_param(req, "_HLS_msn", msn) || (req.has_param("_HLS_part") && !parse_param(req, "_HLS_part", part)))
+    {
+        res.status = 400;
+        return Server::HandlerResponse::Handled;
+    }
+
+    status = wait_playlist(base_dir + req.path, dir, msn, part);
+    if (status == 200)
+        return Server::HandlerResponse::Unhandled;
+
+    res.status = status;
+    if (status == 503)
+        res.set_header("Retry-After", "1");
+    return Server::HandlerResponse::Handled;
+}
+
+int HlsReload::wait_playlist(const std::string &path, const std::string &dir, int64_t msn, int64_t part)
+{
+    auto waiters = acquire(dir);
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    int status = 200;
+    bool waiting = false; // 是否占用了等待名额
+
+    while (true)
+    {
+        // 先记录版本再读取，读取期间的变化不会错过
+        uint64_t version = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            version = waiters->version;
+        }
+
+        auto info = parse_playlist(read_file(path));
+        if (info.valid)
+        {
+            if (msn < info.next_msn || (msn == info.next_msn && part >= 0 && part < info.parts))
+                break;
+            // 最新的完整切片是next_msn - 1
+            if (msn > info.next_msn - 1 + HLS_RELOAD_MAX_AHEAD)
+            {
+                status = 400;
+                break;
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (deadline == std::chrono::steady_clock::time_point::max())
+        {
+            auto target = info.target > 0 ? info.target : AppConfig::getinstance().get_int("hls_time", 2);
+            deadline = now + std::chrono::seconds(target * HLS_RELOAD_TIMEOUT_FACTOR);
+        }
+        // 播放列表不存在时由静态文件处理返回404
+        if (now >= deadline)
+        {
+            status = info.valid ? 503 : 200;
+            break;
+        }
+        // 同时等待的请求过多时不再等待
+        if (!waiting && !(waiting = WaitLimiter::getinstance().try_acquire()))
+        {
+            status = 503;
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        waiters->cond.wait_until(lock, std::min(deadline, now + std::chrono::milliseconds(HLS_RELOAD_RECHECK_MS)),
+                                 [&waiters, version]() { return waiters->version != version; });
+    }
+
+    if (waiting)
+        WaitLimiter::getinstance().release();
+    release(dir, waiters);
+    return status;
+}
+
+int HlsReload::wait_part(const std::string &path, const std::string &dir)
+{
+    if (::access(path.c_str(), F_OK) == 0)
+        return 200;
+
+    // 只等待播放列表中预加载提示的分片，其他不存在的文件直接返回404
+    auto pos = path.rfind('/');
+    auto info = parse_playlist(read_file(path.substr(0, pos) + "/hls.m3u8"));
+    if (info.hint.empty() || info.hint != path.substr(pos + 1))
+        return 200;
+
+    WaitLimiter::Slot slot;
+    if (!slot.acquired())
+        return 503;
+
+    double timeout = (info.part_target > 0 ? info.part_target : static_cast<double>(info.target)) *
+                     HLS_RELOAD_TIMEOUT_FACTOR;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(static_cast<int64_t>(timeout * 1000));
+
+    auto waiters = acquire(dir);
+    while (true)
+    {
+        uint64_t version = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            version = waiters->version;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (::access(path.c_str(), F_OK) == 0 || now >= deadline)
+            break;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        waiters->cond.wait_until(lock, std::min(deadline, now + std::chrono::milliseconds(HLS_RELOAD_RECHECK_MS)),
+                                 [&waiters, version]() { return waiters->version != version; });
+    }
+    release(dir, waiters);
+    return 200;
+}
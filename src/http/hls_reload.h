@@ -0,0 +1,74 @@
+#pragma once
+
+#include "httplib.h"
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief LL-HLS的阻塞式播放列表更新和预加载分片等待
+ *
+ * 播放器请求hls.m3u8?_HLS_msn=M&_HLS_part=P时，等到播放列表中出现序号为M的切片
+ * (或切片M的第P个分片)后才返回，播放器用长轮询代替定时刷新；超过3倍目标时长仍没有
+ * 更新时返回503，M比播放列表中最新的切片超前2个以上时返回400。
+ * 请求播放列表中EXT-X-PRELOAD-HINT指向的还未生成的分片时，等到分片生成后再返回。
+ *
+ * 目录下的播放列表和切片变化时由inotify事件唤醒对应目录的等待者，不轮询磁盘。
+ * 等待在HTTP工作线程中进行，与按需启动时等待首个播放列表共用WaitLimiter的名额，名额用完时返回503。
+ */
+class HlsReload
+{
+  private:
+    HlsReload();
+
+    // 单个目录的等待者
+    struct Waiters
+    {
+        std::condition_variable cond;
+        uint64_t version = 0; // 目录下文件变化的次数
+        int refs = 0;
+    };
+
+    std::mutex m_mutex; // 保护以下成员
+    std::map<std::string, std::shared_ptr<Waiters>> m_waiters; // 请求路径中的目录(如/live/my)到等待者
+    std::string m_base_dir = "./html";
+
+    void on_event(const std::string &dir, const std::string &name, uint32_t mask);
+    std::shared_ptr<Waiters> acquire(const std::string &dir);
+    void release(const std::string &dir, const std::shared_ptr<Waiters> &waiters);
+
+  public:
+    static HlsReload &getinstance()
+    {
+        static HlsReload instance;
+        return instance;
+    }
+
+    // 设置静态文件根目录，与HTTP挂载点一致
+    void set_base_dir(const std::string &dir);
+
+    /**
+     * @brief 处理播放列表和分片请求，需要时阻塞等待
+     * @return 已经生成错误响应时返回Handled，否则返回Unhandled由静态文件处理
+     */
+    httplib::Server::HandlerResponse on_request(const httplib::Request &req, httplib::Response &res);
+
+  private:
+    /**
+     * @brief 等待播放列表包含指定的切片或分片
+     * @param path 播放列表文件路径
+     * @param dir 请求路径中的目录，等待者按它登记
+     * @param msn 切片序号
+     * @param part 分片序号，-1表示只等待切片完成
+     * @return HTTP状态码，200表示已经包含
+     */
+    int wait_playlist(const std::string &path, const std::string &dir, int64_t msn, int64_t part);
+
+    // 等待预加载提示的分片生成，返回HTTP状态码，200表示交给静态文件处理
+    int wait_part(const std::string &path, const std::string &dir);
+};
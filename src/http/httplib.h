@@ -153,6 +153,7 @@ using socket_t = SOCKET;
 
 #include <arpa/inet.h>
 #include <cstring>
+#include <ctime>
 #include <ifaddrs.h>
 #include <netdb.h>
 #include <netinet/in.h>
@@ -167,6 +168,10 @@ using socket_t = SOCKET;
 #include <pthread.h>
 #include <sys/select.h>
 #include <sys/socket.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#endif
 #include <unistd.h>
 
 using socket_t = int;
@@ -176,6 +181,7 @@ using socket_t = int;
 #include <array>
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <climits>
 #include <condition_variable>
 #include <errno.h>
@@ -347,6 +353,7 @@ struct Request {
   MultipartFormDataMap files;
   Ranges ranges;
   Match matches;
+  std::chrono::steady_clock::time_point start_time; // when the request line was read
 
   // for client
   size_t redirect_count = CPPHTTPLIB_REDIRECT_MAX_COUNT;
@@ -412,6 +419,9 @@ struct Response {
       const char *content_type, ContentProviderWithoutLength provider,
       const std::function<void()> &resource_releaser = nullptr);
 
+  // Takes ownership of `fd`; the body is sent from the file descriptor
+  void set_file_content(int fd, size_t length, const char *content_type);
+
   Response() = default;
   Response(const Response &) = default;
   Response &operator=(const Response &) = default;
@@ -428,6 +438,7 @@ struct Response {
   ContentProvider content_provider_;
   std::function<void()> content_provider_resource_releaser_;
   bool is_chunked_content_provider = false;
+  int file_fd_ = -1;
 };
 
 class Stream {
@@ -441,6 +452,12 @@ public:
   virtual ssize_t write(const char *ptr, size_t size) = 0;
   virtual void get_remote_ip_and_port(std::string &ip, int &port) const = 0;
 
+  // Zero-copy transfer from a file descriptor, when the stream supports it
+  virtual bool is_send_file_supported() const { return false; }
+  virtual ssize_t send_file(int /*fd*/, size_t /*offset*/, size_t /*size*/) {
+    return -1;
+  }
+
   template <typename... Args>
   ssize_t write_format(const char *fmt, const Args &... args);
   ssize_t write(const char *ptr);
@@ -530,6 +547,12 @@ private:
 
 using Logger = std::function<void(const Request &, const Response &)>;
 
+// Returns the content of a file, or nullptr to let the server read it. st
+// receives the attributes of the file the content was read from, which the
+// ETag and Last-Modified validators are built from.
+using FileReader = std::function<std::shared_ptr<const std::string>(
+    const std::string &path, struct stat &st)>;
+
 using SocketOptions = std::function<void(socket_t sock)>;
 
 inline void default_socket_options(socket_t sock) {
@@ -553,6 +576,13 @@ inline void default_socket_options(socket_t sock) {
 class Server {
 public:
   using Handler = std::function<void(const Request &, Response &)>;
+
+  enum class HandlerResponse {
+    Handled,
+    Unhandled,
+  };
+  using HandlerWithResponse =
+      std::function<HandlerResponse(const Request &, Response &)>;
   using HandlerWithContentReader = std::function<void(
       const Request &, Response &, const ContentReader &content_reader)>;
   using Expect100ContinueHandler =
@@ -581,8 +611,10 @@ public:
   void set_file_extension_and_mimetype_mapping(const char *ext,
                                                const char *mime);
   void set_file_request_handler(Handler handler);
+  void set_file_reader(FileReader reader);
 
   void set_error_handler(Handler handler);
+  void set_pre_routing_handler(HandlerWithResponse handler);
   void set_expect_100_continue_handler(Expect100ContinueHandler handler);
   void set_logger(Logger logger);
 
@@ -590,11 +622,14 @@ public:
   void set_socket_options(SocketOptions socket_options);
 
   void set_keep_alive_max_count(size_t count);
+  void set_reactor_thread_count(size_t count);
+  void set_listener_count(size_t count, bool pin_cpus = true);
   void set_read_timeout(time_t sec, time_t usec = 0);
   void set_write_timeout(time_t sec, time_t usec = 0);
   void set_idle_interval(time_t sec, time_t usec = 0);
 
   void set_payload_max_length(size_t length);
+  void set_sendfile_min_size(size_t size);
 
   bool bind_to_port(const char *host, int port, int socket_flags = 0);
   int bind_to_any_port(const char *host, int socket_flags = 0);
@@ -614,6 +649,10 @@ protected:
 
   std::atomic<socket_t> svr_sock_;
   size_t keep_alive_max_count_ = CPPHTTPLIB_KEEPALIVE_MAX_COUNT;
+  size_t reactor_thread_count_ = 0;
+  size_t listener_count_ = 1;
+  bool pin_listener_cpus_ = true;
+  std::vector<socket_t> reuseport_socks_; // Listeners besides svr_sock_
   time_t read_timeout_sec_ = CPPHTTPLIB_READ_TIMEOUT_SECOND;
   time_t read_timeout_usec_ = CPPHTTPLIB_READ_TIMEOUT_USECOND;
   time_t write_timeout_sec_ = CPPHTTPLIB_WRITE_TIMEOUT_SECOND;
@@ -621,6 +660,7 @@ protected:
   time_t idle_interval_sec_ = CPPHTTPLIB_IDLE_INTERVAL_SECOND;
   time_t idle_interval_usec_ = CPPHTTPLIB_IDLE_INTERVAL_USECOND;
   size_t payload_max_length_ = CPPHTTPLIB_PAYLOAD_MAX_LENGTH;
+  size_t sendfile_min_size_ = (std::numeric_limits<size_t>::max)();
 
 private:
   using Handlers = std::vector<std::pair<std::regex, Handler>>;
@@ -631,9 +671,11 @@ private:
                                 SocketOptions socket_options) const;
   int bind_internal(const char *host, int port, int socket_flags);
   bool listen_internal();
+  bool accept_loop(socket_t sock);
+  void pin_listener(size_t index, size_t count);
 
   bool routing(Request &req, Response &res, Stream &strm);
-  bool handle_file_request(Request &req, Response &res, bool head = false);
+  bool handle_file_request(Request &req, Response &res);
   bool dispatch_request(Request &req, Response &res, const Handlers &handlers);
   bool
   dispatch_request_for_content_reader(Request &req, Response &res,
@@ -658,11 +700,13 @@ private:
                          ContentReceiver multipart_receiver);
 
   virtual bool process_and_close_socket(socket_t sock);
+  bool process_socket_request(socket_t sock, bool close_connection);
 
   std::atomic<bool> is_running_;
   std::vector<std::pair<std::string, std::string>> base_dirs_;
   std::map<std::string, std::string> file_extension_and_mimetype_map_;
   Handler file_request_handler_;
+  FileReader file_reader_;
   Handlers get_handlers_;
   Handlers post_handlers_;
   HandlersForContentReader post_handlers_for_content_reader_;
@@ -674,6 +718,7 @@ private:
   HandlersForContentReader delete_handlers_for_content_reader_;
   Handlers options_handlers_;
   Handler error_handler_;
+  HandlerWithResponse pre_routing_handler_;
   Logger logger_;
   Expect100ContinueHandler expect_100_continue_handler_;
 
@@ -1433,6 +1478,53 @@ inline void read_file(const std::string &path, std::string &out) {
   fs.read(&out[0], static_cast<std::streamsize>(size));
 }
 
+inline int open_file(const std::string &path, size_t &size,
+                     struct stat *out = nullptr) {
+#ifdef _WIN32
+  (void)path;
+  (void)size;
+  (void)out;
+  return -1;
+#else
+  auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) { return -1; }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return -1;
+  }
+  size = static_cast<size_t>(st.st_size);
+  if (out) { *out = st; }
+  return fd;
+#endif
+}
+
+// Reads a file together with the attributes of the opened file, so that the
+// validators match the content even if the path is replaced concurrently
+inline bool read_file(const std::string &path, std::string &out,
+                      struct stat &st) {
+#ifdef _WIN32
+  if (stat(path.c_str(), &st) < 0) { return false; }
+  read_file(path, out);
+  return true;
+#else
+  size_t size = 0;
+  auto fd = open_file(path, size, &st);
+  if (fd < 0) { return false; }
+  out.resize(size);
+  size_t offset = 0;
+  while (offset < size) {
+    auto n = ::read(fd, &out[offset], size - offset);
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n <= 0) { break; }
+    offset += static_cast<size_t>(n);
+  }
+  ::close(fd);
+  out.resize(offset);
+  return true;
+#endif
+}
+
 inline std::string file_extension(const std::string &path) {
   std::smatch m;
   static auto re = std::regex("\\.([a-zA-Z0-9]+)$");
@@ -1470,6 +1562,70 @@ template <class Fn> void split(const char *b, const char *e, char d, Fn fn) {
   }
 }
 
+// Strong validator: the same inode, size and modification time mean the same
+// content, since files are replaced by rename rather than rewritten in place
+inline std::string make_file_etag(const struct stat &st) {
+  unsigned long long nsec = 0;
+#ifdef __linux__
+  nsec = static_cast<unsigned long long>(st.st_mtim.tv_nsec);
+#endif
+  char buf[96];
+  snprintf(buf, sizeof(buf), "\"%llx-%llx-%llx\"",
+           static_cast<unsigned long long>(st.st_ino),
+           static_cast<unsigned long long>(st.st_size),
+           static_cast<unsigned long long>(st.st_mtime) * 1000000000ULL + nsec);
+  return buf;
+}
+
+inline std::string make_http_date(time_t t) {
+  struct tm tm;
+#ifdef _WIN32
+  gmtime_s(&tm, &t);
+#else
+  gmtime_r(&t, &tm);
+#endif
+  char buf[64];
+  strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  return buf;
+}
+
+inline bool parse_http_date(const std::string &s, time_t &t) {
+#ifdef _WIN32
+  (void)s;
+  (void)t;
+  return false;
+#else
+  struct tm tm;
+  memset(&tm, 0, sizeof(tm));
+  auto end = strptime(s.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  if (!end || *end) { return false; }
+  t = timegm(&tm);
+  return true;
+#endif
+}
+
+// If-None-Match uses the weak comparison, and takes precedence over
+// If-Modified-Since (RFC 7232 section 3.2 and 6)
+inline bool is_not_modified(const Request &req, const std::string &etag,
+                            time_t mtime, bool has_last_modified) {
+  if (req.has_header("If-None-Match")) {
+    auto value = req.get_header_value("If-None-Match");
+    auto matched = false;
+    split(value.data(), value.data() + value.size(), ',',
+          [&](const char *b, const char *e) {
+            std::string tag(b, e);
+            if (!tag.compare(0, 2, "W/")) { tag.erase(0, 2); }
+            if (tag == "*" || tag == etag) { matched = true; }
+          });
+    return matched;
+  }
+
+  time_t since = 0;
+  return has_last_modified && req.has_header("If-Modified-Since") &&
+         parse_http_date(req.get_header_value("If-Modified-Since"), since) &&
+         mtime <= since;
+}
+
 // NOTE: until the read size reaches `fixed_buffer_size`, use `fixed_buffer`
 // to store data. The call can set memory on stack for performance.
 class stream_line_reader {
@@ -1668,6 +1824,8 @@ public:
   ssize_t read(char *ptr, size_t size) override;
   ssize_t write(const char *ptr, size_t size) override;
   void get_remote_ip_and_port(std::string &ip, int &port) const override;
+  bool is_send_file_supported() const override;
+  ssize_t send_file(int fd, size_t offset, size_t size) override;
 
 private:
   socket_t sock_;
@@ -2045,6 +2203,16 @@ find_content_type(const std::string &path,
     return "application/xml";
   } else if (ext == "xhtml") {
     return "application/xhtml+xml";
+  } else if (ext == "m3u8") {
+    return "application/vnd.apple.mpegurl";
+  } else if (ext == "ts") {
+    return "video/mp2t";
+  } else if (ext == "mp4") {
+    return "video/mp4";
+  } else if (ext == "m4s") {
+    return "video/iso.segment";
+  } else if (ext == "mpd") {
+    return "application/dash+xml";
   }
   return nullptr;
 }
@@ -2666,6 +2834,39 @@ inline bool write_data(Stream &strm, const char *d, size_t l) {
   return true;
 }
 
+inline bool write_file_content(Stream &strm, int fd, size_t offset,
+                               size_t length) {
+  auto end_offset = offset + length;
+
+  if (strm.is_send_file_supported()) {
+    while (offset < end_offset) {
+      auto n = strm.send_file(fd, offset, end_offset - offset);
+      if (n < 0 && (errno == EINVAL || errno == ENOSYS)) { break; }
+      // The file was truncated or the socket failed
+      if (n <= 0) { return false; }
+      offset += static_cast<size_t>(n);
+    }
+    if (offset == end_offset) { return true; }
+  }
+
+#ifdef _WIN32
+  return false;
+#else
+  // Fall back to copying through userspace
+  char buf[CPPHTTPLIB_RECV_BUFSIZ * 16];
+  while (offset < end_offset) {
+    auto n = handle_EINTR([&]() {
+      return pread(fd, buf, (std::min)(sizeof(buf), end_offset - offset),
+                   static_cast<off_t>(offset));
+    });
+    if (n <= 0) { return false; }
+    if (!write_data(strm, buf, static_cast<size_t>(n))) { return false; }
+    offset += static_cast<size_t>(n);
+  }
+  return true;
+#endif
+}
+
 template <typename T>
 inline ssize_t write_content(Stream &strm, ContentProvider content_provider,
                              size_t offset, size_t length, T is_shutting_down) {
@@ -3139,12 +3340,13 @@ bool process_multipart_ranges_data(const Request &req, Response &res,
       ctoken("\r\n");
     }
 
-    auto offsets = get_range_offset_and_length(req, res.body.size(), i);
+    auto total = res.body.empty() ? res.content_length_ : res.body.size();
+    auto offsets = get_range_offset_and_length(req, total, i);
     auto offset = offsets.first;
     auto length = offsets.second;
 
     ctoken("Content-Range: ");
-    stoken(make_content_range_header_field(offset, length, res.body.size()));
+    stoken(make_content_range_header_field(offset, length, total));
     ctoken("\r\n");
     ctoken("\r\n");
     if (!content(offset, length)) { return false; }
@@ -3606,6 +3808,35 @@ inline void Response::set_chunked_content_provider(
   is_chunked_content_provider = true;
 }
 
+inline void Response::set_file_content(int fd, size_t length,
+                                       const char *content_type) {
+  assert(length > 0);
+  set_header("Content-Type", content_type);
+  content_length_ = length;
+  // Used for multipart ranges, single ranges go through `file_fd_` directly
+  content_provider_ = [fd](size_t offset, size_t length, DataSink &sink) {
+#ifdef _WIN32
+    (void)fd;
+    (void)offset;
+    (void)length;
+    (void)sink;
+    return false;
+#else
+    char buf[CPPHTTPLIB_RECV_BUFSIZ * 16];
+    auto n = detail::handle_EINTR([&]() {
+      return pread(fd, buf, (std::min)(sizeof(buf), length),
+                   static_cast<off_t>(offset));
+    });
+    if (n <= 0) { return false; }
+    sink.write(buf, static_cast<size_t>(n));
+    return true;
+#endif
+  };
+  content_provider_resource_releaser_ = [fd]() { detail::close_socket(fd); };
+  is_chunked_content_provider = false;
+  file_fd_ = fd;
+}
+
 // Rstream implementation
 inline ssize_t Stream::write(const char *ptr) {
   return write(ptr, strlen(ptr));
@@ -3651,6 +3882,162 @@ inline ssize_t Stream::write_format(const char *fmt, const Args &... args) {
 
 namespace detail {
 
+#ifdef __linux__
+// Edge-triggered epoll reactor for keep-alive connections. Idle sockets are
+// parked in epoll and only hand a worker job to the task queue when a request
+// arrives, so a connection holds a thread only while a request is processed.
+class Reactor {
+public:
+  // Processes one request, returns false when the connection must be closed
+  using Handler = std::function<bool(socket_t sock, bool close_connection)>;
+
+  Reactor(size_t loop_count, TaskQueue &task_queue, size_t keep_alive_max_count,
+          time_t keep_alive_timeout_msec, Handler handler)
+      : task_queue_(task_queue), keep_alive_max_count_(keep_alive_max_count),
+        keep_alive_timeout_msec_(keep_alive_timeout_msec),
+        handler_(std::move(handler)) {
+    for (size_t i = 0; i < (std::max)(loop_count, size_t(1)); i++) {
+      std::unique_ptr<Loop> loop(new Loop());
+      loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+      loops_.push_back(std::move(loop));
+    }
+    for (auto &loop : loops_) {
+      auto l = loop.get();
+      l->thread = std::thread([this, l]() { run(*l); });
+    }
+  }
+
+  Reactor(const Reactor &) = delete;
+
+  ~Reactor() {
+    shutdown();
+    for (auto &loop : loops_) {
+      for (auto &kv : loop->conns) {
+        detail::shutdown_socket(kv.first);
+        detail::close_socket(kv.first);
+      }
+      ::close(loop->epfd);
+    }
+  }
+
+  void add(socket_t sock) {
+    auto &loop = *loops_[next_loop_++ % loops_.size()];
+    std::lock_guard<std::mutex> guard(loop.mutex);
+    loop.conns[sock] = Connection();
+    if (!arm(loop, sock, EPOLL_CTL_ADD)) { close_locked(loop, sock); }
+  }
+
+  // Stops the event loops, in-flight requests still complete
+  void shutdown() {
+    if (shutdown_.exchange(true)) { return; }
+    for (auto &loop : loops_) {
+      if (loop->thread.joinable()) { loop->thread.join(); }
+    }
+  }
+
+private:
+  struct Connection {
+    std::chrono::steady_clock::time_point last_active =
+        std::chrono::steady_clock::now();
+    size_t count = 0;
+    bool busy = false;
+  };
+
+  struct Loop {
+    int epfd = -1;
+    std::thread thread;
+    std::mutex mutex;
+    std::map<socket_t, Connection> conns;
+  };
+
+  bool arm(Loop &loop, socket_t sock, int op) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+    ev.data.fd = sock;
+    return epoll_ctl(loop.epfd, op, sock, &ev) == 0;
+  }
+
+  void close_locked(Loop &loop, socket_t sock) {
+    epoll_ctl(loop.epfd, EPOLL_CTL_DEL, sock, nullptr);
+    loop.conns.erase(sock);
+    detail::shutdown_socket(sock);
+    detail::close_socket(sock);
+  }
+
+  void run(Loop &loop) {
+    std::array<struct epoll_event, 256> events;
+    auto last_sweep = std::chrono::steady_clock::now();
+
+    while (!shutdown_) {
+      auto n = epoll_wait(loop.epfd, events.data(),
+                          static_cast<int>(events.size()), 100);
+      if (n < 0 && errno != EINTR) { break; }
+
+      for (int i = 0; i < n; i++) {
+        auto sock = static_cast<socket_t>(events[i].data.fd);
+        auto flags = events[i].events;
+
+        std::lock_guard<std::mutex> guard(loop.mutex);
+        auto it = loop.conns.find(sock);
+        if (it == loop.conns.end()) { continue; }
+
+        if (!(flags & EPOLLIN) || (flags & (EPOLLERR | EPOLLHUP))) {
+          close_locked(loop, sock);
+          continue;
+        }
+
+        it->second.busy = true;
+        auto close_connection = it->second.count + 1 >= keep_alive_max_count_;
+        auto l = &loop;
+        task_queue_.enqueue([this, l, sock, close_connection]() {
+          finish(*l, sock, handler_(sock, close_connection));
+        });
+      }
+
+      // Close keep-alive connections which stayed idle for too long
+      auto now = std::chrono::steady_clock::now();
+      if (now - last_sweep >= std::chrono::seconds(1)) {
+        last_sweep = now;
+        auto timeout = std::chrono::milliseconds(keep_alive_timeout_msec_);
+        std::lock_guard<std::mutex> guard(loop.mutex);
+        for (auto it = loop.conns.begin(); it != loop.conns.end();) {
+          auto sock = it->first;
+          auto idle = !it->second.busy && now - it->second.last_active > timeout;
+          ++it;
+          if (idle) { close_locked(loop, sock); }
+        }
+      }
+    }
+  }
+
+  void finish(Loop &loop, socket_t sock, bool keep) {
+    std::lock_guard<std::mutex> guard(loop.mutex);
+    auto it = loop.conns.find(sock);
+    if (it == loop.conns.end()) { return; }
+
+    auto &conn = it->second;
+    conn.count++;
+    if (!keep || conn.count >= keep_alive_max_count_) {
+      close_locked(loop, sock);
+      return;
+    }
+
+    conn.busy = false;
+    conn.last_active = std::chrono::steady_clock::now();
+    // Re-arming reports data which already arrived while the job ran
+    if (!arm(loop, sock, EPOLL_CTL_MOD)) { close_locked(loop, sock); }
+  }
+
+  TaskQueue &task_queue_;
+  size_t keep_alive_max_count_;
+  time_t keep_alive_timeout_msec_;
+  Handler handler_;
+  std::vector<std::unique_ptr<Loop>> loops_;
+  std::atomic<size_t> next_loop_{0};
+  std::atomic<bool> shutdown_{false};
+};
+#endif
+
 // Socket stream implementation
 inline SocketStream::SocketStream(socket_t sock, time_t read_timeout_sec,
                                   time_t read_timeout_usec,
@@ -3702,6 +4089,29 @@ inline void SocketStream::get_remote_ip_and_port(std::string &ip,
   return detail::get_remote_ip_and_port(sock_, ip, port);
 }
 
+inline bool SocketStream::is_send_file_supported() const {
+#ifdef __linux__
+  return true;
+#else
+  return false;
+#endif
+}
+
+inline ssize_t SocketStream::send_file(int fd, size_t offset, size_t size) {
+#ifdef __linux__
+  if (!is_writable()) { return -1; }
+
+  auto off = static_cast<off_t>(offset);
+  return handle_EINTR([&]() { return ::sendfile(sock_, fd, &off, size); });
+#else
+  (void)fd;
+  (void)offset;
+  (void)size;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
 // Buffer stream implementation
 inline bool BufferStream::is_readable() const { return true; }
 
@@ -3833,10 +4243,18 @@ inline void Server::set_file_request_handler(Handler handler) {
   file_request_handler_ = std::move(handler);
 }
 
+inline void Server::set_file_reader(FileReader reader) {
+  file_reader_ = std::move(reader);
+}
+
 inline void Server::set_error_handler(Handler handler) {
   error_handler_ = std::move(handler);
 }
 
+inline void Server::set_pre_routing_handler(HandlerWithResponse handler) {
+  pre_routing_handler_ = std::move(handler);
+}
+
 inline void Server::set_tcp_nodelay(bool on) { tcp_nodelay_ = on; }
 
 inline void Server::set_socket_options(SocketOptions socket_options) {
@@ -3854,6 +4272,19 @@ inline void Server::set_keep_alive_max_count(size_t count) {
   keep_alive_max_count_ = count;
 }
 
+inline void Server::set_reactor_thread_count(size_t count) {
+  reactor_thread_count_ = count;
+}
+
+// Opens count SO_REUSEPORT listeners on the same port (Linux only), each with
+// its own accept thread, task queue and reactor, so the kernel spreads
+// connections across them. With pin_cpus each listener and the threads it
+// starts are pinned to an equal share of the allowed CPUs.
+inline void Server::set_listener_count(size_t count, bool pin_cpus) {
+  listener_count_ = (std::max)(count, size_t(1));
+  pin_listener_cpus_ = pin_cpus;
+}
+
 inline void Server::set_read_timeout(time_t sec, time_t usec) {
   read_timeout_sec_ = sec;
   read_timeout_usec_ = usec;
@@ -3873,6 +4304,10 @@ inline void Server::set_payload_max_length(size_t length) {
   payload_max_length_ = length;
 }
 
+inline void Server::set_sendfile_min_size(size_t size) {
+  sendfile_min_size_ = size;
+}
+
 inline bool Server::bind_to_port(const char *host, int port, int socket_flags) {
   if (bind_internal(host, port, socket_flags) < 0) return false;
   return true;
@@ -3895,6 +4330,10 @@ inline void Server::stop() {
     std::atomic<socket_t> sock(svr_sock_.exchange(INVALID_SOCKET));
     detail::shutdown_socket(sock);
     detail::close_socket(sock);
+    // Wakes the other accept threads, which close their sockets on exit
+    for (auto s : reuseport_socks_) {
+      detail::shutdown_socket(s);
+    }
   }
 }
 
@@ -3998,7 +4437,7 @@ inline bool Server::write_response(Stream &strm, bool close_connection,
             res.set_header("Content-Encoding", "br");
           }
         }
-      } else {
+      } else if (res.status != 304) {
         res.set_header("Content-Length", "0");
       }
     }
@@ -4064,6 +4503,18 @@ inline bool Server::write_response(Stream &strm, bool close_connection,
   if (req.method != "HEAD") {
     if (!res.body.empty()) {
       if (!strm.write(res.body)) { ret = false; }
+    } else if (res.file_fd_ != -1 && req.ranges.size() <= 1) {
+      size_t offset = 0;
+      size_t length = res.content_length_;
+      if (req.ranges.size() == 1) {
+        auto offsets =
+            detail::get_range_offset_and_length(req, res.content_length_, 0);
+        offset = offsets.first;
+        length = offsets.second;
+      }
+      if (!detail::write_file_content(strm, res.file_fd_, offset, length)) {
+        ret = false;
+      }
     } else if (res.content_provider_) {
       if (!write_content_with_provider(strm, req, res, boundary,
                                        content_type)) {
@@ -4231,8 +4682,7 @@ inline bool Server::read_content_core(Stream &strm, Request &req, Response &res,
   return true;
 }
 
-inline bool Server::handle_file_request(Request &req, Response &res,
-                                        bool head) {
+inline bool Server::handle_file_request(Request &req, Response &res) {
   for (const auto &kv : base_dirs_) {
     const auto &mount_point = kv.first;
     const auto &base_dir = kv.second;
@@ -4244,15 +4694,66 @@ inline bool Server::handle_file_request(Request &req, Response &res,
         auto path = base_dir + sub_path;
         if (path.back() == '/') { path += "index.html"; }
 
-        if (detail::is_file(path)) {
-          detail::read_file(path, res.body);
+        struct stat st;
+        if (stat(path.c_str(), &st) >= 0 && S_ISREG(st.st_mode)) {
           auto type =
               detail::find_content_type(path, file_extension_and_mimetype_map_);
-          if (type) { res.set_header("Content-Type", type); }
-          res.status = 200;
-          if (!head && file_request_handler_) {
-            file_request_handler_(req, res);
+
+          // The path may be replaced after stat() and the reader may return a
+          // cached buffer, so the validators are taken from the data actually
+          // served: the opened fd, the reader, or the read below
+          size_t size = 0;
+          auto fd = -1;
+          if (st.st_size > 0 &&
+              static_cast<size_t>(st.st_size) >= sendfile_min_size_) {
+            fd = detail::open_file(path, size, &st);
+            if (fd != -1 && size == 0) {
+              detail::close_socket(fd);
+              fd = -1;
+            }
+          }
+
+          std::shared_ptr<const std::string> buf;
+          std::string body;
+          if (fd == -1 && file_reader_) { buf = file_reader_(path, st); }
+          if (fd == -1 && !buf && !detail::read_file(path, body, st)) {
+            continue;
           }
+
+          // A file modified within the current second may change again with
+          // the same Last-Modified, so only the ETag validates it
+          auto etag = detail::make_file_etag(st);
+          auto has_last_modified = st.st_mtime < time(nullptr);
+          res.set_header("ETag", etag);
+          if (has_last_modified) {
+            res.set_header("Last-Modified", detail::make_http_date(st.st_mtime));
+          }
+
+          if (detail::is_not_modified(req, etag, st.st_mtime,
+                                      has_last_modified)) {
+            if (fd != -1) { detail::close_socket(fd); }
+            res.status = 304;
+            if (file_request_handler_) { file_request_handler_(req, res); }
+            return true;
+          }
+
+          if (fd != -1) {
+            // Large files are sent straight from the page cache
+            res.set_file_content(fd, size, type ? type : "text/plain");
+          } else if (buf && !buf->empty()) {
+            // Serve the shared buffer without copying it into the body
+            res.set_content_provider(
+                buf->size(), type ? type : "text/plain",
+                [buf](size_t offset, size_t length, DataSink &sink) {
+                  sink.write(buf->data() + offset, length);
+                  return true;
+                });
+          } else {
+            res.body = std::move(body);
+            if (type) { res.set_header("Content-Type", type); }
+          }
+          res.status = 200;
+          if (file_request_handler_) { file_request_handler_(req, res); }
           return true;
         }
       }
@@ -4280,7 +4781,21 @@ Server::create_server_socket(const char *host, int port, int socket_flags,
 inline int Server::bind_internal(const char *host, int port, int socket_flags) {
   if (!is_valid()) { return -1; }
 
-  svr_sock_ = create_server_socket(host, port, socket_flags, socket_options_);
+  auto socket_options = socket_options_;
+  reuseport_socks_.clear();
+#ifdef SO_REUSEPORT
+  if (listener_count_ > 1) {
+    auto options = socket_options_;
+    socket_options = [options](socket_t sock) {
+      if (options) { options(sock); }
+      int yes = 1;
+      setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<char *>(&yes),
+                 sizeof(yes));
+    };
+  }
+#endif
+
+  svr_sock_ = create_server_socket(host, port, socket_flags, socket_options);
   if (svr_sock_ == INVALID_SOCKET) { return -1; }
 
   if (port == 0) {
@@ -4291,29 +4806,95 @@ inline int Server::bind_internal(const char *host, int port, int socket_flags) {
       return -1;
     }
     if (addr.ss_family == AF_INET) {
-      return ntohs(reinterpret_cast<struct sockaddr_in *>(&addr)->sin_port);
+      port = ntohs(reinterpret_cast<struct sockaddr_in *>(&addr)->sin_port);
     } else if (addr.ss_family == AF_INET6) {
-      return ntohs(reinterpret_cast<struct sockaddr_in6 *>(&addr)->sin6_port);
+      port = ntohs(reinterpret_cast<struct sockaddr_in6 *>(&addr)->sin6_port);
     } else {
       return -1;
     }
-  } else {
-    return port;
   }
+
+#if defined(__linux__) && defined(SO_REUSEPORT)
+  for (size_t i = 1; i < listener_count_; i++) {
+    auto sock = create_server_socket(host, port, socket_flags, socket_options);
+    if (sock == INVALID_SOCKET) {
+      for (auto s : reuseport_socks_) {
+        detail::close_socket(s);
+      }
+      reuseport_socks_.clear();
+      detail::close_socket(svr_sock_.exchange(INVALID_SOCKET));
+      return -1;
+    }
+    reuseport_socks_.push_back(sock);
+  }
+#endif
+
+  return port;
 }
 
 inline bool Server::listen_internal() {
   auto ret = true;
   is_running_ = true;
 
+#ifdef __linux__
+  if (!reuseport_socks_.empty()) {
+    std::vector<socket_t> socks(1, svr_sock_);
+    socks.insert(socks.end(), reuseport_socks_.begin(), reuseport_socks_.end());
+
+    std::atomic<bool> ok(true);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < socks.size(); i++) {
+      auto sock = socks[i];
+      auto count = socks.size();
+      threads.emplace_back([this, i, sock, count, &ok]() {
+        // Threads started by the listener inherit its CPU affinity
+        if (pin_listener_cpus_) { pin_listener(i, count); }
+        if (!accept_loop(sock)) { ok = false; }
+      });
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+
+    for (auto s : reuseport_socks_) {
+      detail::close_socket(s);
+    }
+    ret = ok;
+  } else
+#endif
+  {
+    ret = accept_loop(svr_sock_);
+  }
+
+  is_running_ = false;
+  return ret;
+}
+
+inline bool Server::accept_loop(socket_t svr_sock) {
+  auto ret = true;
+
   {
     std::unique_ptr<TaskQueue> task_queue(new_task_queue());
 
+#ifdef __linux__
+    // Reactor mode, only plain HTTP connections are supported
+    std::unique_ptr<detail::Reactor> reactor;
+    if (reactor_thread_count_ > 0) {
+      reactor.reset(new detail::Reactor(
+          reactor_thread_count_, *task_queue, keep_alive_max_count_,
+          CPPHTTPLIB_KEEPALIVE_TIMEOUT_SECOND * 1000 +
+              CPPHTTPLIB_KEEPALIVE_TIMEOUT_USECOND / 1000,
+          [this](socket_t sock, bool close_connection) {
+            return process_socket_request(sock, close_connection);
+          }));
+    }
+#endif
+
     while (svr_sock_ != INVALID_SOCKET) {
 #ifndef _WIN32
       if (idle_interval_sec_ > 0 || idle_interval_usec_ > 0) {
 #endif
-        auto val = detail::select_read(svr_sock_, idle_interval_sec_,
+        auto val = detail::select_read(svr_sock, idle_interval_sec_,
                                        idle_interval_usec_);
         if (val == 0) { // Timeout
           task_queue->on_idle();
@@ -4322,7 +4903,7 @@ inline bool Server::listen_internal() {
 #ifndef _WIN32
       }
 #endif
-      socket_t sock = accept(svr_sock_, nullptr, nullptr);
+      socket_t sock = accept(svr_sock, nullptr, nullptr);
 
       if (sock == INVALID_SOCKET) {
         if (errno == EMFILE) {
@@ -4332,7 +4913,7 @@ inline bool Server::listen_internal() {
           continue;
         }
         if (svr_sock_ != INVALID_SOCKET) {
-          detail::close_socket(svr_sock_);
+          if (svr_sock == svr_sock_) { detail::close_socket(svr_sock_); }
           ret = false;
         } else {
           ; // The server socket was closed by user.
@@ -4340,6 +4921,13 @@ inline bool Server::listen_internal() {
         break;
       }
 
+#ifdef __linux__
+      if (reactor) {
+        reactor->add(sock);
+        continue;
+      }
+#endif
+
 #if __cplusplus > 201703L
       task_queue->enqueue([=, this]() { process_and_close_socket(sock); });
 #else
@@ -4347,18 +4935,56 @@ inline bool Server::listen_internal() {
 #endif
     }
 
+#ifdef __linux__
+    if (reactor) { reactor->shutdown(); }
+#endif
     task_queue->shutdown();
   }
 
-  is_running_ = false;
   return ret;
 }
 
+#ifdef __linux__
+inline void Server::pin_listener(size_t index, size_t count) {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) { return; }
+
+  std::vector<int> cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowed)) { cpus.push_back(cpu); }
+  }
+  if (cpus.empty()) { return; }
+
+  // A contiguous share of the allowed CPUs, or a single CPU when there are
+  // more listeners than CPUs
+  auto begin = index * cpus.size() / count;
+  auto end = (index + 1) * cpus.size() / count;
+  if (begin == end) {
+    begin = index % cpus.size();
+    end = begin + 1;
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto i = begin; i < end; i++) {
+    CPU_SET(cpus[i], &set);
+  }
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+#else
+inline void Server::pin_listener(size_t, size_t) {}
+#endif
+
 inline bool Server::routing(Request &req, Response &res, Stream &strm) {
+  if (pre_routing_handler_ &&
+      pre_routing_handler_(req, res) == HandlerResponse::Handled) {
+    return true;
+  }
+
   // File handler
-  bool is_head_request = req.method == "HEAD";
-  if ((req.method == "GET" || is_head_request) &&
-      handle_file_request(req, res, is_head_request)) {
+  if ((req.method == "GET" || req.method == "HEAD") &&
+      handle_file_request(req, res)) {
     return true;
   }
 
@@ -4473,6 +5099,7 @@ Server::process_request(Stream &strm, bool close_connection,
   Request req;
   Response res;
 
+  req.start_time = std::chrono::steady_clock::now();
   res.version = "HTTP/1.1";
 
   // Check if the request URI doesn't exceed the limit
@@ -4539,6 +5166,16 @@ Server::process_request(Stream &strm, bool close_connection,
 
 inline bool Server::is_valid() const { return true; }
 
+inline bool Server::process_socket_request(socket_t sock,
+                                           bool close_connection) {
+  detail::SocketStream strm(sock, read_timeout_sec_, read_timeout_usec_,
+                            write_timeout_sec_, write_timeout_usec_);
+  auto connection_closed = false;
+  auto ret =
+      process_request(strm, close_connection, connection_closed, nullptr);
+  return ret && !connection_closed && !close_connection;
+}
+
 inline bool Server::process_and_close_socket(socket_t sock) {
   auto ret = detail::process_server_socket(
       sock, keep_alive_max_count_, read_timeout_sec_, read_timeout_usec_,
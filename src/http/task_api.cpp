@@ -0,0 +1,325 @@
+#include "task_api.h"
+#include "../core/proxytaskmgr.h"
+#include "../utils/json.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+using namespace std;
+using namespace httplib;
+
+// 分页查询单页的默认和最大任务数
+#define TASK_API_PAGE_DEFAULT 100
+#define TASK_API_PAGE_MAX 1000
+
+static void reply(Response &res, int status, const JsonValue &body)
+{
+    res.status = status;
+    res.set_content(body.dump(), "application/json");
+}
+
+static void reply_error(Response &res, int status, const std::string &message)
+{
+    reply(res, status, JsonValue::object().set("error", message));
+}
+
+// 任务的配置和运行状态
+static JsonValue task_to_json(const std::string &dest, IngestTask &task)
+{
+    std::lock_guard<std::mutex> lock(task.mutex);
+    JsonValue v = JsonValue::object();
+    v.set("dest", dest);
+    v.set("src", task.src);
+    v.set("playlist", dest + "/hls.m3u8");
+    v.set("backend", task.backend);
+    v.set("on_demand", task.on_demand);
+    v.set("priority", task.priority);
+    v.set("segment_type", task.segment_type);
+    v.set("state", task.state());
+    v.set("starttime", static_cast<int64_t>(task.starttime));
+    v.set("restarts", task.restarts);
+    v.set("failures", task.failures);
+    v.set("backoff", task.backoff);
+    v.set("stalls", task.stalls);
+
+    // 距最近一个切片的秒数，未在运行或还没有切片时为-1
+    time_t last = task.last_segment;
+    v.set("last_segment_age", task.running && last > 0 ? static_cast<int64_t>(time(nullptr) - last) : -1);
+    return v;
+}
+
+// 从JSON对象读取任务配置
+static bool json_to_task(const JsonValue &v, TaskConfig &task, std::string &errmsg)
+{
+    auto src = v.get("src");
+    auto dest = v.get("dest");
+    if (!src || !src->is_string() || src->as_string().empty() || !dest || !dest->is_string() ||
+        dest->as_string().empty())
+    {
+        errmsg = "src and dest are required strings";
+        return false;
+    }
+    task.src = src->as_string();
+    task.dest = dest->as_string();
+
+    if (!ProxytaskMgr::is_allowed_src(task.src))
+    {
+        errmsg = "src scheme must be rtmp, rtmps, rtsp, http or https";
+        return false;
+    }
+
+    // 目标路径用作输出目录，只允许/app/stream形式
+    if (task.dest[0] != '/' || task.dest.find("..") != std::string::npos || task.dest.back() == '/')
+    {
+        errmsg = "invalid dest " + task.dest;
+        return false;
+    }
+
+    if (auto backend = v.get("backend"))
+    {
+        if (!backend->is_string() || (backend->as_string() != "ffmpeg" && backend->as_string() != "native"))
+        {
+            errmsg = "backend must be ffmpeg or native";
+            return false;
+        }
+        task.opts.backend = backend->as_string();
+    }
+    if (auto on_demand = v.get("on_demand"))
+    {
+        if (!on_demand->is_bool())
+        {
+            errmsg = "on_demand must be a boolean";
+            return false;
+        }
+        task.opts.on_demand = on_demand->as_bool() ? 1 : 0;
+    }
+    if (auto priority = v.get("priority"))
+    {
+        // 转换前检查，超出int范围的浮点数转换为int是未定义行为
+        if (!priority->is_number() || priority->as_number() != std::floor(priority->as_number()) ||
+            priority->as_number() < INT_MIN || priority->as_number() > INT_MAX)
+        {
+            errmsg = "priority must be an integer";
+            return false;
+        }
+        task.opts.priority = priority->as_int();
+    }
+    if (auto segment_type = v.get("segment_type"))
+    {
+        if (!segment_type->is_string() || (segment_type->as_string() != "ts" && segment_type->as_string() != "fmp4"))
+        {
+            errmsg = "segment_type must be ts or fmp4";
+            return false;
+        }
+        task.opts.segment_type = segment_type->as_string();
+    }
+    return true;
+}
+
+static bool parse_body(const Request &req, Response &res, JsonValue &body)
+{
+    std::string errmsg;
+    if (!JsonValue::parse(req.body, body, errmsg))
+    {
+        reply_error(res, 400, "invalid json: " + errmsg);
+        return false;
+    }
+    if (!body.is_object())
+    {
+        reply_error(res, 400, "request body must be an object");
+        return false;
+    }
+    return true;
+}
+
+static size_t param_to_size(const Request &req, const char *key, size_t def)
+{
+    if (!req.has_param(key))
+        return def;
+    long long v = atoll(req.get_param_value(key).c_str());
+    return v < 0 ? def : static_cast<size_t>(v);
+}
+
+// 按目标路径排序分页列出任务
+static void list_tasks(const Request &req, Response &res)
+{
+    size_t offset = param_to_size(req, "offset", 0);
+    size_t limit = std::min<size_t>(param_to_size(req, "limit", TASK_API_PAGE_DEFAULT), TASK_API_PAGE_MAX);
+
+    auto entries = ProxytaskMgr::getinstance().get_task_entries();
+    size_t begin = std::min(offset, entries.size());
+    size_t end = std::min(begin + limit, entries.size());
+
+    // 只需要排出当前页
+    auto cmp = [](const std::pair<std::string, ProxytaskMgr::TaskPtr> &a,
+                  const std::pair<std::string, ProxytaskMgr::TaskPtr> &b) { return a.first < b.first; };
+    std::nth_element(entries.begin(), entries.begin() + begin, entries.end(), cmp);
+    std::partial_sort(entries.begin() + begin, entries.begin() + end, entries.end(), cmp);
+
+    JsonValue tasks = JsonValue::array();
+    for (size_t i = begin; i < end; i++)
+        tasks.push(task_to_json(entries[i].first, *entries[i].second));
+
+    JsonValue body = JsonValue::object();
+    body.set("total", entries.size());
+    body.set("offset", offset);
+    body.set("limit", limit);
+    body.set("tasks", tasks);
+    reply(res, 200, body);
+}
+
+static void get_task(const Request &req, Response &res)
+{
+    std::string dest = req.matches[1];
+    auto task = ProxytaskMgr::getinstance().find_task(dest);
+    if (!task)
+    {
+        reply_error(res, 404, "dest not found. " + dest);
+        return;
+    }
+    reply(res, 200, task_to_json(dest, *task));
+}
+
+static void create_task(const Request &req, Response &res)
+{
+    JsonValue body;
+    if (!parse_body(req, res, body))
+        return;
+
+    TaskConfig conf;
+    std::string errmsg;
+    if (!json_to_task(body, conf, errmsg))
+    {
+        reply_error(res, 400, errmsg);
+        return;
+    }
+
+    auto &mgr = ProxytaskMgr::getinstance();
+    if (mgr.add_task(conf.src, conf.dest, conf.opts) != 0)
+    {
+        reply_error(res, 409, mgr.get_errmsg());
+        return;
+    }
+
+    auto task = mgr.find_task(conf.dest);
+    if (!task)
+    {
+        // 刚添加就被其他请求删除
+        reply_error(res, 404, "dest not found. " + conf.dest);
+        return;
+    }
+    reply(res, 201, task_to_json(conf.dest, *task));
+}
+
+static void delete_task(const Request &req, Response &res)
+{
+    std::string dest = req.matches[1];
+    auto &mgr = ProxytaskMgr::getinstance();
+    if (mgr.del_task(dest) != 0)
+    {
+        reply_error(res, 404, mgr.get_errmsg());
+        return;
+    }
+    reply(res, 200, JsonValue::object().set("dest", dest));
+}
+
+// 批量删除和添加，全部成功或全部不生效
+static void batch_tasks(const Request &req, Response &res)
+{
+    JsonValue body;
+    if (!parse_body(req, res, body))
+        return;
+
+    std::vector<std::string> dels;
+    if (auto del = body.get("delete"))
+    {
+        if (!del->is_array())
+        {
+            reply_error(res, 400, "delete must be an array of dest");
+            return;
+        }
+        for (auto &item : del->as_array())
+        {
+            if (!item.is_string() || item.as_string().empty())
+            {
+                reply_error(res, 400, "delete must be an array of dest");
+                return;
+            }
+            dels.push_back(item.as_string());
+        }
+    }
+
+    std::vector<TaskConfig> adds;
+    if (auto add = body.get("add"))
+    {
+        if (!add->is_array())
+        {
+            reply_error(res, 400, "add must be an array of task");
+            return;
+        }
+        for (size_t i = 0; i < add->as_array().size(); i++)
+        {
+            TaskConfig conf;
+            std::string errmsg;
+            if (!json_to_task(add->as_array()[i], conf, errmsg))
+            {
+                reply_error(res, 400, "add[" + std::to_string(i) + "]: " + errmsg);
+                return;
+            }
+            adds.push_back(conf);
+        }
+    }
+
+    auto &mgr = ProxytaskMgr::getinstance();
+    if (mgr.apply_batch(adds, dels) != 0)
+    {
+        reply_error(res, 409, mgr.get_errmsg());
+        return;
+    }
+
+    JsonValue result = JsonValue::object();
+    result.set("added", adds.size());
+    result.set("deleted", dels.size());
+    reply(res, 200, result);
+}
+
+// 比较令牌，耗时与第一个不同字符的位置无关
+static bool token_equals(const std::string &a, const std::string &b)
+{
+    if (a.size() != b.size())
+        return false;
+    unsigned char diff = 0;
+    for (size_t i = 0; i < a.size(); i++)
+        diff |= static_cast<unsigned char>(a[i] ^ b[i]);
+    return diff == 0;
+}
+
+// 令牌不为空时检查请求头Authorization: Bearer <token>或X-API-Token: <token>
+static Server::Handler authorized(const std::string &token, Server::Handler handler)
+{
+    if (token.empty())
+        return handler;
+
+    return [token, handler](const Request &req, Response &res)
+    {
+        auto auth = req.get_header_value("Authorization");
+        auto given = auth.compare(0, 7, "Bearer ") ? req.get_header_value("X-API-Token") : auth.substr(7);
+        if (!token_equals(given, token))
+        {
+            res.set_header("WWW-Authenticate", "Bearer");
+            reply_error(res, 401, "unauthorized");
+            return;
+        }
+        handler(req, res);
+    };
+}
+
+void TaskApi::mount(httplib::Server &svr, const std::string &token)
+{
+    svr.Get("/api/tasks", authorized(token, list_tasks));
+    svr.Post("/api/tasks", authorized(token, create_task));
+    svr.Post("/api/tasks/batch", authorized(token, batch_tasks));
+    svr.Get(R"(/api/tasks(/.+))", authorized(token, get_task));
+    svr.Delete(R"(/api/tasks(/.+))", authorized(token, delete_task));
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "httplib.h"
+
+/**
+ * @brief 任务管理HTTP接口，请求和响应均为JSON
+ *
+ * GET    /api/tasks?offset=0&limit=100  按目标路径排序分页列出任务
+ * GET    /api/tasks/{dest}              查询单个任务，例如/api/tasks/live/my
+ * POST   /api/tasks                     添加任务：{"src":"rtmp://...","dest":"/live/my","backend":"native",
+ *                                        "on_demand":false,"priority":0}，src和dest之外的字段可选
+ * DELETE /api/tasks/{dest}              删除任务
+ * POST   /api/tasks/batch               批量操作：{"delete":["/live/a"],"add":[{...}]}，
+ *                                        所有操作在一个事务中生效，任何一项冲突时都不生效
+ *
+ * 失败时返回{"error":"..."}，状态码400表示请求格式错误，401表示令牌错误，404表示任务不存在，409表示目标路径冲突。
+ * 源地址只允许rtmp、rtmps、rtsp、http和https协议。
+ */
+class TaskApi
+{
+  public:
+    /**
+     * @brief 在HTTP服务上注册接口
+     * @param token 访问令牌，请求需带Authorization: Bearer <token>或X-API-Token头，为空时不检查
+     */
+    static void mount(httplib::Server &svr, const std::string &token);
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+
+/**
+ * @brief 限制同时在HTTP工作线程中阻塞等待的请求数
+ *
+ * 按需启动等待首个播放列表、LL-HLS阻塞式播放列表更新和预加载分片都在工作线程中等待，
+ * 每个等待占用一个工作线程。等待数达到上限时不再等待，由调用方返回503和Retry-After，
+ * 播放器稍后重试，剩余的工作线程留给普通的播放列表和切片请求。
+ */
+class WaitLimiter
+{
+  private:
+    WaitLimiter() {}
+
+    std::atomic<size_t> m_waiting{0};  // 当前等待的请求数
+    std::atomic<size_t> m_capacity{4}; // 上限
+
+  public:
+    static WaitLimiter &getinstance()
+    {
+        static WaitLimiter instance;
+        return instance;
+    }
+
+    // 设置同时等待的请求数上限，至少为1
+    void set_capacity(size_t capacity) { m_capacity = capacity > 0 ? capacity : 1; }
+    size_t capacity() const { return m_capacity; }
+    size_t waiting() const { return m_waiting; }
+
+    /**
+     * @brief 占用一个等待名额
+     * @return 已达到上限时返回false，不占用名额
+     */
+    bool try_acquire()
+    {
+        size_t n = m_waiting.load();
+        do
+        {
+            if (n >= m_capacity)
+                return false;
+        } while (!m_waiting.compare_exchange_weak(n, n + 1));
+        return true;
+    }
+
+    void release() { m_waiting--; }
+
+    // 在作用域内占用等待名额
+    class Slot
+    {
+      private:
+        bool m_acquired;
+
+      public:
+        Slot() : m_acquired(WaitLimiter::getinstance().try_acquire()) {}
+        ~Slot()
+        {
+            if (m_acquired)
+                WaitLimiter::getinstance().release();
+        }
+        Slot(const Slot &) = delete;
+        Slot &operator=(const Slot &) = delete;
+
+        // 是否占用到名额，没有时不能等待
+        bool acquired() const { return m_acquired; }
+    };
+};
@@ -1,9 +1,17 @@
 
+#include "common/app_config.h"
 #include "common/logger.h"
 #include "core/proxytaskmgr.h"
+#include "core/task_reloader.h"
+#include "http/hls_cache.h"
+#include "http/hls_reload.h"
 #include "http/httplib.h"
-#include "utils/csv.hpp"
+#include "http/task_api.h"
+#include "http/wait_limiter.h"
+#include "utils/file_system.hpp"
+#include "utils/metrics.hpp"
 #include "utils/timer.hpp"
+#include <algorithm>
 #include <cstdio>
 #include <iostream>
 
@@ -11,23 +19,35 @@ using namespace httplib;
 using namespace std;
 
 #ifndef WIN32
+#include <pthread.h>
 #include <signal.h>
+#include <thread>
 
-// 信号处理函数，用于处理SIGINT和SIGTERM信号
-void signalDeal(int sig)
+// 信号处理线程，用于处理SIGINT和SIGTERM信号
+// 信号在所有线程中被屏蔽，由该线程同步等待，退出流程可以正常加锁和写日志
+void signalDeal(sigset_t set)
 {
     auto logger = MyLogger::getLogger("main");
-    // 处理Ctrl+C (SIGINT)和终止信号(SIGTERM)
-    if (sig == SIGINT || sig == SIGTERM)
-    {
+    int sig = 0;
+    if (sigwait(&set, &sig) != 0)
+        return;
+
+    // 处理Ctrl+C (SIGINT)和终止信号(SIGTERM)：所有拉流进程同时退出，超时的强制终止
+    LOG_INFO(logger, "receive signal %d, and stop sub process.", sig);
+    std::thread([set]() {
+        // 退出过程中再次收到信号时立即强制终止
+        int again = 0;
+        if (sigwait(&set, &again) != 0)
+            return;
         ProxytaskMgr::getinstance().fast_kill();
-        LOG_INFO(logger, "receive signal %d, and kill sub process.", sig);
-        exit(0);
-    }
-    else
-    {
-        LOG_INFO(logger, "receive signal %d. but ignore.", sig);
-    }
+        AsyncLogger::getinstance().stop();
+        _exit(1);
+    }).detach();
+
+    auto timeout = AppConfig::getinstance().get_int("shutdown_timeout", 5);
+    ProxytaskMgr::getinstance().shutdown(timeout * 1000);
+    AsyncLogger::getinstance().stop();
+    exit(0);
 }
 #endif
 
@@ -57,68 +77,161 @@ void check()
 // CSV文件路径常量
 const string CSV_FILE = "tasks.csv";
 
-// 从CSV文件加载任务配置
-map<string, string> load_task_from_csv()
+// 运行参数配置文件路径常量
+const string CONF_FILE = "rtmp2hls.conf";
+
+int main(int argc, const char **argv)
 {
-    map<string, string> taskmap;
-    try
+#ifndef WIN32
+    // 在创建其他线程前屏蔽SIGINT和SIGTERM，新线程继承屏蔽字，信号只由信号处理线程接收
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);  // Ctrl+C
+    sigaddset(&signals, SIGTERM); // 终止信号
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    std::thread(signalDeal, signals).detach();
+#endif
+
+    // 加载运行参数配置，文件不存在时全部使用默认值
+    auto &conf = AppConfig::getinstance();
+    conf.load(CONF_FILE);
+
+    // 异步日志：LOG_*只把参数写入线程本地的无锁缓冲区，由后台线程批量格式化和输出
+    if (conf.get_bool("log_async", false))
     {
-        // 设置CSV格式，去除空格和制表符
-        csv::CSVFormat format;
-        format.trim({' ', '\t'});
+        auto overflow = conf.get_string("log_async_overflow", "drop") == "block" ? AsyncLogger::OVERFLOW_BLOCK
+                                                                                 : AsyncLogger::OVERFLOW_DROP;
+        AsyncLogger::getinstance().start(static_cast<size_t>(conf.get_int("log_async_buffer_kb", 256)) * 1024,
+                                         overflow, conf.get_int("log_async_flush_ms", 10));
+    }
 
-        // 读取CSV文件
-        csv::CSVReader reader(CSV_FILE, format);
-        csv::CSVRow row;
+    // 创建HTTP服务器实例
+    httplib::Server svr;
 
-        // 遍历每一行数据
-        while (reader.read_row(row))
+    // 设置HLS内存缓存，切片和播放列表只从磁盘读取一次；关闭缓存时同一文件的并发请求仍然合并为一次读取
+    auto cache_mb = conf.get_int("hls_cache_max_mb", 256);
+    HlsCache::getinstance().set_capacity(static_cast<size_t>(std::max<long long>(cache_mb, 0)) * 1024 * 1024);
+    svr.set_file_reader(
+        [](const std::string &path, struct stat &st) { return HlsCache::getinstance().get(path, &st); });
+
+    // 大文件通过sendfile从文件直接发送到socket，不经过用户态缓冲区。
+    // sendfile绕过上面的合并读取和内存缓存，默认关闭，使切片也由共享缓冲区发送
+    auto sendfile_min_kb = conf.get_int("http_sendfile_min_kb", -1);
+    if (sendfile_min_kb >= 0)
+    {
+        svr.set_sendfile_min_size(static_cast<size_t>(sendfile_min_kb) * 1024);
+    }
+
+    // 缓存控制：切片文件名不会重复使用，可以长期缓存；播放列表只缓存很短的时间，0表示每次都需要验证
+    // 静态文件都带有ETag和Last-Modified，未变化时返回304
+    auto playlist_max_age = conf.get_int("http_playlist_max_age", 1);
+    auto segment_max_age = conf.get_int("http_segment_max_age", 86400);
+    svr.set_file_request_handler(
+        [playlist_max_age, segment_max_age](const Request &req, Response &res)
         {
-            if (!row["dest"].is_null() && !row["src"].is_null())
+            auto ends_with = [&req](const char *suffix, size_t n)
+            { return req.path.size() >= n && !req.path.compare(req.path.size() - n, n, suffix); };
+
+            if (ends_with(".m3u8", 5))
             {
-                auto dest = row["dest"].get();
-                auto src = row["src"].get();
-                taskmap[src] = dest;
+                res.set_header("Cache-Control", playlist_max_age > 0
+                                                    ? "public, max-age=" + std::to_string(playlist_max_age)
+                                                    : std::string("no-cache"));
             }
-        }
-    }
-    catch (exception &ex)
-    {
-        auto logger = MyLogger::getLogger("main");
-        LOG_INFO(logger, "exception:%s", ex.what());
-    }
-    return taskmap;
-}
+            else if (ends_with(".ts", 3) || ends_with(".m4s", 4))
+            {
+                res.set_header("Cache-Control", "public, max-age=" + std::to_string(segment_max_age) + ", immutable");
+            }
+            else if (ends_with(".mp4", 4))
+            {
+                // fMP4初始化段init.mp4在任务重启后会以相同的文件名重写，每次都需要验证
+                res.set_header("Cache-Control", "no-cache");
+            }
+        });
 
-int main(int argc, const char **argv)
-{
-#ifndef WIN32
-    // 注册信号处理函数
-    signal(SIGINT, signalDeal);  // 注册SIGINT信号处理
-    signal(SIGTERM, signalDeal); // 注册SIGTERM信号处理
-#endif
+    // 按需启动：首次请求播放列表时启动对应任务，并等待播放列表生成
+    // LL-HLS：带_HLS_msn/_HLS_part的播放列表请求等待播放列表更新，预加载提示的分片请求等待分片生成
+    svr.set_pre_routing_handler(
+        [](const Request &req, Response &res)
+        {
+            if (!ProxytaskMgr::getinstance().on_http_request(req.path))
+            {
+                res.status = 503;
+                res.set_header("Retry-After", "1");
+                return Server::HandlerResponse::Handled;
+            }
+            return HlsReload::getinstance().on_request(req, res);
+        });
 
-    // 创建HTTP服务器实例
-    httplib::Server svr;
+    // 任务管理接口，运行时添加和删除任务，与HLS共用端口，默认关闭
+    if (conf.get_bool("http_api", false))
+    {
+        auto token = conf.get_string("http_api_token", "");
+        if (token.empty())
+        {
+            auto logger = MyLogger::getLogger("main");
+            LOG_WARN(logger, "http api enabled without http_api_token, anyone reaching the port can manage tasks.");
+        }
+        TaskApi::mount(svr, token);
+    }
 
     // 设置错误处理器
     svr.set_error_handler(
         [](const Request & /*req*/, Response &res)
         {
+            // 接口已经返回了错误内容时不覆盖
+            if (!res.body.empty())
+            {
+                return;
+            }
             const char *fmt = "<p>Error Status: <span style='color:red;'>%d</span></p>";
             char buf[BUFSIZ];
             snprintf(buf, sizeof(buf), fmt, res.status);
             res.set_content(buf, "text/html");
         });
 
-    // 设置日志处理器
+    // 设置日志处理器，响应发送完后记录请求日志和指标
     svr.set_logger(
         [](const Request &req, const Response &res)
         {
-            auto logger = MyLogger::getLogger("http");
+            static auto logger = MyLogger::getLogger("http");
             LOG_INFO(logger, log(req, res));
+
+            auto latency = std::chrono::steady_clock::now() - req.start_time;
+            auto bytes = req.method == "HEAD" ? 0 : res.get_header_value<uint64_t>("Content-Length");
+            ProxytaskMgr::getinstance().on_http_response(
+                req.path, res.status, bytes, std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
         });
 
+    // Prometheus指标，输出时不占用请求处理路径上的锁
+    if (conf.get_bool("http_metrics", true))
+    {
+        svr.Get("/metrics",
+                [](const Request & /*req*/, Response &res)
+                { res.set_content(Metrics::getinstance().render(), "text/plain; version=0.0.4"); });
+    }
+
+    // 设置epoll事件循环线程数，空闲的keep-alive连接不再占用工作线程，0表示每连接一个线程
+    svr.set_reactor_thread_count(static_cast<size_t>(conf.get_int("http_reactor_threads", 0)));
+    svr.set_keep_alive_max_count(static_cast<size_t>(conf.get_int("http_keep_alive_max_count", 5)));
+
+    // 多个SO_REUSEPORT监听套接字，由内核把连接分散到各个监听，每个监听有独立的accept线程、工作线程池和事件循环
+    auto listeners = conf.get_int("http_listeners", 1);
+    if (listeners > 1)
+        svr.set_listener_count(static_cast<size_t>(listeners), conf.get_bool("http_listener_pin_cpus", true));
+    // 每个监听的工作线程数，0表示使用默认值
+    auto worker_threads = conf.get_int("http_worker_threads", 0);
+    if (worker_threads > 0)
+        svr.new_task_queue = [worker_threads]() { return new ThreadPool(static_cast<size_t>(worker_threads)); };
+    // 同时在工作线程中阻塞等待的请求数上限，超过时返回503，0表示工作线程总数的一半
+    auto max_waiting = conf.get_int("http_max_waiting_requests", 0);
+    if (max_waiting <= 0)
+    {
+        auto threads = worker_threads > 0 ? worker_threads : static_cast<long long>(CPPHTTPLIB_THREAD_POOL_COUNT);
+        max_waiting = threads * (listeners > 1 ? listeners : 1) / 2;
+    }
+    WaitLimiter::getinstance().set_capacity(static_cast<size_t>(max_waiting));
+
     // 设置服务器端口，默认8086
     auto port = 8086;
     if (argc > 1)
@@ -134,9 +247,8 @@ int main(int argc, const char **argv)
     }
 
     // 创建必要的目录
-    string cmd = "mkdir  -p " + string(base_dir);
-    system(cmd.c_str());
-    system("mkdir -p logs");
+    FileSystem::getinstance().mkdirs(base_dir);
+    FileSystem::getinstance().mkdirs("logs");
 
     // 设置静态文件挂载点
     if (!svr.set_mount_point("/", base_dir))
@@ -144,16 +256,19 @@ int main(int argc, const char **argv)
         cout << "The specified base directory doesn't exist...";
         return 1;
     }
+    // 需在监听任务目录之前注册目录变化的监听
+    HlsReload::getinstance().set_base_dir(base_dir);
 
-    // 从CSV文件加载任务并添加到任务管理器
-    map<string, string> taskmap = load_task_from_csv();
-    for (auto item : taskmap)
+    // 启动内置RTMP推流服务
+    if (ProxytaskMgr::getinstance().init() != 0)
     {
-        auto src = item.first;
-        auto dest = item.second;
-        ProxytaskMgr::getinstance().add_task(src, dest);
+        auto logger = MyLogger::getLogger("main");
+        LOG_ERROR(logger, "%s", ProxytaskMgr::getinstance().get_errmsg().c_str());
     }
 
+    // 从CSV文件加载任务并添加到任务管理器，由启动调度器按优先级分批启动，之后文件变化时只应用变化的任务
+    TaskReloader::getinstance().start(CSV_FILE, conf.get_bool("tasks_hot_reload", true));
+
     // 启动定时器，定期检查任务状态
     Timer m_timer;
     m_timer.StartTimer(1000, std::bind(check));
@@ -163,5 +278,6 @@ int main(int argc, const char **argv)
     LOG_INFO(logger, "The server started at port %d", port);
     svr.listen("0.0.0.0", port);
 
+    AsyncLogger::getinstance().stop();
     return 0;
 }
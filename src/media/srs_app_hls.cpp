@@ -0,0 +1,477 @@
+#include "srs_app_hls.hpp"
+#include "../common/logger.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+using namespace std;
+
+// 每个音频PES合并的帧数，减少PES头和TS填充的开销
+#define SRS_HLS_AUDIO_FRAMES_PER_PES 8
+// 收到音频后等待视频序列头的时长，超过后按纯音频流切片
+#define SRS_HLS_AUDIO_ONLY_WAIT (3 * 90000)
+// 单个切片的大小上限，长时间没有关键帧时丢弃当前切片
+#define SRS_HLS_MAX_SEGMENT_SIZE (64 * 1024 * 1024)
+// 移出播放列表后保留的切片数，正在下载的播放器仍然可以读到
+#define SRS_HLS_DELETE_DELAY 2
+// LL-HLS播放列表中列出分片的已完成切片数，更早的切片只列出完整切片
+#define SRS_HLS_PART_SEGMENTS 3
+
+static bool ends_with(const std::string &s, const std::string &suffix)
+{
+    return s.size() >= suffix.size() && !s.compare(s.size() - suffix.size(), suffix.size(), suffix);
+}
+
+srs_error_t srs_write_file_atomic(const std::string &path, const std::string &data)
+{
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return ERROR_HLS_OPEN_FAILED;
+
+    size_t offset = 0;
+    while (offset < data.size())
+    {
+        ssize_t n = ::write(fd, data.data() + offset, data.size() - offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            ::close(fd);
+            ::unlink(tmp.c_str());
+            return ERROR_HLS_WRITE_FAILED;
+        }
+        offset += static_cast<size_t>(n);
+    }
+    ::close(fd);
+
+    if (::rename(tmp.c_str(), path.c_str()) < 0)
+    {
+        ::unlink(tmp.c_str());
+        return ERROR_SYSTEM_FILE_RENAME;
+    }
+    return srs_success;
+}
+
+SrsHlsMuxer::SrsHlsMuxer() : m_hls_time(2 * 90000), m_list_size(5), m_part_time(0), m_fmp4(false)
+{
+}
+
+SrsHlsMuxer::~SrsHlsMuxer()
+{
+}
+
+srs_error_t SrsHlsMuxer::initialize(const std::string &m3u8, double hls_time, int list_size, double part_time,
+                                    bool fmp4)
+{
+    auto pos = m3u8.rfind('/');
+    m_dir = pos == std::string::npos ? "." : m3u8.substr(0, pos);
+    m_playlist = pos == std::string::npos ? m3u8 : m3u8.substr(pos + 1);
+    m_hls_time = static_cast<int64_t>((hls_time > 0 ? hls_time : 2) * 90000);
+    m_list_size = list_size > 0 ? list_size : 5;
+    // 分片不能比切片长
+    m_part_time = part_time > 0 ? std::min(static_cast<int64_t>(part_time * 90000), m_hls_time) : 0;
+    m_frame_dts = -1;
+    m_frame_interval = 0;
+    m_fmp4 = fmp4;
+    m_format.set_mp4(fmp4);
+
+    // 切片序号从当前时间开始，重启后不会与旧切片重名，播放器和HTTP缓存不会拿到过期内容
+    m_seq = static_cast<uint64_t>(time(0));
+
+    // 清理上次运行遗留的切片，先删除引用它们的播放列表，播放器不会拿到指向已删除切片的列表
+    ::unlink((m_dir + "/" + m_playlist).c_str());
+    DIR *dir = opendir(m_dir.c_str());
+    if (!dir)
+        return ERROR_HLS_OPEN_FAILED;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        std::string name = entry->d_name;
+        if (ends_with(name, ".ts") || ends_with(name, ".m4s") || ends_with(name, ".mp4") || ends_with(name, ".tmp"))
+            ::unlink((m_dir + "/" + name).c_str());
+    }
+    closedir(dir);
+    return srs_success;
+}
+
+srs_error_t SrsHlsMuxer::on_audio(uint32_t timestamp, const std::string &payload)
+{
+    srs_error_t err = srs_success;
+
+    SrsMediaFrame frame;
+    bool got = false;
+    if ((err = m_format.on_audio(timestamp, payload, frame, got)) != srs_success || !got)
+        return err;
+
+    return on_frame(frame);
+}
+
+srs_error_t SrsHlsMuxer::on_video(uint32_t timestamp, const std::string &payload)
+{
+    srs_error_t err = srs_success;
+
+    SrsMediaFrame frame;
+    bool got = false;
+    if ((err = m_format.on_video(timestamp, payload, frame, got)) != srs_success || !got)
+        return err;
+
+    return on_frame(frame);
+}
+
+srs_error_t SrsHlsMuxer::on_frame(SrsMediaFrame &frame)
+{
+    srs_error_t err = srs_success;
+
+    if (frame.is_video)
+    {
+        if (!m_segment_open)
+        {
+            // 切片必须从关键帧开始
+            if (!frame.keyframe || (err = open_segment(frame.dts)) != srs_success)
+                return err;
+        }
+        else if (frame.keyframe && (!m_segment_video || frame.dts - m_segment_start >= m_hls_time))
+        {
+            if ((err = close_segment(frame.dts)) != srs_success || (err = open_segment(frame.dts)) != srs_success)
+                return err;
+        }
+        else if (m_segment.size() + m_samples_size > SRS_HLS_MAX_SEGMENT_SIZE)
+        {
+            // 关键帧间隔异常，丢弃当前切片等待下一个关键帧
+            auto logger = MyLogger::getLogger("hls");
+            LOG_WARN(logger, "segment too large without keyframe, drop it. dir:%s", m_dir.c_str());
+            for (auto &part : m_parts)
+                ::unlink((m_dir + "/" + part.name).c_str());
+            m_parts.clear();
+            m_segment.clear();
+            m_samples.clear();
+            m_samples_size = 0;
+            m_segment_open = false;
+            m_audio_frames = 0;
+
+            // 播放列表不再引用已删除的分片，下一个切片与之前的切片不连续
+            m_discontinuity = true;
+            return write_playlist();
+        }
+        else if (part_due(frame.dts))
+        {
+            if ((err = close_part(frame.dts)) != srs_success || (err = write_playlist()) != srs_success)
+                return err;
+        }
+
+        if (!m_part_video)
+        {
+            m_part_video = true;
+            m_part_independent = frame.keyframe;
+        }
+        if (m_frame_dts >= 0 && frame.dts > m_frame_dts)
+            m_frame_interval = frame.dts - m_frame_dts;
+        m_frame_dts = frame.dts;
+
+        write_frame(frame);
+        m_last_dts = frame.dts;
+        return err;
+    }
+
+    if (!m_segment_open)
+    {
+        // 有视频时等待关键帧开始切片
+        if (m_format.has_video())
+            return err;
+
+        if (m_audio_wait_start < 0)
+            m_audio_wait_start = frame.dts;
+        if (frame.dts - m_audio_wait_start < SRS_HLS_AUDIO_ONLY_WAIT)
+            return err;
+        if ((err = open_segment(frame.dts)) != srs_success)
+            return err;
+    }
+    else if (!m_format.has_video() && frame.dts - m_segment_start >= m_hls_time)
+    {
+        if ((err = close_segment(frame.dts)) != srs_success || (err = open_segment(frame.dts)) != srs_success)
+            return err;
+    }
+    else if (!m_format.has_video() && part_due(frame.dts))
+    {
+        if ((err = close_part(frame.dts)) != srs_success || (err = write_playlist()) != srs_success)
+            return err;
+    }
+
+    // 纯音频流按音频帧切分分片
+    if (!m_format.has_video())
+    {
+        if (m_frame_dts >= 0 && frame.dts > m_frame_dts)
+            m_frame_interval = frame.dts - m_frame_dts;
+        m_frame_dts = frame.dts;
+    }
+
+    m_last_dts = std::max(m_last_dts, frame.dts);
+    if (m_fmp4)
+    {
+        write_frame(frame);
+        return err;
+    }
+
+    if (m_audio_frames == 0)
+        m_audio = frame;
+    else
+        m_audio.data.append(frame.data);
+
+    if (++m_audio_frames >= SRS_HLS_AUDIO_FRAMES_PER_PES)
+        flush_audio();
+    return err;
+}
+
+void SrsHlsMuxer::flush_audio()
+{
+    if (m_audio_frames == 0)
+        return;
+
+    // 纯音频流的PMT以音频PID作为PCR_PID，由音频PES携带PCR
+    m_ts.write_frame(m_segment, m_audio, !m_segment_video);
+    m_audio_frames = 0;
+    m_audio.data.clear();
+}
+
+// TS直接写入当前切片；fMP4先缓存，切分分片或切片时写成一个分段
+void SrsHlsMuxer::write_frame(const SrsMediaFrame &frame)
+{
+    if (!m_fmp4)
+    {
+        m_ts.write_frame(m_segment, frame, frame.is_video);
+        return;
+    }
+
+    // 初始化段中没有的轨道，等下一个切片
+    if (frame.is_video ? !m_segment_video : !m_segment_audio)
+        return;
+    m_samples.push_back(frame);
+    m_samples_size += frame.data.size();
+}
+
+void SrsHlsMuxer::flush_samples(int64_t end_dts)
+{
+    if (m_samples.empty())
+        return;
+
+    m_mp4.write_fragment(m_segment, m_samples, end_dts);
+    m_samples.clear();
+    m_samples_size = 0;
+}
+
+srs_error_t SrsHlsMuxer::open_segment(int64_t dts)
+{
+    srs_error_t err = srs_success;
+
+    m_segment.clear();
+    m_segment_video = m_format.has_video();
+    m_segment_audio = m_format.has_audio();
+    if (!m_fmp4)
+    {
+        m_ts.write_pat_pmt(m_segment, m_segment_video, m_segment_audio);
+    }
+    else
+    {
+        // 解码参数变化时写入新的初始化段，播放列表中较早的切片仍然引用原来的初始化段
+        std::string init;
+        m_mp4.write_init(init, m_format, m_segment_video, m_segment_audio);
+        if (init != m_init)
+        {
+            auto name = m_init_name.empty() ? std::string("init.mp4") : "init" + std::to_string(m_seq) + ".mp4";
+            if ((err = srs_write_file_atomic(m_dir + "/" + name, init)) != srs_success)
+                return err;
+            m_init.swap(init);
+            m_init_name = name;
+        }
+    }
+    m_segment_start = dts;
+    m_segment_open = true;
+
+    m_parts.clear();
+    m_part_offset = 0;
+    m_part_start = dts;
+    m_part_video = false;
+    m_part_independent = true;
+    return err;
+}
+
+// 再写入一帧就会超过分片时长时，在这一帧之前切分
+bool SrsHlsMuxer::part_due(int64_t dts)
+{
+    return m_part_time > 0 && dts > m_part_start && dts - m_part_start + m_frame_interval > m_part_time;
+}
+
+// 写出当前分片，由调用方更新播放列表
+srs_error_t SrsHlsMuxer::close_part(int64_t end_dts)
+{
+    srs_error_t err = srs_success;
+
+    flush_audio();
+    flush_samples(end_dts);
+
+    Part part;
+    part.duration = end_dts > m_part_start ? (end_dts - m_part_start) / 90000.0 : 0;
+    part.name = "hls" + std::to_string(m_seq) + "." + std::to_string(m_parts.size()) + extension();
+    part.independent = m_part_independent;
+
+    if ((err = srs_write_file_atomic(m_dir + "/" + part.name, m_segment.substr(m_part_offset))) != srs_success)
+        return err;
+
+    m_parts.push_back(part);
+    m_part_offset = m_segment.size();
+    m_part_start = end_dts;
+    m_part_video = false;
+    m_part_independent = true;
+    return err;
+}
+
+void SrsHlsMuxer::remove_files(const Segment &segment)
+{
+    ::unlink((m_dir + "/" + segment.name).c_str());
+    for (auto &part : segment.parts)
+        ::unlink((m_dir + "/" + part.name).c_str());
+}
+
+srs_error_t SrsHlsMuxer::close_segment(int64_t end_dts)
+{
+    srs_error_t err = srs_success;
+
+    flush_audio();
+    flush_samples(end_dts);
+    m_segment_open = false;
+
+    // 切片的最后一个分片
+    if (m_part_time > 0 && m_segment.size() > m_part_offset && (err = close_part(end_dts)) != srs_success)
+        return err;
+
+    Segment segment;
+    segment.parts.swap(m_parts);
+    segment.seq = m_seq++;
+    segment.duration = end_dts > m_segment_start ? (end_dts - m_segment_start) / 90000.0 : 0;
+    segment.name = "hls" + std::to_string(segment.seq) + extension();
+    segment.map = m_init_name;
+    segment.discontinuity = m_discontinuity;
+    m_discontinuity = false;
+
+    if ((err = srs_write_file_atomic(m_dir + "/" + segment.name, m_segment)) != srs_success)
+        return err;
+    m_segment.clear();
+
+    m_segments.push_back(segment);
+    while (m_segments.size() > m_list_size + SRS_HLS_DELETE_DELAY)
+    {
+        remove_files(m_segments.front());
+        if (m_segments.front().discontinuity)
+            m_discontinuity_sequence++;
+        auto map = m_segments.front().map;
+        m_segments.pop_front();
+
+        // 没有切片再引用的旧初始化段
+        if (!map.empty() && map != m_init_name && (m_segments.empty() || m_segments.front().map != map))
+            ::unlink((m_dir + "/" + map).c_str());
+    }
+
+    return write_playlist();
+}
+
+srs_error_t SrsHlsMuxer::write_playlist()
+{
+    size_t first = m_segments.size() > m_list_size ? m_segments.size() - m_list_size : 0;
+
+    // 第一个切片完成前只有分片，目标时长按配置的切片时长
+    double target = m_segments.empty() ? m_hls_time / 90000.0 : 0;
+    for (size_t i = first; i < m_segments.size(); i++)
+        target = std::max(target, m_segments[i].duration);
+    uint64_t sequence = m_segments.empty() ? m_seq : m_segments[first].seq;
+    uint64_t discontinuity_sequence = m_discontinuity_sequence;
+    for (size_t i = 0; i < first; i++)
+        discontinuity_sequence += m_segments[i].discontinuity ? 1 : 0;
+
+    char buf[256];
+    // EXT-X-MAP需要版本6，fMP4按版本7
+    std::string m3u8 = m_fmp4 ? "#EXTM3U\n#EXT-X-VERSION:7\n"
+                              : (m_part_time > 0 ? "#EXTM3U\n#EXT-X-VERSION:6\n" : "#EXTM3U\n#EXT-X-VERSION:3\n");
+    snprintf(buf, sizeof(buf), "#EXT-X-TARGETDURATION:%d\n", static_cast<int>(ceil(target)));
+    m3u8 += buf;
+
+    // 播放器按分片时长的3倍保持与直播点的距离，可以阻塞等待播放列表更新
+    double part_target = m_part_time / 90000.0;
+    if (m_part_time > 0)
+    {
+        snprintf(buf, sizeof(buf), "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=%.3f\n",
+                 part_target * 3);
+        m3u8 += buf;
+        snprintf(buf, sizeof(buf), "#EXT-X-PART-INF:PART-TARGET=%.3f\n", part_target);
+        m3u8 += buf;
+    }
+
+    snprintf(buf, sizeof(buf), "#EXT-X-MEDIA-SEQUENCE:%llu\n", static_cast<unsigned long long>(sequence));
+    m3u8 += buf;
+    if (discontinuity_sequence > 0)
+    {
+        snprintf(buf, sizeof(buf), "#EXT-X-DISCONTINUITY-SEQUENCE:%llu\n",
+                 static_cast<unsigned long long>(discontinuity_sequence));
+        m3u8 += buf;
+    }
+
+    auto append_parts = [&m3u8, &buf](const std::vector<Part> &parts) {
+        for (auto &part : parts)
+        {
+            snprintf(buf, sizeof(buf), "#EXT-X-PART:DURATION=%.3f,URI=\"%s\"%s\n", part.duration, part.name.c_str(),
+                     part.independent ? ",INDEPENDENT=YES" : "");
+            m3u8 += buf;
+        }
+    };
+
+    // 初始化段变化处重新声明，之后的切片使用新的初始化段
+    std::string map;
+    auto append_map = [&m3u8, &map](const std::string &name) {
+        if (name.empty() || name == map)
+            return;
+        m3u8 += "#EXT-X-MAP:URI=\"" + name + "\"\n";
+        map = name;
+    };
+
+    for (size_t i = first; i < m_segments.size(); i++)
+    {
+        if (m_segments[i].discontinuity)
+            m3u8 += "#EXT-X-DISCONTINUITY\n";
+        append_map(m_segments[i].map);
+        if (i + SRS_HLS_PART_SEGMENTS >= m_segments.size())
+            append_parts(m_segments[i].parts);
+        snprintf(buf, sizeof(buf), "#EXTINF:%.3f,\n", m_segments[i].duration);
+        m3u8 += buf;
+        m3u8 += m_segments[i].name + "\n";
+    }
+
+    // 正在生成的切片的分片，以及下一个分片的地址，播放器可以提前请求，由HTTP端等待分片生成
+    if (m_part_time > 0)
+    {
+        // 不连续标签要在切片的第一个分片之前，切片还没有分片时只有预加载提示，不输出标签
+        if (m_discontinuity && !m_parts.empty())
+            m3u8 += "#EXT-X-DISCONTINUITY\n";
+        append_map(m_init_name);
+        append_parts(m_parts);
+        snprintf(buf, sizeof(buf), "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"hls%llu.%d%s\"\n",
+                 static_cast<unsigned long long>(m_seq), static_cast<int>(m_parts.size()), extension());
+        m3u8 += buf;
+    }
+
+    return srs_write_file_atomic(m_dir + "/" + m_playlist, m3u8);
+}
+
+srs_error_t SrsHlsMuxer::flush()
+{
+    if (!m_segment_open)
+        return srs_success;
+    return close_segment(m_last_dts);
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "srs_kernel_codec.hpp"
+#include "srs_kernel_mp4.hpp"
+#include "srs_kernel_ts.hpp"
+
+#include <stdint.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * @class SrsHlsMuxer
+ * @brief 把RTMP音视频消息切片为TS文件并维护m3u8播放列表
+ *
+ * 也可以输出fMP4：初始化段写入init.mp4(解码参数变化时写入新的init<序号>.mp4)，
+ * 切片为hls<序号>.m4s，每个切片(或LL-HLS分片)是一个moof+mdat分段，播放列表用EXT-X-MAP引用初始化段。
+ * 切片在内存中组装，切片完成后一次性写入临时文件再改名，
+ * 播放列表同样先写临时文件再改名，HTTP端不会读到不完整的文件。
+ * 有视频时只在关键帧处切片；纯音频流按时长切片。
+ *
+ * 设置了分片时长时按LL-HLS输出：切片生成过程中每凑够一个分片就写出分片文件
+ * hls<序号>.<分片序号>.ts并更新播放列表(EXT-X-PART和EXT-X-PRELOAD-HINT)，
+ * 播放器不必等整个切片完成。分片在视频帧之前切分，时长不超过分片时长。
+ * 非线程安全，同一个流的消息需要串行调用。
+ */
+class SrsHlsMuxer
+{
+private:
+    // LL-HLS分片
+    struct Part
+    {
+        double duration; // 秒
+        std::string name;
+        bool independent; // 以关键帧开始或为纯音频，可以独立解码
+    };
+
+    struct Segment
+    {
+        uint64_t seq;
+        double duration; // 秒
+        std::string name;
+        std::string map;         // fMP4切片的初始化段文件名
+        std::vector<Part> parts; // 切片包含的分片，未开启LL-HLS时为空
+        bool discontinuity;      // 与前一个切片不连续，之前丢弃过未完成的切片
+    };
+
+    std::string m_dir;      // 输出目录
+    std::string m_playlist; // 播放列表文件名
+    int64_t m_hls_time;     // 目标切片时长(90kHz)
+    size_t m_list_size;     // 播放列表中的切片数
+    int64_t m_part_time;    // LL-HLS分片时长(90kHz)，0表示不输出分片
+    bool m_fmp4;            // 输出fMP4切片
+
+    SrsFormat m_format;
+    SrsTsMuxer m_ts;
+    SrsMp4Muxer m_mp4;
+
+    // fMP4：当前初始化段，以及等待写入分段的帧
+    std::string m_init_name;
+    std::string m_init;
+    std::vector<SrsMediaFrame> m_samples;
+    size_t m_samples_size = 0;
+
+    // 当前切片
+    std::string m_segment;
+    bool m_segment_open = false;
+    bool m_segment_video = false; // 当前切片的PMT(或初始化段)是否包含视频
+    bool m_segment_audio = false; // 当前切片的初始化段是否包含音频，只用于fMP4
+    int64_t m_segment_start = 0;
+    int64_t m_last_dts = 0;
+    uint64_t m_seq = 0;
+
+    // 当前切片中正在生成的分片
+    std::vector<Part> m_parts;      // 当前切片已完成的分片
+    size_t m_part_offset = 0;       // 当前分片在m_segment中的起始位置
+    int64_t m_part_start = 0;
+    bool m_part_video = false;      // 当前分片是否已经有视频帧
+    bool m_part_independent = true; // 当前分片的第一个视频帧是否为关键帧
+    int64_t m_frame_dts = -1;       // 上一个用于切分分片的帧(有视频时为视频帧)的时间戳
+    int64_t m_frame_interval = 0;   // 帧间隔，用于保证分片时长不超过分片时长
+
+    // 等待合并写入的音频帧
+    SrsMediaFrame m_audio;
+    int m_audio_frames = 0;
+
+    // 纯音频判断：收到音频但迟迟没有视频序列头
+    int64_t m_audio_wait_start = -1;
+
+    std::deque<Segment> m_segments; // 已完成的切片，包括等待删除的
+
+    // 丢弃过未完成的切片，下一个切片前插入EXT-X-DISCONTINUITY
+    bool m_discontinuity = false;
+    // 已经移出播放列表的不连续切片数，即EXT-X-DISCONTINUITY-SEQUENCE的基数
+    uint64_t m_discontinuity_sequence = 0;
+
+public:
+    SrsHlsMuxer();
+    ~SrsHlsMuxer();
+
+    /**
+     * @brief 初始化输出参数，清理上次运行遗留的切片
+     * @param m3u8 播放列表路径，例如./html/live/my/hls.m3u8
+     * @param hls_time 目标切片时长(秒)
+     * @param list_size 播放列表中的切片数
+     * @param part_time LL-HLS分片时长(秒)，0表示不输出分片
+     * @param fmp4 输出fMP4切片，否则输出TS切片
+     */
+    srs_error_t initialize(const std::string &m3u8, double hls_time, int list_size, double part_time = 0,
+                           bool fmp4 = false);
+
+    // 处理RTMP音视频消息
+    srs_error_t on_audio(uint32_t timestamp, const std::string &payload);
+    srs_error_t on_video(uint32_t timestamp, const std::string &payload);
+
+    /**
+     * @brief 流结束，写出当前切片
+     */
+    srs_error_t flush();
+
+private:
+    srs_error_t on_frame(SrsMediaFrame &frame);
+    srs_error_t open_segment(int64_t dts);
+    void write_frame(const SrsMediaFrame &frame);
+    void flush_samples(int64_t end_dts);
+    const char *extension() const { return m_fmp4 ? ".m4s" : ".ts"; }
+    srs_error_t close_segment(int64_t end_dts);
+    bool part_due(int64_t dts);
+    srs_error_t close_part(int64_t end_dts);
+    void remove_files(const Segment &segment);
+    void flush_audio();
+    srs_error_t write_playlist();
+};
+
+/**
+ * @brief 原子写文件：写入临时文件后改名
+ */
+srs_error_t srs_write_file_atomic(const std::string &path, const std::string &data);
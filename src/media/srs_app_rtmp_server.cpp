@@ -0,0 +1,484 @@
+#include "srs_app_rtmp_server.hpp"
+#include "../common/logger.h"
+#include "../http/hls_cache.h"
+#include "../utils/file_system.hpp"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// 推流连接超过该时长没有数据则断开(秒)
+#define SRS_RTMP_PUBLISH_TIMEOUT 20
+// 单次事件最多接受的连接数
+#define SRS_RTMP_ACCEPT_QUOTA 64
+// 推流连接使用的输出分块大小
+#define SRS_RTMP_OUT_CHUNK_SIZE 60000
+// HLS输出根目录，与拉流任务一致
+#define SRS_RTMP_HLS_ROOT "./html"
+
+/**
+ * @class SrsRtmpListener
+ * @brief 监听socket，收到连接后交给SrsRtmpServer
+ */
+class SrsRtmpListener : public SrsEpollConn
+{
+private:
+    SrsRtmpServer *m_server;
+
+public:
+    SrsRtmpListener(SrsRtmpServer *server, int fd) : m_server(server) { m_fd = fd; }
+
+protected:
+    virtual uint32_t on_event(uint32_t /*events*/)
+    {
+        for (int i = 0; i < SRS_RTMP_ACCEPT_QUOTA; i++)
+        {
+            struct sockaddr_storage addr;
+            socklen_t len = sizeof(addr);
+            int fd = ::accept4(m_fd, reinterpret_cast<struct sockaddr *>(&addr), &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    auto logger = MyLogger::getLogger("rtmp");
+                    LOG_WARN(logger, "accept failed, errno=%d(%s)", errno, strerror(errno));
+                }
+                break;
+            }
+
+            char ip[INET6_ADDRSTRLEN] = {0};
+            if (addr.ss_family == AF_INET)
+                inet_ntop(AF_INET, &reinterpret_cast<struct sockaddr_in *>(&addr)->sin_addr, ip, sizeof(ip));
+            else if (addr.ss_family == AF_INET6)
+                inet_ntop(AF_INET6, &reinterpret_cast<struct sockaddr_in6 *>(&addr)->sin6_addr, ip, sizeof(ip));
+
+            m_server->on_accept(fd, ip);
+        }
+        return EPOLLIN;
+    }
+};
+
+// 去掉查询参数，例如live?vhost=xxx
+static std::string strip_query(const std::string &s)
+{
+    auto pos = s.find('?');
+    return pos == std::string::npos ? s : s.substr(0, pos);
+}
+
+// 应用名和流名只允许常见字符，防止写出html目录
+static bool is_valid_name(const std::string &s)
+{
+    if (s.empty() || s.find("..") != std::string::npos || s[0] == '/' || s[s.size() - 1] == '/')
+        return false;
+
+    for (char c : s)
+    {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-' && c != '.' && c != '/')
+            return false;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////
+// SrsRtmpPublishSession
+///////////////////////////////////////////////////////
+
+SrsRtmpPublishSession::SrsRtmpPublishSession(SrsRtmpServer *server, int fd, const std::string &ip)
+    : m_server(server), m_ip(ip)
+{
+    m_fd = fd;
+}
+
+SrsRtmpPublishSession::~SrsRtmpPublishSession()
+{
+}
+
+std::string SrsRtmpPublishSession::desc()
+{
+    return "rtmp client " + m_ip + (m_dest.empty() ? "" : " publish " + m_dest);
+}
+
+void SrsRtmpPublishSession::on_close()
+{
+    on_unpublish();
+    m_server->on_close(this);
+}
+
+srs_error_t SrsRtmpPublishSession::on_handshake()
+{
+    if (m_handshake_step == 0)
+    {
+        // C0 + C1
+        if (m_handshake.size() < 1 + RTMP_HANDSHAKE_SIZE)
+            return srs_success;
+        if (m_handshake[0] != 0x03)
+            return ERROR_RTMP_PLAIN_REQUIRED;
+
+        srs_rtmp_make_s0s1s2(m_handshake.data() + 1, m_out);
+        m_handshake.erase(0, 1 + RTMP_HANDSHAKE_SIZE);
+        m_handshake_step = 1;
+    }
+
+    // C2，内容不校验
+    if (m_handshake.size() < RTMP_HANDSHAKE_SIZE)
+        return srs_success;
+
+    if (m_handshake.size() > RTMP_HANDSHAKE_SIZE)
+        m_reader.append(m_handshake.data() + RTMP_HANDSHAKE_SIZE, m_handshake.size() - RTMP_HANDSHAKE_SIZE);
+    std::string().swap(m_handshake);
+    m_handshaked = true;
+    return srs_success;
+}
+
+srs_error_t SrsRtmpPublishSession::on_message(SrsRtmpMessage &msg)
+{
+    srs_error_t err = srs_success;
+
+    switch (msg.type)
+    {
+    case RTMP_MSG_AMF0CommandMessage:
+    case RTMP_MSG_AMF3CommandMessage:
+        return on_command(msg);
+    case RTMP_MSG_AudioMessage:
+    case RTMP_MSG_VideoMessage:
+    {
+        if (!m_publishing)
+            break;
+        err = msg.type == RTMP_MSG_AudioMessage ? m_muxer.on_audio(msg.timestamp, msg.payload)
+                                                : m_muxer.on_video(msg.timestamp, msg.payload);
+        // 单帧解析失败时丢弃该帧，文件写入失败时断开推流
+        if (err == ERROR_HLS_DECODE_ERROR || err == ERROR_HLS_AVC_SAMPLE_SIZE)
+        {
+            auto logger = MyLogger::getLogger("rtmp");
+            LOG_WARN(logger, "drop invalid frame, type:%d, size:%d, err:%d", msg.type,
+                     static_cast<int>(msg.payload.size()), err);
+            err = srs_success;
+        }
+        return err;
+    }
+    case RTMP_MSG_AggregateMessage:
+        return on_aggregate(msg);
+    default:
+        // @setDataFrame等元数据不影响切片
+        break;
+    }
+
+    return err;
+}
+
+srs_error_t SrsRtmpPublishSession::on_command(SrsRtmpMessage &msg)
+{
+    std::vector<SrsAmf0Any> values;
+    if (!srs_rtmp_decode_command(msg, values))
+        return ERROR_RTMP_AMF0_DECODE;
+
+    const std::string &name = values[0].str;
+    double txn = values[1].number;
+
+    if (name == "connect")
+        return on_connect(values);
+
+    if (name == "createStream")
+    {
+        std::vector<SrsAmf0Any> args = {SrsAmf0Any::make_string("_result"), SrsAmf0Any::make_number(txn),
+                                        SrsAmf0Any::make_null(), SrsAmf0Any::make_number(1)};
+        send_message(srs_rtmp_make_command(args), RTMP_CID_OverConnection);
+    }
+    else if (name == "publish")
+    {
+        return on_publish(msg, values);
+    }
+    else if (name == "deleteStream" || name == "closeStream")
+    {
+        on_unpublish();
+    }
+    else if (name == "releaseStream" || name == "FCPublish" || name == "FCUnpublish")
+    {
+        std::vector<SrsAmf0Any> args = {SrsAmf0Any::make_string("_result"), SrsAmf0Any::make_number(txn),
+                                        SrsAmf0Any::make_null()};
+        send_message(srs_rtmp_make_command(args), RTMP_CID_OverConnection);
+    }
+    else if (name == "play")
+    {
+        // 只提供HLS播放
+        send_status(msg.stream_id, "error", "NetStream.Play.Failed", "Play is not supported, use HLS.");
+        return ERROR_RTMP_STREAM_NOT_FOUND;
+    }
+
+    return srs_success;
+}
+
+srs_error_t SrsRtmpPublishSession::on_connect(std::vector<SrsAmf0Any> &values)
+{
+    if (values.size() < 3 || !values[2].is_object())
+        return ERROR_RTMP_REQ_CONNECT;
+
+    m_app = strip_query(values[2].get_string("app"));
+    m_tc_url = values[2].get_string("tcUrl");
+    if (!is_valid_name(m_app))
+        return ERROR_RTMP_REQ_TCURL;
+
+    send_message(srs_rtmp_make_window_ack_size(SRS_CONSTS_RTMP_ACK_WINDOW), RTMP_CID_ProtocolControl);
+    send_message(srs_rtmp_make_set_peer_bandwidth(SRS_CONSTS_RTMP_ACK_WINDOW, 2), RTMP_CID_ProtocolControl);
+    send_message(srs_rtmp_make_set_chunk_size(SRS_RTMP_OUT_CHUNK_SIZE), RTMP_CID_ProtocolControl);
+    m_writer.set_chunk_size(SRS_RTMP_OUT_CHUNK_SIZE);
+
+    auto props = SrsAmf0Any::make_object();
+    props.set("fmsVer", SrsAmf0Any::make_string("FMS/3,5,3,888"));
+    props.set("capabilities", SrsAmf0Any::make_number(127));
+    props.set("mode", SrsAmf0Any::make_number(1));
+
+    auto info = SrsAmf0Any::make_object();
+    info.set("level", SrsAmf0Any::make_string("status"));
+    info.set("code", SrsAmf0Any::make_string("NetConnection.Connect.Success"));
+    info.set("description", SrsAmf0Any::make_string("Connection succeeded."));
+    info.set("objectEncoding", SrsAmf0Any::make_number(0));
+
+    std::vector<SrsAmf0Any> args = {SrsAmf0Any::make_string("_result"), SrsAmf0Any::make_number(values[1].number),
+                                    props, info};
+    send_message(srs_rtmp_make_command(args), RTMP_CID_OverConnection);
+    return srs_success;
+}
+
+srs_error_t SrsRtmpPublishSession::on_publish(SrsRtmpMessage &msg, std::vector<SrsAmf0Any> &values)
+{
+    srs_error_t err = srs_success;
+    auto logger = MyLogger::getLogger("rtmp");
+
+    std::string stream = values.size() > 3 && values[3].is_string() ? strip_query(values[3].str) : "";
+    if (m_publishing || m_app.empty() || !is_valid_name(stream))
+    {
+        send_status(msg.stream_id, "error", "NetStream.Publish.BadName", "Invalid stream name.");
+        return ERROR_RTMP_STREAM_NOT_FOUND;
+    }
+
+    auto dest = "/" + m_app + "/" + stream;
+    if ((err = m_server->acquire(dest, this)) != srs_success)
+    {
+        LOG_WARN(logger, "reject publish %s from %s, err:%d", dest.c_str(), m_ip.c_str(), err);
+        send_status(msg.stream_id, "error", "NetStream.Publish.BadName", "Stream is busy.");
+        return err;
+    }
+    m_dest = dest;
+
+    auto dir = SRS_RTMP_HLS_ROOT + dest;
+    if (!FileSystem::getinstance().mkdirs(dir) || (err = m_muxer.initialize(dir + "/hls.m3u8", m_server->m_hls_time,
+                                                       m_server->m_list_size, m_server->m_part_time,
+                                                       m_server->m_fmp4)) != srs_success)
+    {
+        LOG_WARN(logger, "create hls dir %s failed, errno=%d(%s)", dir.c_str(), errno, strerror(errno));
+        send_status(msg.stream_id, "error", "NetStream.Publish.Failed", "Create HLS output failed.");
+        return err != srs_success ? err : ERROR_SYSTEM_CREATE_DIR;
+    }
+
+    HlsCache::getinstance().watch_dir(dir);
+    m_publishing = true;
+
+    send_status(msg.stream_id, "status", "NetStream.Publish.Start", "Started publishing stream.");
+    LOG_INFO(logger, "publish start. client:%s, tcUrl:%s, dest:%s", m_ip.c_str(), m_tc_url.c_str(), dest.c_str());
+    return err;
+}
+
+void SrsRtmpPublishSession::on_unpublish()
+{
+    if (m_dest.empty())
+        return;
+
+    if (m_publishing)
+    {
+        // 写出最后一个不完整的切片
+        m_muxer.flush();
+        HlsCache::getinstance().unwatch_dir(SRS_RTMP_HLS_ROOT + m_dest);
+        m_publishing = false;
+
+        auto logger = MyLogger::getLogger("rtmp");
+        LOG_INFO(logger, "publish stop. client:%s, dest:%s", m_ip.c_str(), m_dest.c_str());
+    }
+
+    m_server->release(m_dest, this);
+    m_dest.clear();
+}
+
+void SrsRtmpPublishSession::send_status(uint32_t stream_id, const std::string &level, const std::string &code,
+                                        const std::string &description)
+{
+    auto info = SrsAmf0Any::make_object();
+    info.set("level", SrsAmf0Any::make_string(level));
+    info.set("code", SrsAmf0Any::make_string(code));
+    info.set("description", SrsAmf0Any::make_string(description));
+
+    std::vector<SrsAmf0Any> args = {SrsAmf0Any::make_string("onStatus"), SrsAmf0Any::make_number(0),
+                                    SrsAmf0Any::make_null(), info};
+    send_message(srs_rtmp_make_command(args, stream_id), RTMP_CID_OverStream);
+}
+
+///////////////////////////////////////////////////////
+// SrsRtmpServer
+///////////////////////////////////////////////////////
+
+SrsRtmpServer::SrsRtmpServer()
+{
+}
+
+SrsRtmpServer::~SrsRtmpServer()
+{
+    if (m_listener)
+        m_listener->close();
+
+    std::vector<std::shared_ptr<SrsRtmpPublishSession>> sessions;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &item : m_sessions)
+        {
+            auto session = item.second.lock();
+            if (session)
+                sessions.push_back(session);
+        }
+    }
+    for (auto &session : sessions)
+        session->close();
+}
+
+void SrsRtmpServer::set_hls_options(double hls_time, int list_size, double part_time, bool fmp4)
+{
+    m_hls_time = hls_time;
+    m_list_size = list_size;
+    m_part_time = part_time;
+    m_fmp4 = fmp4;
+}
+
+srs_error_t SrsRtmpServer::listen(const std::string &ip, int port)
+{
+    auto logger = MyLogger::getLogger("rtmp");
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1)
+        return ERROR_SYSTEM_IP_INVALID;
+
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return ERROR_SOCKET_CREATE;
+
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    if (::bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0)
+    {
+        LOG_ERROR(logger, "bind rtmp %s:%d failed, errno=%d(%s)", ip.c_str(), port, errno, strerror(errno));
+        ::close(fd);
+        return ERROR_SOCKET_BIND;
+    }
+    if (::listen(fd, 512) < 0)
+    {
+        ::close(fd);
+        return ERROR_SOCKET_LISTEN;
+    }
+
+    m_listener = std::make_shared<SrsRtmpListener>(this, fd);
+    srs_error_t err = SrsTransmuxEngine::getinstance().add(m_listener, EPOLLIN);
+    if (err != srs_success)
+    {
+        m_listener->close();
+        m_listener.reset();
+        return err;
+    }
+
+    LOG_INFO(logger, "rtmp server listen at %s:%d", ip.c_str(), port);
+    return srs_success;
+}
+
+void SrsRtmpServer::on_accept(int fd, const std::string &ip)
+{
+    auto session = std::make_shared<SrsRtmpPublishSession>(this, fd, ip);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_sessions[session.get()] = session;
+    }
+
+    if (SrsTransmuxEngine::getinstance().add(session, EPOLLIN) != srs_success)
+        session->close();
+}
+
+void SrsRtmpServer::on_close(SrsRtmpPublishSession *session)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sessions.erase(session);
+}
+
+srs_error_t SrsRtmpServer::acquire(const std::string &dest, SrsRtmpPublishSession *session)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto iter = m_publishers.find(dest);
+        if (iter != m_publishers.end() && iter->second != session)
+            return ERROR_SYSTEM_STREAM_BUSY;
+
+        m_publishers[dest] = session;
+    }
+
+    // 先登记再检查，添加任务时通过is_publishing检查推流，两边不会同时通过
+    if (m_filter && !m_filter(dest))
+    {
+        release(dest, session);
+        return ERROR_SYSTEM_STREAM_BUSY;
+    }
+    return srs_success;
+}
+
+void SrsRtmpServer::release(const std::string &dest, SrsRtmpPublishSession *session)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto iter = m_publishers.find(dest);
+    if (iter != m_publishers.end() && iter->second == session)
+        m_publishers.erase(iter);
+}
+
+std::vector<std::string> SrsRtmpServer::publishers()
+{
+    std::vector<std::string> dests;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &item : m_publishers)
+        dests.push_back(item.first);
+    return dests;
+}
+
+bool SrsRtmpServer::is_publishing(const std::string &dest)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_publishers.find(dest) != m_publishers.end();
+}
+
+void SrsRtmpServer::cycle()
+{
+    // 先收集再关闭，关闭时会回调on_close
+    std::vector<std::shared_ptr<SrsRtmpPublishSession>> expired;
+    time_t now = time(0);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &item : m_sessions)
+        {
+            auto session = item.second.lock();
+            if (session && now - session->last_active() > SRS_RTMP_PUBLISH_TIMEOUT)
+                expired.push_back(session);
+        }
+    }
+
+    for (auto &session : expired)
+    {
+        auto logger = MyLogger::getLogger("rtmp");
+        LOG_WARN(logger, "rtmp client timeout, close it.");
+        session->close();
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "../common/srs_common.h"
+#include "srs_app_hls.hpp"
+#include "srs_app_transmux.hpp"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class SrsRtmpServer;
+class SrsRtmpListener;
+
+/**
+ * @class SrsRtmpPublishSession
+ * @brief 接收推流并直接切片为HLS
+ *
+ * 推流地址rtmp://host:port/app/stream对应的HLS输出为./html/app/stream/hls.m3u8，
+ * 与拉流任务的目标路径规则一致。
+ */
+class SrsRtmpPublishSession : public SrsRtmpConn
+{
+private:
+    SrsRtmpServer *m_server;
+    std::string m_ip;          // 客户端地址
+    int m_handshake_step = 0;  // 0：等待C0C1，1：等待C2
+    std::string m_app;
+    std::string m_tc_url;
+    std::string m_dest;        // 目标路径，例如/live/my
+    bool m_publishing = false;
+    SrsHlsMuxer m_muxer;
+
+public:
+    SrsRtmpPublishSession(SrsRtmpServer *server, int fd, const std::string &ip);
+    virtual ~SrsRtmpPublishSession();
+
+protected:
+    virtual void on_close();
+    virtual srs_error_t on_handshake();
+    virtual srs_error_t on_message(SrsRtmpMessage &msg);
+    virtual std::string desc();
+
+private:
+    srs_error_t on_command(SrsRtmpMessage &msg);
+    srs_error_t on_connect(std::vector<SrsAmf0Any> &values);
+    srs_error_t on_publish(SrsRtmpMessage &msg, std::vector<SrsAmf0Any> &values);
+    void on_unpublish();
+    void send_status(uint32_t stream_id, const std::string &level, const std::string &code,
+                     const std::string &description);
+};
+
+/**
+ * @class SrsRtmpServer
+ * @brief 内置RTMP推流服务，代替外部的SRS进程
+ *
+ * 监听socket和所有推流连接都挂在SrsTransmuxEngine上，与拉流共享线程。
+ * 同一个目标路径同时只允许一个推流。
+ */
+class SrsRtmpServer
+{
+public:
+    // 返回false时拒绝推流，例如目标路径已被拉流任务占用
+    using PublishFilter = std::function<bool(const std::string &dest)>;
+
+private:
+    std::shared_ptr<SrsRtmpListener> m_listener;
+    PublishFilter m_filter;
+    double m_hls_time = 2;
+    int m_list_size = 5;
+    double m_part_time = 0;
+    bool m_fmp4 = false;
+
+    std::mutex m_mutex; // 保护以下成员
+    std::map<SrsRtmpPublishSession *, std::weak_ptr<SrsRtmpPublishSession>> m_sessions;
+    std::map<std::string, SrsRtmpPublishSession *> m_publishers; // 目标路径到推流连接
+
+public:
+    SrsRtmpServer();
+    ~SrsRtmpServer();
+
+    /**
+     * @brief 开始监听
+     * @param ip 监听地址
+     * @param port 监听端口
+     */
+    srs_error_t listen(const std::string &ip, int port);
+
+    void set_publish_filter(PublishFilter filter) { m_filter = filter; }
+    void set_hls_options(double hls_time, int list_size, double part_time, bool fmp4);
+
+    /**
+     * @brief 定期检查，关闭长时间没有数据的连接
+     */
+    void cycle();
+
+    // 当前推流的目标路径
+    std::vector<std::string> publishers();
+
+    // 目标路径是否正在推流
+    bool is_publishing(const std::string &dest);
+
+private:
+    friend class SrsRtmpListener;
+    friend class SrsRtmpPublishSession;
+
+    void on_accept(int fd, const std::string &ip);
+    void on_close(SrsRtmpPublishSession *session);
+    srs_error_t acquire(const std::string &dest, SrsRtmpPublishSession *session);
+    void release(const std::string &dest, SrsRtmpPublishSession *session);
+};
@@ -0,0 +1,699 @@
+#include "srs_app_transmux.hpp"
+#include "../common/app_config.h"
+#include "../common/logger.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <thread>
+
+using namespace std;
+
+// 超过该时长没有收到数据认为拉流中断(秒)
+#define SRS_NATIVE_RECV_TIMEOUT 10
+// 单次事件处理最多读取的字节数，避免一个流长时间占用工作线程
+#define SRS_NATIVE_READ_QUOTA (1024 * 1024)
+// 客户端缓冲时长(ms)
+#define SRS_NATIVE_BUFFER_LENGTH 3000
+
+///////////////////////////////////////////////////////
+// SrsEpollConn
+///////////////////////////////////////////////////////
+
+SrsEpollConn::~SrsEpollConn()
+{
+    if (!m_closed && m_fd >= 0)
+        ::close(m_fd);
+}
+
+void SrsEpollConn::close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    close_locked();
+}
+
+void SrsEpollConn::close_locked()
+{
+    if (m_closed)
+        return;
+    m_closed = true;
+
+    if (m_fd >= 0)
+    {
+        SrsTransmuxEngine::getinstance().remove(this);
+        ::close(m_fd);
+    }
+    on_close();
+}
+
+void SrsEpollConn::dispatch(uint32_t events)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_closed)
+        return;
+
+    uint32_t next = on_event(events);
+    if (m_closed)
+        return;
+
+    if (next == 0)
+    {
+        close_locked();
+        return;
+    }
+    SrsTransmuxEngine::getinstance().rearm(this, next);
+}
+
+///////////////////////////////////////////////////////
+// SrsTransmuxEngine
+///////////////////////////////////////////////////////
+
+SrsTransmuxEngine::SrsTransmuxEngine()
+{
+    auto logger = MyLogger::getLogger("native");
+
+    auto threads = AppConfig::getinstance().get_int("native_worker_threads", 4);
+    m_pool.reset(new WorkerPool(threads > 0 ? static_cast<size_t>(threads) : 1));
+
+    m_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epfd < 0)
+    {
+        LOG_ERROR(logger, "epoll create failed, errno=%d(%s)", errno, strerror(errno));
+        return;
+    }
+
+    std::thread([this] { run(); }).detach();
+    LOG_INFO(logger, "transmux engine started, workers:%d", static_cast<int>(m_pool->size()));
+}
+
+SrsTransmuxEngine::~SrsTransmuxEngine()
+{
+    m_pool->shutdown();
+}
+
+srs_error_t SrsTransmuxEngine::add(const std::shared_ptr<SrsEpollConn> &conn, uint32_t events)
+{
+    if (m_epfd < 0)
+        return ERROR_ST_SET_EPOLL;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    conn->m_id = ++m_next_id;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events | EPOLLONESHOT;
+    ev.data.u64 = conn->m_id;
+    if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, conn->m_fd, &ev) < 0)
+        return ERROR_ST_SET_EPOLL;
+
+    m_conns[conn->m_id] = conn;
+    return srs_success;
+}
+
+void SrsTransmuxEngine::rearm(SrsEpollConn *conn, uint32_t events)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events | EPOLLONESHOT;
+    ev.data.u64 = conn->m_id;
+    epoll_ctl(m_epfd, EPOLL_CTL_MOD, conn->m_fd, &ev);
+}
+
+void SrsTransmuxEngine::remove(SrsEpollConn *conn)
+{
+    epoll_ctl(m_epfd, EPOLL_CTL_DEL, conn->m_fd, nullptr);
+
+    // 调用者仍持有连接的引用，这里释放不会析构连接
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_conns.erase(conn->m_id);
+}
+
+void SrsTransmuxEngine::submit(std::function<void()> job)
+{
+    m_pool->submit(std::move(job));
+}
+
+void SrsTransmuxEngine::run()
+{
+    struct epoll_event events[64];
+
+    for (;;)
+    {
+        int n = epoll_wait(m_epfd, events, 64, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            auto logger = MyLogger::getLogger("native");
+            LOG_ERROR(logger, "epoll wait failed, errno=%d(%s)", errno, strerror(errno));
+            return;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            std::shared_ptr<SrsEpollConn> conn;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto iter = m_conns.find(events[i].data.u64);
+                if (iter == m_conns.end())
+                    continue;
+                conn = iter->second;
+            }
+
+            uint32_t ev = events[i].events;
+            m_pool->submit([conn, ev] { conn->dispatch(ev); });
+        }
+    }
+}
+
+///////////////////////////////////////////////////////
+// SrsRtmpConn
+///////////////////////////////////////////////////////
+
+SrsRtmpConn::SrsRtmpConn() : m_failed(false), m_last_active(time(0))
+{
+}
+
+SrsRtmpConn::~SrsRtmpConn()
+{
+}
+
+void SrsRtmpConn::fail(const char *reason)
+{
+    auto logger = MyLogger::getLogger("native");
+    LOG_WARN(logger, "%s %s, errno=%d(%s)", desc().c_str(), reason, errno, strerror(errno));
+    m_failed = true;
+}
+
+uint32_t SrsRtmpConn::on_event(uint32_t events)
+{
+    srs_error_t err = srs_success;
+
+    if (events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+    {
+        char buf[64 * 1024];
+        size_t total = 0;
+        while (total < SRS_NATIVE_READ_QUOTA)
+        {
+            ssize_t n = ::recv(m_fd, buf, sizeof(buf), 0);
+            if (n == 0)
+            {
+                errno = 0;
+                fail("closed by peer");
+                return 0;
+            }
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                fail("recv failed");
+                return 0;
+            }
+
+            total += static_cast<size_t>(n);
+            m_in_bytes += static_cast<size_t>(n);
+            m_last_active = time(0);
+
+            if (!m_handshaked)
+            {
+                m_handshake.append(buf, n);
+                err = on_handshake();
+            }
+            else
+            {
+                m_reader.append(buf, n);
+            }
+
+            SrsRtmpMessage msg;
+            bool got = false;
+            while (err == srs_success && m_handshaked && !m_failed &&
+                   (err = m_reader.read_message(msg, got)) == srs_success && got)
+            {
+                bool handled = false;
+                if ((err = on_control_message(msg, handled)) == srs_success && !handled)
+                    err = on_message(msg);
+            }
+
+            if (err != srs_success)
+            {
+                // 尽量把错误状态发给对端
+                flush();
+                errno = 0;
+                fail(("protocol error " + std::to_string(err)).c_str());
+                return 0;
+            }
+            if (m_failed)
+                return 0;
+        }
+
+        // 收到的数据达到确认窗口时回复确认消息
+        if (m_ack_window > 0 && m_in_bytes - m_last_ack >= m_ack_window)
+        {
+            send_message(srs_rtmp_make_acknowledgement(static_cast<uint32_t>(m_in_bytes)), RTMP_CID_ProtocolControl);
+            m_last_ack = m_in_bytes;
+        }
+    }
+
+    if (!flush())
+    {
+        fail("send failed");
+        return 0;
+    }
+
+    return EPOLLIN | (m_out.empty() ? static_cast<uint32_t>(0) : static_cast<uint32_t>(EPOLLOUT));
+}
+
+srs_error_t SrsRtmpConn::on_control_message(SrsRtmpMessage &msg, bool &handled)
+{
+    handled = true;
+
+    switch (msg.type)
+    {
+    case RTMP_MSG_SetChunkSize:
+    {
+        if (msg.payload.size() < 4)
+            return ERROR_RTMP_MESSAGE_DECODE;
+        uint32_t size = srs_rtmp_read_u32(msg.payload.data()) & 0x7fffffff;
+        if (size < 1 || size > 0xffffff)
+            return ERROR_RTMP_CHUNK_SIZE;
+        m_reader.set_chunk_size(size);
+        break;
+    }
+    case RTMP_MSG_WindowAcknowledgementSize:
+        if (msg.payload.size() < 4)
+            return ERROR_RTMP_MESSAGE_DECODE;
+        m_ack_window = srs_rtmp_read_u32(msg.payload.data());
+        break;
+    case RTMP_MSG_UserControlMessage:
+        if (msg.payload.size() >= 6 && srs_rtmp_read_u16(msg.payload.data()) == SrcPCUCPingRequest)
+        {
+            uint32_t data = srs_rtmp_read_u32(msg.payload.data() + 2);
+            send_message(srs_rtmp_make_user_control(SrcPCUCPingResponse, data), RTMP_CID_ProtocolControl);
+        }
+        break;
+    case RTMP_MSG_Acknowledgement:
+    case RTMP_MSG_SetPeerBandwidth:
+    case RTMP_MSG_AbortMessage:
+        break;
+    default:
+        handled = false;
+        break;
+    }
+
+    return srs_success;
+}
+
+bool SrsRtmpConn::flush()
+{
+    while (!m_out.empty())
+    {
+        ssize_t n = ::send(m_fd, m_out.data(), m_out.size(), MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        m_out.erase(0, static_cast<size_t>(n));
+    }
+    return true;
+}
+
+void SrsRtmpConn::send_message(const SrsRtmpMessage &msg, uint32_t csid)
+{
+    m_writer.write(msg, csid, m_out);
+}
+
+srs_error_t SrsRtmpConn::on_aggregate(SrsRtmpMessage &msg)
+{
+    srs_error_t err = srs_success;
+
+    // 聚合消息由多个FLV tag组成：TagType(1) DataSize(3) Timestamp(3) TimestampExtended(1) StreamID(3) Data PreviousTagSize(4)
+    const char *p = msg.payload.data();
+    const char *end = p + msg.payload.size();
+    uint32_t base = 0;
+    bool first = true;
+
+    while (end - p >= 11)
+    {
+        uint8_t type = static_cast<uint8_t>(p[0]) & 0x1f;
+        uint32_t size = srs_rtmp_read_u24(p + 1);
+        uint32_t timestamp = srs_rtmp_read_u24(p + 4) | (static_cast<uint32_t>(static_cast<uint8_t>(p[7])) << 24);
+        if (static_cast<size_t>(end - p) < 11 + size + 4)
+            return ERROR_RTMP_MESSAGE_DECODE;
+
+        // tag的时间戳是相对于第一个tag的
+        if (first)
+        {
+            base = timestamp;
+            first = false;
+        }
+
+        if (type == RTMP_MSG_AudioMessage || type == RTMP_MSG_VideoMessage)
+        {
+            SrsRtmpMessage sub;
+            sub.type = type;
+            sub.timestamp = msg.timestamp + (timestamp - base);
+            sub.stream_id = msg.stream_id;
+            sub.payload.assign(p + 11, size);
+            if ((err = on_message(sub)) != srs_success)
+                return err;
+        }
+        p += 11 + size + 4;
+    }
+
+    return err;
+}
+
+///////////////////////////////////////////////////////
+// SrsRtmpPullSession
+///////////////////////////////////////////////////////
+
+SrsRtmpPullSession::SrsRtmpPullSession()
+{
+}
+
+SrsRtmpPullSession::~SrsRtmpPullSession()
+{
+}
+
+srs_error_t SrsRtmpPullSession::initialize(const std::string &url, const std::string &m3u8, double hls_time,
+                                           int list_size, double part_time, bool fmp4)
+{
+    if (!m_url.parse(url))
+        return ERROR_RTMP_REQ_TCURL;
+
+    m_m3u8 = m3u8;
+    return m_muxer.initialize(m3u8, hls_time, list_size, part_time, fmp4);
+}
+
+std::string SrsRtmpPullSession::desc()
+{
+    return "native ingest " + m_url.tc_url + "/" + m_url.stream;
+}
+
+void SrsRtmpPullSession::start()
+{
+    m_last_active = time(0);
+    auto self = std::static_pointer_cast<SrsRtmpPullSession>(shared_from_this());
+    // 域名解析是阻塞的，放在独立线程中进行，避免一次慢解析拖住共享工作线程上的其他流
+    std::thread([self] { self->resolve(); }).detach();
+}
+
+void SrsRtmpPullSession::resolve()
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *result = nullptr;
+    auto port = std::to_string(m_url.port);
+    std::shared_ptr<struct addrinfo> addr;
+    if (getaddrinfo(m_url.host.c_str(), port.c_str(), &hints, &result) == 0 && result)
+        addr.reset(result, freeaddrinfo);
+
+    auto self = std::static_pointer_cast<SrsRtmpPullSession>(shared_from_this());
+    SrsTransmuxEngine::getinstance().submit([self, addr] { self->connect(addr.get()); });
+}
+
+void SrsRtmpPullSession::connect(const struct addrinfo *addr)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_closed)
+        return;
+
+    if (!addr)
+    {
+        fail("resolve host failed");
+        return;
+    }
+
+    m_fd = ::socket(addr->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_fd < 0)
+    {
+        fail("create socket failed");
+        return;
+    }
+
+    int ret = ::connect(m_fd, addr->ai_addr, addr->ai_addrlen);
+    if (ret < 0 && errno != EINPROGRESS)
+    {
+        fail("connect failed");
+        return;
+    }
+
+    m_state = StateConnecting;
+    if (SrsTransmuxEngine::getinstance().add(shared_from_this(), EPOLLOUT) != srs_success)
+    {
+        fail("add to engine failed");
+        return;
+    }
+}
+
+void SrsRtmpPullSession::on_close()
+{
+    // 写出最后一个不完整的切片
+    m_muxer.flush();
+}
+
+uint32_t SrsRtmpPullSession::on_event(uint32_t events)
+{
+    if (m_state == StateConnecting)
+    {
+        int so_error = 0;
+        socklen_t len = sizeof(so_error);
+        getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &so_error, &len);
+        if (so_error != 0 || (events & (EPOLLERR | EPOLLHUP)))
+        {
+            errno = so_error;
+            fail("connect failed");
+            return 0;
+        }
+
+        srs_rtmp_make_c0c1(m_out);
+        m_state = StateHandshaking;
+    }
+
+    return SrsRtmpConn::on_event(events);
+}
+
+srs_error_t SrsRtmpPullSession::on_handshake()
+{
+    // S0 + S1 + S2
+    if (m_handshake.size() < 1 + 2 * RTMP_HANDSHAKE_SIZE)
+        return srs_success;
+
+    if (m_handshake[0] != 0x03)
+        return ERROR_RTMP_PLAIN_REQUIRED;
+
+    // C2回显S1
+    m_out.append(m_handshake, 1, RTMP_HANDSHAKE_SIZE);
+    if (m_handshake.size() > 1 + 2 * RTMP_HANDSHAKE_SIZE)
+        m_reader.append(m_handshake.data() + 1 + 2 * RTMP_HANDSHAKE_SIZE,
+                        m_handshake.size() - 1 - 2 * RTMP_HANDSHAKE_SIZE);
+    std::string().swap(m_handshake);
+    m_handshaked = true;
+    m_state = StateConnected;
+
+    auto obj = SrsAmf0Any::make_object();
+    obj.set("app", SrsAmf0Any::make_string(m_url.app));
+    obj.set("flashVer", SrsAmf0Any::make_string("LNX 9,0,124,2"));
+    obj.set("tcUrl", SrsAmf0Any::make_string(m_url.tc_url));
+    obj.set("fpad", SrsAmf0Any::make_boolean(false));
+    obj.set("capabilities", SrsAmf0Any::make_number(239));
+    obj.set("audioCodecs", SrsAmf0Any::make_number(3575));
+    obj.set("videoCodecs", SrsAmf0Any::make_number(252));
+    obj.set("videoFunction", SrsAmf0Any::make_number(1));
+    obj.set("objectEncoding", SrsAmf0Any::make_number(0));
+
+    std::vector<SrsAmf0Any> values = {SrsAmf0Any::make_string("connect"), SrsAmf0Any::make_number(1), obj};
+    send_message(srs_rtmp_make_command(values), RTMP_CID_OverConnection);
+    return srs_success;
+}
+
+srs_error_t SrsRtmpPullSession::on_message(SrsRtmpMessage &msg)
+{
+    srs_error_t err = srs_success;
+
+    switch (msg.type)
+    {
+    case RTMP_MSG_AMF0CommandMessage:
+    case RTMP_MSG_AMF3CommandMessage:
+        return on_command(msg);
+    case RTMP_MSG_AudioMessage:
+    case RTMP_MSG_VideoMessage:
+    {
+        if (m_state != StatePlaying)
+            break;
+        err = msg.type == RTMP_MSG_AudioMessage ? m_muxer.on_audio(msg.timestamp, msg.payload)
+                                                : m_muxer.on_video(msg.timestamp, msg.payload);
+        // 单帧解析失败时丢弃该帧，文件写入失败时结束拉流
+        if (err == ERROR_HLS_DECODE_ERROR || err == ERROR_HLS_AVC_SAMPLE_SIZE)
+        {
+            auto logger = MyLogger::getLogger("native");
+            LOG_WARN(logger, "drop invalid frame, type:%d, size:%d, err:%d", msg.type,
+                     static_cast<int>(msg.payload.size()), err);
+            err = srs_success;
+        }
+        return err;
+    }
+    case RTMP_MSG_AggregateMessage:
+        return on_aggregate(msg);
+    default:
+        break;
+    }
+
+    return err;
+}
+
+srs_error_t SrsRtmpPullSession::on_command(SrsRtmpMessage &msg)
+{
+    std::vector<SrsAmf0Any> values;
+    if (!srs_rtmp_decode_command(msg, values))
+        return ERROR_RTMP_AMF0_DECODE;
+
+    auto logger = MyLogger::getLogger("native");
+    const std::string &name = values[0].str;
+    double txn = values[1].number;
+
+    if (name == "_result" && txn == 1)
+    {
+        // connect成功
+        std::vector<SrsAmf0Any> args = {SrsAmf0Any::make_string("createStream"), SrsAmf0Any::make_number(2),
+                                        SrsAmf0Any::make_null()};
+        send_message(srs_rtmp_make_command(args), RTMP_CID_OverConnection);
+    }
+    else if (name == "_result" && txn == 2)
+    {
+        // createStream成功，开始播放
+        if (values.size() < 4 || !values[3].is_number())
+            return ERROR_RTMP_MESSAGE_DECODE;
+        m_stream_id = static_cast<uint32_t>(values[3].number);
+
+        std::vector<SrsAmf0Any> args = {SrsAmf0Any::make_string("play"), SrsAmf0Any::make_number(0),
+                                        SrsAmf0Any::make_null(), SrsAmf0Any::make_string(m_url.stream)};
+        send_message(srs_rtmp_make_command(args, m_stream_id), RTMP_CID_OverStream);
+        send_message(srs_rtmp_make_user_control(SrcPCUCSetBufferLength, m_stream_id, SRS_NATIVE_BUFFER_LENGTH, true),
+                     RTMP_CID_ProtocolControl);
+        m_state = StatePlaying;
+        LOG_INFO(logger, "native ingest playing. url:%s/%s, hls:%s", m_url.tc_url.c_str(), m_url.stream.c_str(),
+                 m_m3u8.c_str());
+    }
+    else if (name == "_error")
+    {
+        std::string desc = values.size() > 3 ? values[3].get_string("description") : "";
+        LOG_WARN(logger, "native ingest command failed, txn:%d, desc:%s", static_cast<int>(txn), desc.c_str());
+        return txn == 1 ? ERROR_RTMP_REQ_CONNECT : ERROR_RTMP_STREAM_NOT_FOUND;
+    }
+    else if (name == "onStatus" && values.size() > 3)
+    {
+        std::string level = values[3].get_string("level");
+        std::string code = values[3].get_string("code");
+        LOG_INFO(logger, "native ingest status, level:%s, code:%s", level.c_str(), code.c_str());
+
+        // 源站停止推流后断开，由定时检查重新拉流
+        if (level == "error" || code == "NetStream.Play.Stop" || code == "NetStream.Play.UnpublishNotify")
+            return ERROR_RTMP_STREAM_NOT_FOUND;
+    }
+
+    return srs_success;
+}
+
+///////////////////////////////////////////////////////
+// SrsNativeIngester
+///////////////////////////////////////////////////////
+
+SrsNativeIngester::SrsNativeIngester()
+{
+}
+
+SrsNativeIngester::~SrsNativeIngester()
+{
+    stop();
+}
+
+srs_error_t SrsNativeIngester::initialize(std::string in, std::string out, std::string /*log*/)
+{
+    m_input = in;
+    m_output = out;
+
+    auto &conf = AppConfig::getinstance();
+    m_hls_time = static_cast<double>(conf.get_int("hls_time", 2));
+    m_list_size = static_cast<int>(conf.get_int("hls_list_size", 5));
+    m_part_time = conf.get_int("hls_part_ms", 0) / 1000.0;
+    return srs_success;
+}
+
+srs_error_t SrsNativeIngester::start()
+{
+    srs_error_t err = srs_success;
+
+    if (m_session)
+        return err;
+
+    auto session = std::make_shared<SrsRtmpPullSession>();
+    if ((err = session->initialize(m_input, m_output, m_hls_time, m_list_size, m_part_time, m_fmp4)) != srs_success)
+        return srs_error_wrap(err, "init native session " + m_input);
+
+    m_session = session;
+    m_session->start();
+    return err;
+}
+
+bool SrsNativeIngester::started()
+{
+    return m_session != nullptr;
+}
+
+srs_error_t SrsNativeIngester::cycle()
+{
+    if (!m_session)
+        return srs_success;
+
+    if (m_session->failed())
+    {
+        stop();
+        return ERROR_SOCKET_CLOSED;
+    }
+
+    if (time(0) - m_session->last_active() > SRS_NATIVE_RECV_TIMEOUT)
+    {
+        auto logger = MyLogger::getLogger("native");
+        LOG_WARN(logger, "native ingest timeout, url:%s", m_input.c_str());
+        stop();
+        return ERROR_SOCKET_TIMEOUT;
+    }
+
+    return srs_success;
+}
+
+void SrsNativeIngester::stop()
+{
+    if (!m_session)
+        return;
+
+    m_session->close();
+    m_session.reset();
+}
+
+void SrsNativeIngester::fast_stop()
+{
+    stop();
+}
+
+void SrsNativeIngester::fast_kill()
+{
+    stop();
+}
+
+void SrsNativeIngester::set_segment_type(const std::string &type)
+{
+    m_fmp4 = type == "fmp4";
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+#include "../common/srs_common.h"
+#include "../process/srs_app_ingester.hpp"
+#include "../protocol/srs_rtmp_stack.hpp"
+#include "../utils/thread_pool.hpp"
+#include "srs_app_hls.hpp"
+
+#include <netdb.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * @class SrsEpollConn
+ * @brief 挂在SrsTransmuxEngine上的非阻塞连接
+ *
+ * 每次只有一个工作线程处理同一个连接(EPOLLONESHOT)，处理完成后重新关注事件。
+ * on_event在持有连接锁的情况下调用，close可以在任意线程调用。
+ */
+class SrsEpollConn : public std::enable_shared_from_this<SrsEpollConn>
+{
+    friend class SrsTransmuxEngine;
+
+protected:
+    std::mutex m_mutex;     // 保护连接状态，处理事件和关闭时持有
+    int m_fd = -1;
+    uint64_t m_id = 0;      // 引擎分配的连接ID，fd可能被复用，事件按ID分发
+    bool m_closed = false;
+
+public:
+    virtual ~SrsEpollConn();
+
+    // 关闭连接，之后不会再收到事件
+    void close();
+
+protected:
+    /**
+     * @brief 处理epoll事件
+     * @return 下一次关注的事件，返回0表示关闭连接
+     */
+    virtual uint32_t on_event(uint32_t events) = 0;
+
+    // 连接关闭时调用，持有连接锁
+    virtual void on_close() {}
+
+    // 持有连接锁时关闭
+    void close_locked();
+
+private:
+    void dispatch(uint32_t events);
+};
+
+/**
+ * @class SrsTransmuxEngine
+ * @brief 原生转封装引擎：一个epoll线程负责等待网络事件，工作线程池负责解析和写切片
+ *
+ * 所有流共享同一组线程，流的数量不再受进程数限制。
+ * 工作线程数由配置项native_worker_threads指定。
+ */
+class SrsTransmuxEngine
+{
+private:
+    SrsTransmuxEngine();
+
+    int m_epfd = -1;
+    std::unique_ptr<WorkerPool> m_pool;
+    std::mutex m_mutex;                                   // 保护m_conns
+    std::map<uint64_t, std::shared_ptr<SrsEpollConn>> m_conns;
+    uint64_t m_next_id = 0;
+
+    void run();
+
+public:
+    static SrsTransmuxEngine &getinstance()
+    {
+        static SrsTransmuxEngine instance;
+        return instance;
+    }
+    ~SrsTransmuxEngine();
+
+    /**
+     * @brief 注册连接，fd需为非阻塞
+     * @param events 首次关注的事件
+     */
+    srs_error_t add(const std::shared_ptr<SrsEpollConn> &conn, uint32_t events);
+
+    // 提交任务到工作线程池
+    void submit(std::function<void()> job);
+
+private:
+    friend class SrsEpollConn;
+    void rearm(SrsEpollConn *conn, uint32_t events);
+    void remove(SrsEpollConn *conn);
+};
+
+/**
+ * @class SrsRtmpConn
+ * @brief RTMP连接的公共部分：收发缓冲、分块流解析和协议控制消息
+ *
+ * 子类实现握手和命令处理，握手完成前收到的数据交给on_handshake，之后解析为消息交给on_message。
+ */
+class SrsRtmpConn : public SrsEpollConn
+{
+protected:
+    bool m_handshaked = false;     // 握手是否完成
+    std::string m_handshake;       // 握手阶段收到的数据
+    std::string m_out;             // 待发送的数据
+    SrsRtmpChunkReader m_reader;
+    SrsRtmpChunkWriter m_writer;
+
+    uint64_t m_in_bytes = 0;       // 收到的字节数，用于回复确认消息
+    uint64_t m_last_ack = 0;
+    uint32_t m_ack_window = 0;
+
+    std::atomic<bool> m_failed;
+    std::atomic<time_t> m_last_active;
+
+public:
+    SrsRtmpConn();
+    virtual ~SrsRtmpConn();
+
+    // 是否已经出错结束
+    bool failed() const { return m_failed; }
+    // 最近一次收到数据的时间
+    time_t last_active() const { return m_last_active; }
+
+protected:
+    virtual uint32_t on_event(uint32_t events);
+
+    // 处理握手数据，完成后设置m_handshaked，多余的数据放入m_reader
+    virtual srs_error_t on_handshake() = 0;
+    // 处理协议控制消息以外的消息
+    virtual srs_error_t on_message(SrsRtmpMessage &msg) = 0;
+    // 日志中的连接描述
+    virtual std::string desc() = 0;
+
+    void fail(const char *reason);
+    bool flush();
+    void send_message(const SrsRtmpMessage &msg, uint32_t csid);
+    srs_error_t on_aggregate(SrsRtmpMessage &msg);
+
+private:
+    srs_error_t on_control_message(SrsRtmpMessage &msg, bool &handled);
+};
+
+/**
+ * @class SrsRtmpPullSession
+ * @brief 从RTMP服务器拉流并切片为HLS，协议交互全部为非阻塞
+ *
+ * 流程：连接 -> 简单握手 -> connect -> createStream -> play -> 接收音视频。
+ */
+class SrsRtmpPullSession : public SrsRtmpConn
+{
+private:
+    enum State
+    {
+        StateInit,
+        StateConnecting,
+        StateHandshaking,
+        StateConnected,
+        StatePlaying,
+    };
+
+    SrsRtmpUrl m_url;
+    std::string m_m3u8;
+    State m_state = StateInit;
+    SrsHlsMuxer m_muxer;
+    uint32_t m_stream_id = 0;
+
+public:
+    SrsRtmpPullSession();
+    virtual ~SrsRtmpPullSession();
+
+    /**
+     * @brief 初始化拉流参数
+     * @param url RTMP地址
+     * @param m3u8 输出播放列表路径
+     * @param fmp4 输出fMP4切片
+     */
+    srs_error_t initialize(const std::string &url, const std::string &m3u8, double hls_time, int list_size,
+                           double part_time, bool fmp4);
+
+    // 在独立线程中解析域名，之后在工作线程中发起连接
+    void start();
+
+protected:
+    virtual uint32_t on_event(uint32_t events);
+    virtual void on_close();
+    virtual srs_error_t on_handshake();
+    virtual srs_error_t on_message(SrsRtmpMessage &msg);
+    virtual std::string desc();
+
+private:
+    void resolve();
+    void connect(const struct addrinfo *addr);
+    srs_error_t on_command(SrsRtmpMessage &msg);
+};
+
+/**
+ * @class SrsNativeIngester
+ * @brief 使用内置转封装引擎的拉流后端，不启动外部进程
+ */
+class SrsNativeIngester : public ISrsIngester
+{
+private:
+    std::string m_input;
+    std::string m_output;
+    double m_hls_time = 2;
+    int m_list_size = 5;
+    double m_part_time = 0; // LL-HLS分片时长(秒)，0表示不输出分片
+    bool m_fmp4 = false;    // 输出fMP4切片
+    std::shared_ptr<SrsRtmpPullSession> m_session;
+
+public:
+    SrsNativeIngester();
+    virtual ~SrsNativeIngester();
+
+    virtual srs_error_t initialize(std::string in, std::string out, std::string log);
+    virtual srs_error_t start();
+    virtual bool started();
+    virtual srs_error_t cycle();
+    virtual void stop();
+    virtual void fast_stop();
+    virtual void fast_kill();
+    virtual void set_segment_type(const std::string &type);
+};
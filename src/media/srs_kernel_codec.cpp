@@ -0,0 +1,411 @@
+#include "srs_kernel_codec.hpp"
+
+using namespace std;
+
+// Annex B起始码
+static const char kStartCode[] = {0x00, 0x00, 0x00, 0x01};
+// 访问单元分隔符，HLS播放器依赖它划分帧
+static const char kAccessUnitDelimiter[] = {0x00, 0x00, 0x00, 0x01, 0x09, static_cast<char>(0xf0)};
+
+srs_error_t SrsFormat::avc_demux_sps_pps(const char *p, size_t size)
+{
+    // AVCDecoderConfigurationRecord，参考ISO/IEC 14496-15 5.2.4.1
+    if (size < 7)
+        return ERROR_HLS_DECODE_ERROR;
+
+    int nalu_length_size = (static_cast<uint8_t>(p[4]) & 0x03) + 1;
+    if (nalu_length_size == 3)
+        return ERROR_HLS_DECODE_ERROR;
+
+    const char *end = p + size;
+    const char *q = p + 5;
+
+    std::string sps;
+    int nb_sps = static_cast<uint8_t>(*q++) & 0x1f;
+    for (int i = 0; i < nb_sps; i++)
+    {
+        if (end - q < 2)
+            return ERROR_HLS_DECODE_ERROR;
+        size_t len = (static_cast<uint8_t>(q[0]) << 8) | static_cast<uint8_t>(q[1]);
+        q += 2;
+        if (static_cast<size_t>(end - q) < len)
+            return ERROR_HLS_DECODE_ERROR;
+        // 只使用第一个SPS
+        if (sps.empty())
+            sps.assign(q, len);
+        q += len;
+    }
+
+    if (end - q < 1)
+        return ERROR_HLS_DECODE_ERROR;
+
+    std::string pps;
+    int nb_pps = static_cast<uint8_t>(*q++);
+    for (int i = 0; i < nb_pps; i++)
+    {
+        if (end - q < 2)
+            return ERROR_HLS_DECODE_ERROR;
+        size_t len = (static_cast<uint8_t>(q[0]) << 8) | static_cast<uint8_t>(q[1]);
+        q += 2;
+        if (static_cast<size_t>(end - q) < len)
+            return ERROR_HLS_DECODE_ERROR;
+        if (pps.empty())
+            pps.assign(q, len);
+        q += len;
+    }
+
+    if (sps.empty() || pps.empty())
+        return ERROR_HLS_DECODE_ERROR;
+
+    m_sps = sps;
+    m_pps = pps;
+    m_nalu_length_size = nalu_length_size;
+    m_avc_config.assign(p, size);
+    m_avc_config[4] |= 0x03; // MP4格式输出的帧统一使用4字节长度
+    m_has_video = true;
+    return srs_success;
+}
+
+srs_error_t SrsFormat::on_video(uint32_t timestamp, const std::string &payload, SrsMediaFrame &frame, bool &got)
+{
+    got = false;
+
+    // FrameType(4bit) CodecID(4bit) AVCPacketType(8bit) CompositionTime(24bit)
+    if (payload.size() < 5)
+        return srs_success;
+
+    const char *p = payload.data();
+    int frame_type = (static_cast<uint8_t>(p[0]) >> 4) & 0x0f;
+    int codec_id = static_cast<uint8_t>(p[0]) & 0x0f;
+    if (codec_id != SrsVideoCodecIdAVC)
+        return srs_success;
+
+    // 视频信息帧，不包含数据
+    if (frame_type == 5)
+        return srs_success;
+
+    int packet_type = static_cast<uint8_t>(p[1]);
+    if (packet_type == SrsVideoAvcFrameTraitSequenceHeader)
+        return avc_demux_sps_pps(p + 5, payload.size() - 5);
+
+    if (packet_type != SrsVideoAvcFrameTraitNALU || !m_has_video)
+        return srs_success;
+
+    // 组合时间为有符号24位整数
+    int32_t cts = (static_cast<uint8_t>(p[2]) << 16) | (static_cast<uint8_t>(p[3]) << 8) | static_cast<uint8_t>(p[4]);
+    if (cts & 0x800000)
+        cts |= 0xff000000;
+
+    frame = SrsMediaFrame();
+    frame.is_video = true;
+    frame.dts = static_cast<int64_t>(timestamp) * 90;
+    frame.pts = frame.dts + static_cast<int64_t>(cts) * 90;
+    frame.data.reserve(payload.size() + m_sps.size() + m_pps.size() + 32);
+    if (!m_mp4)
+        frame.data.append(kAccessUnitDelimiter, sizeof(kAccessUnitDelimiter));
+
+    // 第一遍检查是否为关键帧以及是否自带SPS/PPS
+    bool has_idr = false;
+    bool has_sps_pps = false;
+    const char *end = p + payload.size();
+    for (const char *q = p + 5; q < end;)
+    {
+        if (end - q < m_nalu_length_size)
+            return ERROR_HLS_AVC_SAMPLE_SIZE;
+        size_t len = 0;
+        for (int i = 0; i < m_nalu_length_size; i++)
+            len = (len << 8) | static_cast<uint8_t>(q[i]);
+        q += m_nalu_length_size;
+        if (static_cast<size_t>(end - q) < len)
+            return ERROR_HLS_AVC_SAMPLE_SIZE;
+        if (len > 0)
+        {
+            int nalu_type = static_cast<uint8_t>(q[0]) & 0x1f;
+            has_idr |= nalu_type == SrsAvcNaluTypeIDR;
+            has_sps_pps |= nalu_type == SrsAvcNaluTypeSPS || nalu_type == SrsAvcNaluTypePPS;
+        }
+        q += len;
+    }
+
+    // 关键帧前插入SPS/PPS，每个切片都可以独立解码；MP4的SPS/PPS在初始化段中
+    frame.keyframe = has_idr;
+    if (has_idr && !has_sps_pps && !m_mp4)
+    {
+        frame.data.append(kStartCode, sizeof(kStartCode));
+        frame.data.append(m_sps);
+        frame.data.append(kStartCode, sizeof(kStartCode));
+        frame.data.append(m_pps);
+    }
+
+    for (const char *q = p + 5; q < end;)
+    {
+        size_t len = 0;
+        for (int i = 0; i < m_nalu_length_size; i++)
+            len = (len << 8) | static_cast<uint8_t>(q[i]);
+        q += m_nalu_length_size;
+        if (len > 0 && (static_cast<uint8_t>(q[0]) & 0x1f) != SrsAvcNaluTypeAccessUnitDelimiter)
+        {
+            if (m_mp4)
+            {
+                char size[4] = {static_cast<char>(len >> 24), static_cast<char>(len >> 16),
+                                static_cast<char>(len >> 8), static_cast<char>(len)};
+                frame.data.append(size, sizeof(size));
+            }
+            else
+            {
+                frame.data.append(kStartCode, sizeof(kStartCode));
+            }
+            frame.data.append(q, len);
+        }
+        q += len;
+    }
+
+    got = true;
+    return srs_success;
+}
+
+srs_error_t SrsFormat::aac_demux_asc(const char *p, size_t size)
+{
+    // AudioSpecificConfig，参考ISO/IEC 14496-3 1.6.2.1
+    if (size < 2)
+        return ERROR_HLS_DECODE_ERROR;
+
+    uint8_t object = (static_cast<uint8_t>(p[0]) >> 3) & 0x1f;
+    uint8_t sample_rate = ((static_cast<uint8_t>(p[0]) << 1) & 0x0e) | ((static_cast<uint8_t>(p[1]) >> 7) & 0x01);
+    uint8_t channels = (static_cast<uint8_t>(p[1]) >> 3) & 0x0f;
+    if (object == 0 || sample_rate >= 0x0d || channels == 0)
+        return ERROR_HLS_DECODE_ERROR;
+
+    m_aac_object = object;
+    m_aac_sample_rate = sample_rate;
+    m_aac_channels = channels;
+    m_aac_config.assign(p, size);
+    m_has_audio = true;
+    return srs_success;
+}
+
+srs_error_t SrsFormat::on_audio(uint32_t timestamp, const std::string &payload, SrsMediaFrame &frame, bool &got)
+{
+    got = false;
+
+    // SoundFormat(4bit) SoundRate(2bit) SoundSize(1bit) SoundType(1bit) AACPacketType(8bit)
+    if (payload.size() < 2)
+        return srs_success;
+
+    const char *p = payload.data();
+    int sound_format = (static_cast<uint8_t>(p[0]) >> 4) & 0x0f;
+    if (sound_format != SrsAudioCodecIdAAC)
+        return srs_success;
+
+    int packet_type = static_cast<uint8_t>(p[1]);
+    if (packet_type == SrsAudioAacFrameTraitSequenceHeader)
+        return aac_demux_asc(p + 2, payload.size() - 2);
+
+    if (packet_type != SrsAudioAacFrameTraitRawData || !m_has_audio)
+        return srs_success;
+
+    if (m_mp4)
+    {
+        frame = SrsMediaFrame();
+        frame.is_video = false;
+        frame.keyframe = true;
+        frame.dts = frame.pts = static_cast<int64_t>(timestamp) * 90;
+        frame.data.assign(p + 2, payload.size() - 2);
+        got = true;
+        return srs_success;
+    }
+
+    size_t raw_size = payload.size() - 2;
+    size_t frame_length = raw_size + 7;
+    if (frame_length > 0x1fff)
+        return ERROR_HLS_DECODE_ERROR;
+
+    // ADTS只能表示profile 0~3，HE-AAC等扩展类型按AAC-LC标记，由解码器识别SBR/PS
+    uint8_t profile = m_aac_object <= 4 ? m_aac_object - 1 : 1;
+
+    frame = SrsMediaFrame();
+    frame.is_video = false;
+    frame.keyframe = true;
+    frame.dts = frame.pts = static_cast<int64_t>(timestamp) * 90;
+    frame.data.reserve(frame_length);
+    frame.data.push_back(static_cast<char>(0xff));
+    frame.data.push_back(static_cast<char>(0xf1)); // MPEG-4，无CRC
+    frame.data.push_back(static_cast<char>(((profile & 0x03) << 6) | ((m_aac_sample_rate & 0x0f) << 2) |
+                                           ((m_aac_channels >> 2) & 0x01)));
+    frame.data.push_back(static_cast<char>(((m_aac_channels & 0x03) << 6) | ((frame_length >> 11) & 0x03)));
+    frame.data.push_back(static_cast<char>((frame_length >> 3) & 0xff));
+    frame.data.push_back(static_cast<char>(((frame_length & 0x07) << 5) | 0x1f));
+    frame.data.push_back(static_cast<char>(0xfc));
+    frame.data.append(p + 2, raw_size);
+
+    got = true;
+    return srs_success;
+}
+
+int SrsFormat::aac_sample_rate() const
+{
+    static const int rates[] = {96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350};
+    return m_aac_sample_rate < sizeof(rates) / sizeof(rates[0]) ? rates[m_aac_sample_rate] : 0;
+}
+
+namespace
+{
+// 按位读取去除防竞争字节后的RBSP，越界后读到的都是0并设置错误
+class SrsBitReader
+{
+private:
+    const std::string &m_data;
+    size_t m_pos = 0; // 位
+    bool m_error = false;
+
+public:
+    explicit SrsBitReader(const std::string &data) : m_data(data) {}
+
+    bool error() const { return m_error; }
+
+    uint32_t read_bit()
+    {
+        if (m_pos >= m_data.size() * 8)
+        {
+            m_error = true;
+            return 0;
+        }
+        uint32_t bit = (static_cast<uint8_t>(m_data[m_pos / 8]) >> (7 - m_pos % 8)) & 0x01;
+        m_pos++;
+        return bit;
+    }
+
+    uint32_t read_bits(int n)
+    {
+        uint32_t v = 0;
+        for (int i = 0; i < n; i++)
+            v = (v << 1) | read_bit();
+        return v;
+    }
+
+    // 无符号指数哥伦布编码
+    uint32_t read_ue()
+    {
+        int zeros = 0;
+        while (read_bit() == 0 && !m_error && zeros < 32)
+            zeros++;
+        if (zeros >= 32)
+        {
+            m_error = true;
+            return 0;
+        }
+        return (1u << zeros) - 1 + read_bits(zeros);
+    }
+
+    // 有符号指数哥伦布编码
+    int32_t read_se()
+    {
+        uint32_t v = read_ue();
+        return (v & 0x01) ? static_cast<int32_t>((v + 1) / 2) : -static_cast<int32_t>(v / 2);
+    }
+};
+
+void skip_scaling_list(SrsBitReader &reader, int size)
+{
+    int last = 8;
+    int next = 8;
+    for (int i = 0; i < size; i++)
+    {
+        if (next != 0)
+            next = (last + reader.read_se() + 256) % 256;
+        last = next == 0 ? last : next;
+    }
+}
+} // namespace
+
+bool srs_avc_sps_size(const std::string &sps, int &width, int &height)
+{
+    width = height = 0;
+    if (sps.size() < 4)
+        return false;
+
+    // 去除NALU头和防竞争字节(00 00 03中的03)
+    std::string rbsp;
+    rbsp.reserve(sps.size());
+    for (size_t i = 1; i < sps.size(); i++)
+    {
+        if (i >= 3 && sps[i] == 0x03 && sps[i - 1] == 0x00 && sps[i - 2] == 0x00)
+            continue;
+        rbsp.push_back(sps[i]);
+    }
+
+    SrsBitReader reader(rbsp);
+    uint32_t profile = reader.read_bits(8);
+    reader.read_bits(16); // constraint_set_flags, level_idc
+    reader.read_ue();     // seq_parameter_set_id
+
+    uint32_t chroma_format = 1;
+    if (profile == 100 || profile == 110 || profile == 122 || profile == 244 || profile == 44 || profile == 83 ||
+        profile == 86 || profile == 118 || profile == 128 || profile == 138 || profile == 139 || profile == 134 ||
+        profile == 135)
+    {
+        chroma_format = reader.read_ue();
+        if (chroma_format == 3)
+            reader.read_bit(); // separate_colour_plane_flag
+        reader.read_ue();      // bit_depth_luma_minus8
+        reader.read_ue();      // bit_depth_chroma_minus8
+        reader.read_bit();     // qpprime_y_zero_transform_bypass_flag
+        if (reader.read_bit()) // seq_scaling_matrix_present_flag
+        {
+            for (int i = 0; i < (chroma_format != 3 ? 8 : 12); i++)
+            {
+                if (reader.read_bit())
+                    skip_scaling_list(reader, i < 6 ? 16 : 64);
+            }
+        }
+    }
+
+    reader.read_ue(); // log2_max_frame_num_minus4
+    uint32_t poc_type = reader.read_ue();
+    if (poc_type == 0)
+    {
+        reader.read_ue(); // log2_max_pic_order_cnt_lsb_minus4
+    }
+    else if (poc_type == 1)
+    {
+        reader.read_bit(); // delta_pic_order_always_zero_flag
+        reader.read_se();  // offset_for_non_ref_pic
+        reader.read_se();  // offset_for_top_to_bottom_field
+        uint32_t cycle = reader.read_ue();
+        for (uint32_t i = 0; i < cycle && !reader.error(); i++)
+            reader.read_se();
+    }
+    reader.read_ue();  // max_num_ref_frames
+    reader.read_bit(); // gaps_in_frame_num_value_allowed_flag
+
+    uint32_t width_mbs = reader.read_ue() + 1;
+    uint32_t height_units = reader.read_ue() + 1;
+    uint32_t frame_mbs_only = reader.read_bit();
+    if (!frame_mbs_only)
+        reader.read_bit(); // mb_adaptive_frame_field_flag
+    reader.read_bit();     // direct_8x8_inference_flag
+
+    uint32_t crop_left = 0, crop_right = 0, crop_top = 0, crop_bottom = 0;
+    if (reader.read_bit())
+    {
+        crop_left = reader.read_ue();
+        crop_right = reader.read_ue();
+        crop_top = reader.read_ue();
+        crop_bottom = reader.read_ue();
+    }
+    if (reader.error())
+        return false;
+
+    // 裁剪单位，参考表6-1
+    uint32_t crop_x = chroma_format == 1 || chroma_format == 2 ? 2 : 1;
+    uint32_t crop_y = (chroma_format == 1 ? 2 : 1) * (2 - frame_mbs_only);
+    int64_t w = static_cast<int64_t>(width_mbs) * 16 - static_cast<int64_t>(crop_left + crop_right) * crop_x;
+    int64_t h = static_cast<int64_t>(height_units) * 16 * (2 - frame_mbs_only) -
+                static_cast<int64_t>(crop_top + crop_bottom) * crop_y;
+    if (w <= 0 || h <= 0 || w > 65535 || h > 65535)
+        return false;
+
+    width = static_cast<int>(w);
+    height = static_cast<int>(h);
+    return true;
+}
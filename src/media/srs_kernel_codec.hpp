@@ -0,0 +1,105 @@
+#pragma once
+
+#include "../common/srs_common.h"
+
+#include <stdint.h>
+
+#include <string>
+
+// FLV视频编码ID
+#define SrsVideoCodecIdAVC        7
+// FLV音频编码ID
+#define SrsAudioCodecIdAAC        10
+
+// AVC包类型
+#define SrsVideoAvcFrameTraitSequenceHeader 0
+#define SrsVideoAvcFrameTraitNALU           1
+// AAC包类型
+#define SrsAudioAacFrameTraitSequenceHeader 0
+#define SrsAudioAacFrameTraitRawData        1
+
+// H.264 NALU类型
+#define SrsAvcNaluTypeIDR         5
+#define SrsAvcNaluTypeSPS         7
+#define SrsAvcNaluTypePPS         8
+#define SrsAvcNaluTypeAccessUnitDelimiter 9
+
+/**
+ * @brief 解码后的一帧，数据已经转换为TS或MP4需要的格式
+ * TS格式：视频为带AUD的Annex B格式，音频为带ADTS头的AAC帧。
+ * MP4格式：视频为4字节长度前缀的NALU，音频为不带ADTS头的AAC帧。
+ */
+struct SrsMediaFrame
+{
+    bool is_video = false;
+    bool keyframe = false;
+    int64_t dts = 0; // 90kHz时钟
+    int64_t pts = 0; // 90kHz时钟
+    std::string data;
+};
+
+/**
+ * @class SrsFormat
+ * @brief 解析RTMP音视频消息(即FLV tag的数据部分)，只支持H.264和AAC
+ *
+ * 序列头只更新解码参数，不输出帧。其他编码格式的消息被忽略。
+ */
+class SrsFormat
+{
+private:
+    bool m_mp4 = false; // 按MP4格式输出帧
+
+    // AVC解码参数
+    std::string m_sps;
+    std::string m_pps;
+    std::string m_avc_config; // AVCDecoderConfigurationRecord，NALU长度固定为4字节
+    int m_nalu_length_size = 4;
+    bool m_has_video = false;
+
+    // AAC解码参数
+    uint8_t m_aac_object = 0;
+    uint8_t m_aac_sample_rate = 0; // 采样率索引
+    uint8_t m_aac_channels = 0;
+    std::string m_aac_config; // AudioSpecificConfig
+    bool m_has_audio = false;
+
+public:
+    // 按MP4格式输出帧，默认为TS格式
+    void set_mp4(bool mp4) { m_mp4 = mp4; }
+
+    // 是否已收到对应的序列头
+    bool has_video() const { return m_has_video; }
+    bool has_audio() const { return m_has_audio; }
+
+    // 解码参数，用于写MP4初始化段
+    const std::string &sps() const { return m_sps; }
+    const std::string &avc_config() const { return m_avc_config; }
+    const std::string &aac_config() const { return m_aac_config; }
+    int aac_sample_rate() const;
+    int aac_channels() const { return m_aac_channels; }
+
+    /**
+     * @brief 解析视频消息
+     * @param timestamp 消息时间戳(ms)
+     * @param got 输出了一帧时为true
+     */
+    srs_error_t on_video(uint32_t timestamp, const std::string &payload, SrsMediaFrame &frame, bool &got);
+
+    /**
+     * @brief 解析音频消息
+     * @param timestamp 消息时间戳(ms)
+     * @param got 输出了一帧时为true
+     */
+    srs_error_t on_audio(uint32_t timestamp, const std::string &payload, SrsMediaFrame &frame, bool &got);
+
+private:
+    srs_error_t avc_demux_sps_pps(const char *p, size_t size);
+    srs_error_t aac_demux_asc(const char *p, size_t size);
+};
+
+/**
+ * @brief 从SPS解析视频宽高，参考ISO/IEC 14496-10 7.3.2.1.1
+ * @param sps 不带起始码的SPS
+ * @return 格式错误时返回false
+ */
+bool srs_avc_sps_size(const std::string &sps, int &width, int &height);
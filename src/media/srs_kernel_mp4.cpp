@@ -0,0 +1,386 @@
+#include "srs_kernel_mp4.hpp"
+
+#include <string.h>
+
+using namespace std;
+
+// trun中的样本标志，参考ISO/IEC 14496-12 8.8.3.1
+#define SRS_MP4_SAMPLE_SYNC       0x02000000 // sample_depends_on=2
+#define SRS_MP4_SAMPLE_NON_SYNC   0x01010000 // sample_depends_on=1, sample_is_non_sync_sample=1
+
+// 单位矩阵，mvhd和tkhd使用
+static const uint32_t kUnityMatrix[9] = {0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000};
+
+static void write_u8(std::string &out, uint8_t v)
+{
+    out.push_back(static_cast<char>(v));
+}
+
+static void write_u16(std::string &out, uint16_t v)
+{
+    out.push_back(static_cast<char>(v >> 8));
+    out.push_back(static_cast<char>(v));
+}
+
+static void write_u24(std::string &out, uint32_t v)
+{
+    out.push_back(static_cast<char>(v >> 16));
+    out.push_back(static_cast<char>(v >> 8));
+    out.push_back(static_cast<char>(v));
+}
+
+static void write_u32(std::string &out, uint32_t v)
+{
+    out.push_back(static_cast<char>(v >> 24));
+    out.push_back(static_cast<char>(v >> 16));
+    out.push_back(static_cast<char>(v >> 8));
+    out.push_back(static_cast<char>(v));
+}
+
+static void write_u64(std::string &out, uint64_t v)
+{
+    write_u32(out, static_cast<uint32_t>(v >> 32));
+    write_u32(out, static_cast<uint32_t>(v));
+}
+
+static void write_zeros(std::string &out, size_t n)
+{
+    out.append(n, '\0');
+}
+
+// 覆盖已写入位置的32位整数
+static void patch_u32(std::string &out, size_t pos, uint32_t v)
+{
+    out[pos] = static_cast<char>(v >> 24);
+    out[pos + 1] = static_cast<char>(v >> 16);
+    out[pos + 2] = static_cast<char>(v >> 8);
+    out[pos + 3] = static_cast<char>(v);
+}
+
+// 开始一个box，返回起始位置，写完内容后调用end_box回填大小
+static size_t begin_box(std::string &out, const char *type)
+{
+    size_t pos = out.size();
+    write_u32(out, 0);
+    out.append(type, 4);
+    return pos;
+}
+
+static size_t begin_full_box(std::string &out, const char *type, uint8_t version, uint32_t flags)
+{
+    size_t pos = begin_box(out, type);
+    write_u8(out, version);
+    write_u24(out, flags);
+    return pos;
+}
+
+static void end_box(std::string &out, size_t pos)
+{
+    patch_u32(out, pos, static_cast<uint32_t>(out.size() - pos));
+}
+
+// ES描述符，参考ISO/IEC 14496-1 7.2.2.1，长度使用4字节的可变长度编码
+static void write_descriptor(std::string &out, uint8_t tag, const std::string &data)
+{
+    size_t size = data.size();
+    write_u8(out, tag);
+    write_u8(out, static_cast<uint8_t>(0x80 | ((size >> 21) & 0x7f)));
+    write_u8(out, static_cast<uint8_t>(0x80 | ((size >> 14) & 0x7f)));
+    write_u8(out, static_cast<uint8_t>(0x80 | ((size >> 7) & 0x7f)));
+    write_u8(out, static_cast<uint8_t>(size & 0x7f));
+    out.append(data);
+}
+
+void SrsMp4Muxer::write_init(std::string &out, const SrsFormat &format, bool has_video, bool has_audio)
+{
+    m_video_track = has_video ? 1 : 0;
+    m_audio_track = has_audio ? m_video_track + 1 : 0;
+    m_audio_rate = has_audio ? format.aac_sample_rate() : 0;
+
+    size_t box = begin_box(out, "ftyp");
+    out.append("iso6", 4); // major_brand
+    write_u32(out, 0);     // minor_version
+    out.append("iso6mp41dash", 12);
+    end_box(out, box);
+
+    size_t moov = begin_box(out, "moov");
+
+    // 直播流的时长未知，全部为0
+    box = begin_full_box(out, "mvhd", 0, 0);
+    write_u32(out, 0);             // creation_time
+    write_u32(out, 0);             // modification_time
+    write_u32(out, 1000);          // timescale
+    write_u32(out, 0);             // duration
+    write_u32(out, 0x00010000);    // rate
+    write_u16(out, 0x0100);        // volume
+    write_zeros(out, 10);          // reserved
+    for (auto v : kUnityMatrix)
+        write_u32(out, v);
+    write_zeros(out, 24);          // pre_defined
+    write_u32(out, (m_audio_track ? m_audio_track : m_video_track) + 1); // next_track_ID
+    end_box(out, box);
+
+    if (m_video_track)
+        write_trak(out, format, m_video_track, true);
+    if (m_audio_track)
+        write_trak(out, format, m_audio_track, false);
+
+    // 样本都在分段中
+    size_t mvex = begin_box(out, "mvex");
+    for (uint32_t track = 1; track <= (m_audio_track ? m_audio_track : m_video_track); track++)
+    {
+        box = begin_full_box(out, "trex", 0, 0);
+        write_u32(out, track); // track_ID
+        write_u32(out, 1);     // default_sample_description_index
+        write_u32(out, 0);     // default_sample_duration
+        write_u32(out, 0);     // default_sample_size
+        write_u32(out, 0);     // default_sample_flags
+        end_box(out, box);
+    }
+    end_box(out, mvex);
+
+    end_box(out, moov);
+}
+
+void SrsMp4Muxer::write_trak(std::string &out, const SrsFormat &format, uint32_t track, bool video)
+{
+    int width = 0;
+    int height = 0;
+    if (video)
+        srs_avc_sps_size(format.sps(), width, height);
+
+    size_t trak = begin_box(out, "trak");
+
+    size_t box = begin_full_box(out, "tkhd", 0, 0x000003); // track_enabled | track_in_movie
+    write_u32(out, 0);                      // creation_time
+    write_u32(out, 0);                      // modification_time
+    write_u32(out, track);                  // track_ID
+    write_u32(out, 0);                      // reserved
+    write_u32(out, 0);                      // duration
+    write_zeros(out, 8);                    // reserved
+    write_u16(out, 0);                      // layer
+    write_u16(out, 0);                      // alternate_group
+    write_u16(out, video ? 0 : 0x0100);     // volume
+    write_u16(out, 0);                      // reserved
+    for (auto v : kUnityMatrix)
+        write_u32(out, v);
+    write_u32(out, static_cast<uint32_t>(width) << 16);
+    write_u32(out, static_cast<uint32_t>(height) << 16);
+    end_box(out, box);
+
+    size_t mdia = begin_box(out, "mdia");
+
+    box = begin_full_box(out, "mdhd", 0, 0);
+    write_u32(out, 0);                 // creation_time
+    write_u32(out, 0);                 // modification_time
+    write_u32(out, SRS_MP4_TIMESCALE); // timescale
+    write_u32(out, 0);                 // duration
+    write_u16(out, 0x55c4);            // language: und
+    write_u16(out, 0);                 // pre_defined
+    end_box(out, box);
+
+    box = begin_full_box(out, "hdlr", 0, 0);
+    write_u32(out, 0); // pre_defined
+    out.append(video ? "vide" : "soun", 4);
+    write_zeros(out, 12); // reserved
+    const char *name = video ? "VideoHandler" : "SoundHandler";
+    out.append(name, strlen(name) + 1);
+    end_box(out, box);
+
+    size_t minf = begin_box(out, "minf");
+    if (video)
+    {
+        box = begin_full_box(out, "vmhd", 0, 1);
+        write_u16(out, 0);   // graphicsmode
+        write_zeros(out, 6); // opcolor
+        end_box(out, box);
+    }
+    else
+    {
+        box = begin_full_box(out, "smhd", 0, 0);
+        write_u16(out, 0); // balance
+        write_u16(out, 0); // reserved
+        end_box(out, box);
+    }
+
+    size_t dinf = begin_box(out, "dinf");
+    size_t dref = begin_full_box(out, "dref", 0, 0);
+    write_u32(out, 1);                         // entry_count
+    box = begin_full_box(out, "url ", 0, 1);   // 数据在同一个文件中
+    end_box(out, box);
+    end_box(out, dref);
+    end_box(out, dinf);
+
+    size_t stbl = begin_box(out, "stbl");
+    size_t stsd = begin_full_box(out, "stsd", 0, 0);
+    write_u32(out, 1); // entry_count
+    if (video)
+    {
+        size_t entry = begin_box(out, "avc1");
+        write_zeros(out, 6);          // reserved
+        write_u16(out, 1);            // data_reference_index
+        write_zeros(out, 16);         // pre_defined, reserved
+        write_u16(out, static_cast<uint16_t>(width));
+        write_u16(out, static_cast<uint16_t>(height));
+        write_u32(out, 0x00480000);   // horizresolution, 72dpi
+        write_u32(out, 0x00480000);   // vertresolution
+        write_u32(out, 0);            // reserved
+        write_u16(out, 1);            // frame_count
+        write_zeros(out, 32);         // compressorname
+        write_u16(out, 0x0018);       // depth
+        write_u16(out, 0xffff);       // pre_defined
+        box = begin_box(out, "avcC");
+        out.append(format.avc_config());
+        end_box(out, box);
+        end_box(out, entry);
+    }
+    else
+    {
+        size_t entry = begin_box(out, "mp4a");
+        write_zeros(out, 6);          // reserved
+        write_u16(out, 1);            // data_reference_index
+        write_zeros(out, 8);          // reserved
+        write_u16(out, static_cast<uint16_t>(format.aac_channels()));
+        write_u16(out, 16);           // samplesize
+        write_u32(out, 0);            // pre_defined, reserved
+        write_u32(out, static_cast<uint32_t>(m_audio_rate > 0xffff ? 0 : m_audio_rate) << 16);
+
+        // DecoderConfigDescriptor，objectTypeIndication 0x40表示MPEG-4音频，streamType 0x05表示音频
+        std::string config;
+        write_u8(config, 0x40);
+        write_u8(config, (0x05 << 2) | 0x01);
+        write_u24(config, 0); // bufferSizeDB
+        write_u32(config, 0); // maxBitrate
+        write_u32(config, 0); // avgBitrate
+        write_descriptor(config, 0x05, format.aac_config());
+
+        std::string sl;
+        write_u8(sl, 0x02); // predefined，MP4文件使用
+
+        std::string es;
+        write_u16(es, static_cast<uint16_t>(track)); // ES_ID
+        write_u8(es, 0);                             // flags
+        write_descriptor(es, 0x04, config);
+        write_descriptor(es, 0x06, sl);
+
+        box = begin_full_box(out, "esds", 0, 0);
+        write_descriptor(out, 0x03, es);
+        end_box(out, box);
+        end_box(out, entry);
+    }
+    end_box(out, stsd);
+
+    // 样本表为空
+    const char *tables[] = {"stts", "stsc", "stco"};
+    for (auto type : tables)
+    {
+        box = begin_full_box(out, type, 0, 0);
+        write_u32(out, 0); // entry_count
+        end_box(out, box);
+    }
+    box = begin_full_box(out, "stsz", 0, 0);
+    write_u32(out, 0); // sample_size
+    write_u32(out, 0); // sample_count
+    end_box(out, box);
+    end_box(out, stbl);
+
+    end_box(out, minf);
+    end_box(out, mdia);
+    end_box(out, trak);
+}
+
+void SrsMp4Muxer::write_fragment(std::string &out, const std::vector<SrsMediaFrame> &frames, int64_t end_dts)
+{
+    struct Track
+    {
+        uint32_t id;
+        bool video;
+        std::vector<const SrsMediaFrame *> samples;
+        size_t offset_pos; // trun中data_offset的位置
+        size_t size;       // 样本的总大小
+    };
+
+    Track tracks[2] = {{m_video_track, true, {}, 0, 0}, {m_audio_track, false, {}, 0, 0}};
+    for (auto &frame : frames)
+    {
+        auto &track = tracks[frame.is_video ? 0 : 1];
+        if (track.id)
+        {
+            track.samples.push_back(&frame);
+            track.size += frame.data.size();
+        }
+    }
+    if (tracks[0].samples.empty() && tracks[1].samples.empty())
+        return;
+
+    size_t moof = begin_box(out, "moof");
+    size_t box = begin_full_box(out, "mfhd", 0, 0);
+    write_u32(out, ++m_sequence);
+    end_box(out, box);
+
+    for (auto &track : tracks)
+    {
+        if (track.samples.empty())
+            continue;
+
+        size_t traf = begin_box(out, "traf");
+        box = begin_full_box(out, "tfhd", 0, 0x020000); // default-base-is-moof
+        write_u32(out, track.id);
+        end_box(out, box);
+
+        box = begin_full_box(out, "tfdt", 1, 0);
+        write_u64(out, static_cast<uint64_t>(track.samples.front()->dts));
+        end_box(out, box);
+
+        // data_offset、样本时长、大小、标志和有符号的组合时间偏移
+        box = begin_full_box(out, "trun", 1, 0x000f01);
+        write_u32(out, static_cast<uint32_t>(track.samples.size()));
+        track.offset_pos = out.size();
+        write_u32(out, 0);
+
+        int64_t &last_duration = track.video ? m_video_duration : m_audio_duration;
+        for (size_t i = 0; i < track.samples.size(); i++)
+        {
+            auto sample = track.samples[i];
+
+            // 最后一个视频帧持续到分段结束，音频帧时长固定，沿用上一帧的时长
+            int64_t duration = 0;
+            if (i + 1 < track.samples.size())
+                duration = track.samples[i + 1]->dts - sample->dts;
+            else if (track.video)
+                duration = end_dts - sample->dts;
+            if (duration > 0)
+                last_duration = duration;
+            else if (last_duration > 0)
+                duration = last_duration;
+            else if (!track.video && m_audio_rate > 0)
+                duration = 1024LL * SRS_MP4_TIMESCALE / m_audio_rate; // AAC每帧1024个采样
+
+            write_u32(out, static_cast<uint32_t>(duration));
+            write_u32(out, static_cast<uint32_t>(sample->data.size()));
+            write_u32(out, !track.video || sample->keyframe ? SRS_MP4_SAMPLE_SYNC : SRS_MP4_SAMPLE_NON_SYNC);
+            write_u32(out, static_cast<uint32_t>(static_cast<int32_t>(sample->pts - sample->dts)));
+        }
+        end_box(out, box);
+        end_box(out, traf);
+    }
+    end_box(out, moof);
+
+    // 样本数据按轨道依次放在mdat中，data_offset相对于moof的起始位置
+    size_t offset = out.size() - moof + 8;
+    for (auto &track : tracks)
+    {
+        if (track.samples.empty())
+            continue;
+        patch_u32(out, track.offset_pos, static_cast<uint32_t>(offset));
+        offset += track.size;
+    }
+
+    write_u32(out, static_cast<uint32_t>(8 + tracks[0].size + tracks[1].size));
+    out.append("mdat", 4);
+    for (auto &track : tracks)
+    {
+        for (auto sample : track.samples)
+            out.append(sample->data);
+    }
+}
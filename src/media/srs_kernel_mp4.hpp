@@ -0,0 +1,48 @@
+#pragma once
+
+#include "srs_kernel_codec.hpp"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// MP4轨道的时间刻度，与TS一致使用90kHz
+#define SRS_MP4_TIMESCALE         90000
+
+/**
+ * @class SrsMp4Muxer
+ * @brief 把H.264/AAC帧封装为分段MP4(fMP4)，参考ISO/IEC 14496-12
+ *
+ * 初始化段(ftyp+moov)包含解码参数，不包含样本；之后每个分段(moof+mdat)包含一组帧，
+ * 可以作为HLS的EXT-X-MAP和.m4s切片，也可以直接用于DASH。
+ * 视频和音频在同一个文件中的两个轨道，帧数据需为MP4格式(见SrsFormat::set_mp4)。
+ */
+class SrsMp4Muxer
+{
+private:
+    uint32_t m_video_track = 0;      // 视频轨道ID，0表示没有视频
+    uint32_t m_audio_track = 0;      // 音频轨道ID，0表示没有音频
+    int m_audio_rate = 0;            // 音频采样率
+    uint32_t m_sequence = 0;         // 分段序号
+    int64_t m_video_duration = 0;    // 上一个视频帧的时长，用于分段最后一帧
+    int64_t m_audio_duration = 0;    // 上一个音频帧的时长
+
+public:
+    /**
+     * @brief 写入初始化段，之后的分段使用这里的轨道
+     * @param has_video 是否包含视频轨道，需已收到视频序列头
+     * @param has_audio 是否包含音频轨道，需已收到音频序列头
+     */
+    void write_init(std::string &out, const SrsFormat &format, bool has_video, bool has_audio);
+
+    /**
+     * @brief 把一组帧封装为一个分段并写入，不属于初始化段中轨道的帧被忽略
+     * @param frames 按时间顺序的帧
+     * @param end_dts 分段结束时间(90kHz)，即下一个分段第一帧的时间，用于计算最后一个视频帧的时长
+     */
+    void write_fragment(std::string &out, const std::vector<SrsMediaFrame> &frames, int64_t end_dts);
+
+private:
+    void write_trak(std::string &out, const SrsFormat &format, uint32_t track, bool video);
+};
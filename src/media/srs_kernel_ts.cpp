@@ -0,0 +1,199 @@
+#include "srs_kernel_ts.hpp"
+
+#include <vector>
+
+using namespace std;
+
+// 33位时间戳掩码
+#define SRS_TS_TIME_MASK 0x1ffffffffLL
+
+static std::vector<uint32_t> make_crc32_table()
+{
+    std::vector<uint32_t> table(256);
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t k = i << 24;
+        for (int j = 0; j < 8; j++)
+            k = (k & 0x80000000) ? (k << 1) ^ 0x04c11db7 : (k << 1);
+        table[i] = k;
+    }
+    return table;
+}
+
+uint32_t srs_crc32_mpegts(const char *data, size_t size)
+{
+    static const std::vector<uint32_t> table = make_crc32_table();
+
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < size; i++)
+        crc = (crc << 8) ^ table[((crc >> 24) ^ static_cast<uint8_t>(data[i])) & 0xff];
+    return crc;
+}
+
+static void write_u16(std::string &out, uint16_t v)
+{
+    out.push_back(static_cast<char>(v >> 8));
+    out.push_back(static_cast<char>(v));
+}
+
+static void write_u32(std::string &out, uint32_t v)
+{
+    out.push_back(static_cast<char>(v >> 24));
+    out.push_back(static_cast<char>(v >> 16));
+    out.push_back(static_cast<char>(v >> 8));
+    out.push_back(static_cast<char>(v));
+}
+
+// PES头中的PTS/DTS字段，flag为'0010'(只有PTS)、'0011'(PTS)或'0001'(DTS)
+static void write_timestamp(std::string &out, uint8_t flag, int64_t v)
+{
+    v &= SRS_TS_TIME_MASK;
+    out.push_back(static_cast<char>((flag << 4) | (((v >> 30) & 0x07) << 1) | 0x01));
+    out.push_back(static_cast<char>((v >> 22) & 0xff));
+    out.push_back(static_cast<char>((((v >> 15) & 0x7f) << 1) | 0x01));
+    out.push_back(static_cast<char>((v >> 7) & 0xff));
+    out.push_back(static_cast<char>(((v & 0x7f) << 1) | 0x01));
+}
+
+uint8_t SrsTsMuxer::next_counter(uint16_t pid)
+{
+    uint8_t &cc = m_counters[pid];
+    uint8_t v = cc;
+    cc = (cc + 1) & 0x0f;
+    return v;
+}
+
+void SrsTsMuxer::write_section(std::string &out, uint16_t pid, const std::string &section)
+{
+    size_t start = out.size();
+    out.push_back(0x47);
+    out.push_back(static_cast<char>(0x40 | ((pid >> 8) & 0x1f))); // payload_unit_start_indicator
+    out.push_back(static_cast<char>(pid & 0xff));
+    out.push_back(static_cast<char>(0x10 | next_counter(pid)));   // 只有负载
+    out.push_back(0x00);                                            // pointer_field
+    out.append(section);
+    write_u32(out, srs_crc32_mpegts(section.data(), section.size()));
+    out.append(SRS_TS_PACKET_SIZE - (out.size() - start), static_cast<char>(0xff));
+}
+
+void SrsTsMuxer::write_pat_pmt(std::string &out, bool has_video, bool has_audio)
+{
+    // PAT，只有一个节目
+    std::string pat;
+    pat.push_back(0x00);     // table_id
+    write_u16(pat, 0xb000 | 13);
+    write_u16(pat, 0x0001);  // transport_stream_id
+    pat.push_back(static_cast<char>(0xc1)); // version 0, current_next_indicator
+    pat.push_back(0x00);     // section_number
+    pat.push_back(0x00);     // last_section_number
+    write_u16(pat, 0x0001);  // program_number
+    write_u16(pat, 0xe000 | SRS_TS_PID_PMT);
+    write_section(out, SRS_TS_PID_PAT, pat);
+
+    // PMT
+    int nb_streams = (has_video ? 1 : 0) + (has_audio ? 1 : 0);
+    std::string pmt;
+    pmt.push_back(0x02);     // table_id
+    write_u16(pmt, 0xb000 | (13 + 5 * nb_streams));
+    write_u16(pmt, 0x0001);  // program_number
+    pmt.push_back(static_cast<char>(0xc1));
+    pmt.push_back(0x00);
+    pmt.push_back(0x00);
+    write_u16(pmt, 0xe000 | (has_video ? SRS_TS_PID_VIDEO : SRS_TS_PID_AUDIO)); // PCR_PID
+    write_u16(pmt, 0xf000);  // program_info_length
+    if (has_video)
+    {
+        pmt.push_back(SrsTsStreamVideoH264);
+        write_u16(pmt, 0xe000 | SRS_TS_PID_VIDEO);
+        write_u16(pmt, 0xf000);
+    }
+    if (has_audio)
+    {
+        pmt.push_back(SrsTsStreamAudioAAC);
+        write_u16(pmt, 0xe000 | SRS_TS_PID_AUDIO);
+        write_u16(pmt, 0xf000);
+    }
+    write_section(out, SRS_TS_PID_PMT, pmt);
+}
+
+void SrsTsMuxer::write_frame(std::string &out, const SrsMediaFrame &frame, bool pcr)
+{
+    bool has_dts = frame.pts != frame.dts;
+    size_t header_size = has_dts ? 10 : 5;
+
+    std::string pes;
+    pes.reserve(frame.data.size() + 19);
+    pes.append("\x00\x00\x01", 3);
+    pes.push_back(static_cast<char>(frame.is_video ? 0xe0 : 0xc0));
+
+    // 视频PES可能超过65535字节，长度填0表示不限定
+    size_t pes_length = 3 + header_size + frame.data.size();
+    write_u16(pes, (frame.is_video || pes_length > 0xffff) ? 0 : static_cast<uint16_t>(pes_length));
+    pes.push_back(static_cast<char>(0x80));
+    pes.push_back(static_cast<char>(has_dts ? 0xc0 : 0x80));
+    pes.push_back(static_cast<char>(header_size));
+    write_timestamp(pes, has_dts ? 0x03 : 0x02, frame.pts);
+    if (has_dts)
+        write_timestamp(pes, 0x01, frame.dts);
+    pes.append(frame.data);
+
+    write_pes(out, frame.is_video ? SRS_TS_PID_VIDEO : SRS_TS_PID_AUDIO, pes, pcr, frame.dts,
+              frame.is_video && frame.keyframe);
+}
+
+void SrsTsMuxer::write_pes(std::string &out, uint16_t pid, const std::string &pes, bool pcr, int64_t pcr_value,
+                           bool keyframe)
+{
+    size_t pos = 0;
+    bool first = true;
+
+    while (pos < pes.size())
+    {
+        size_t left = pes.size() - pos;
+
+        // 自适应字段长度，包含长度字节本身
+        size_t af_size = 0;
+        bool write_pcr = first && pcr;
+        bool random_access = first && keyframe;
+        if (write_pcr)
+            af_size = 8;
+        else if (random_access)
+            af_size = 2;
+
+        // 最后一个包负载不足时用自适应字段填充
+        if (left < 184 - af_size)
+            af_size = 184 - left;
+        size_t payload = 184 - af_size;
+
+        out.push_back(0x47);
+        out.push_back(static_cast<char>((first ? 0x40 : 0x00) | ((pid >> 8) & 0x1f)));
+        out.push_back(static_cast<char>(pid & 0xff));
+        out.push_back(static_cast<char>((af_size > 0 ? 0x30 : 0x10) | next_counter(pid)));
+
+        if (af_size > 0)
+        {
+            size_t start = out.size();
+            out.push_back(static_cast<char>(af_size - 1));
+            if (af_size > 1)
+            {
+                out.push_back(static_cast<char>((random_access ? 0x40 : 0x00) | (write_pcr ? 0x10 : 0x00)));
+                if (write_pcr)
+                {
+                    // PCR基准为33位90kHz时钟，扩展部分填0
+                    int64_t base = pcr_value & SRS_TS_TIME_MASK;
+                    out.push_back(static_cast<char>(base >> 25));
+                    out.push_back(static_cast<char>(base >> 17));
+                    out.push_back(static_cast<char>(base >> 9));
+                    out.push_back(static_cast<char>(base >> 1));
+                    out.push_back(static_cast<char>(((base & 0x01) << 7) | 0x7e));
+                    out.push_back(0x00);
+                }
+            }
+            out.append(af_size - (out.size() - start), static_cast<char>(0xff));
+        }
+
+        out.append(pes, pos, payload);
+        pos += payload;
+        first = false;
+    }
+}
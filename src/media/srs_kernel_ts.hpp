@@ -0,0 +1,56 @@
+#pragma once
+
+#include "srs_kernel_codec.hpp"
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+// TS包大小
+#define SRS_TS_PACKET_SIZE        188
+
+// TS流PID
+#define SRS_TS_PID_PAT            0x0000
+#define SRS_TS_PID_PMT            0x1000
+#define SRS_TS_PID_VIDEO          0x0100
+#define SRS_TS_PID_AUDIO          0x0101
+
+// PMT中的流类型
+#define SrsTsStreamVideoH264      0x1b
+#define SrsTsStreamAudioAAC       0x0f
+
+/**
+ * @class SrsTsMuxer
+ * @brief 把H.264/AAC帧封装为MPEG-TS，参考ISO/IEC 13818-1
+ *
+ * 输出追加到调用者提供的缓冲区，每个切片开头需要先写PAT/PMT。
+ * 连续计数器在整个流中保持递增，切片之间可以无缝拼接。
+ */
+class SrsTsMuxer
+{
+private:
+    std::map<uint16_t, uint8_t> m_counters; // PID到连续计数器
+
+public:
+    /**
+     * @brief 写入PAT和PMT
+     * @param has_video PMT中是否包含视频流
+     * @param has_audio PMT中是否包含音频流
+     */
+    void write_pat_pmt(std::string &out, bool has_video, bool has_audio);
+
+    /**
+     * @brief 把一帧封装为PES并写入
+     * @param pcr 是否在第一个TS包中携带PCR，通常在视频帧上携带
+     */
+    void write_frame(std::string &out, const SrsMediaFrame &frame, bool pcr);
+
+private:
+    void write_section(std::string &out, uint16_t pid, const std::string &section);
+    void write_pes(std::string &out, uint16_t pid, const std::string &pes, bool pcr, int64_t pcr_value, bool keyframe);
+    uint8_t next_counter(uint16_t pid);
+};
+
+// MPEG-2 CRC32，用于PSI表
+uint32_t srs_crc32_mpegts(const char *data, size_t size);
@@ -1,6 +1,7 @@
 
 #include "srs_app_ffmpeg.hpp"
 #include "srs_app_process.hpp"
+#include "../common/app_config.h"
 
 #include <stdlib.h>
 
@@ -122,15 +123,28 @@ srs_error_t SrsFFMPEG::start()
     params.push_back("-acodec");
     params.push_back("copy");
 
-    // 配置HLS输出参数
+    // 配置HLS输出参数，切片时长和列表长度与内置引擎使用相同的配置项
+    auto &conf = AppConfig::getinstance();
     params.push_back("-f");
     params.push_back("hls");
     params.push_back("-hls_flags");
     params.push_back("delete_segments");
     params.push_back("-segment_list_size");
     params.push_back("8");
+    params.push_back("-hls_time");
+    params.push_back(std::to_string(conf.get_int("hls_time", 2)));
     params.push_back("-hls_list_size");
-    params.push_back("5");
+    params.push_back(std::to_string(conf.get_int("hls_list_size", 5)));
+    // 切片序号从当前时间开始，重启后不会与旧切片重名，切片可以被HTTP缓存长期缓存
+    params.push_back("-start_number");
+    params.push_back(std::to_string(time(0)));
+    // fMP4切片：初始化段init.mp4，切片hls<序号>.m4s
+    if (segment_type == "fmp4") {
+        params.push_back("-hls_segment_type");
+        params.push_back("fmp4");
+        params.push_back("-hls_fmp4_init_filename");
+        params.push_back("init.mp4");
+    }
     
     // 设置输出路径
     params.push_back(_output);
@@ -155,6 +169,15 @@ srs_error_t SrsFFMPEG::start()
     return process->start();
 }
 
+/**
+ * @brief FFmpeg进程是否在运行
+ * @return 进程已启动且未退出返回true
+ */
+bool SrsFFMPEG::started()
+{
+    return process->started();
+}
+
 /**
  * @brief 循环检查FFmpeg进程状态
  * @return 成功返回srs_success，失败返回错误码
@@ -189,4 +212,22 @@ void SrsFFMPEG::fast_stop()
 void SrsFFMPEG::fast_kill()
 {
     process->fast_kill();
-}
\ No newline at end of file
+}
+
+/**
+ * @brief 设置FFmpeg进程退出时的通知
+ * @param handler 进程退出并被回收后调用
+ */
+void SrsFFMPEG::set_exit_handler(std::function<void()> handler)
+{
+    process->set_exit_handler(handler);
+}
+
+/**
+ * @brief 设置切片格式
+ * @param type ts或fmp4，下次启动时生效
+ */
+void SrsFFMPEG::set_segment_type(const std::string &type)
+{
+    segment_type = type;
+}
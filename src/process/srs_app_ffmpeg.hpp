@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../common/srs_common.h"
+#include "srs_app_ingester.hpp"
 
 #include <vector>
 #include <string>
@@ -16,7 +17,7 @@ class SrsProcess;
  * 该类负责管理FFmpeg进程的生命周期，包括启动、停止和参数配置。
  * 主要用于将RTMP流转换为HLS流，支持设置输入输出路径、日志文件等参数。
  */
-class SrsFFMPEG
+class SrsFFMPEG : public ISrsIngester
 {
 private:
     SrsProcess* process;        ///< FFmpeg进程管理对象
@@ -29,6 +30,7 @@ private:
     std::string iformat;       ///< 输入格式
     std::string _input;        ///< 输入URL或文件路径
     std::string _output;       ///< 输出URL或文件路径
+    std::string segment_type;  ///< 切片格式：ts或fmp4
 
 public:
     /**
@@ -68,6 +70,12 @@ public:
      * @return 成功返回srs_success，否则返回具体错误码
      */
     virtual srs_error_t start();
+
+    /**
+     * @brief FFmpeg进程是否在运行
+     * @return 进程已启动且cycle尚未发现其退出时返回true
+     */
+    virtual bool started();
     
     /**
      * @brief 循环检查FFmpeg进程状态
@@ -92,6 +100,18 @@ public:
      * 发送SIGKILL信号立即终止进程
      */
     virtual void fast_kill();
+
+    /**
+     * @brief 设置FFmpeg进程退出时的通知
+     * 在进程回收线程中调用
+     */
+    virtual void set_exit_handler(std::function<void()> handler);
+
+    /**
+     * @brief 设置切片格式
+     * @param type ts输出MPEG-TS切片，fmp4输出init.mp4和.m4s切片
+     */
+    virtual void set_segment_type(const std::string &type);
 };
 
 
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "../common/srs_common.h"
+
+#include <functional>
+#include <string>
+
+/**
+ * @class ISrsIngester
+ * @brief 拉流转HLS的后端接口
+ *
+ * 生命周期与SrsProcess一致：start启动，cycle定期检查状态，
+ * 异常结束后cycle返回错误，调用者可以再次start重新拉流。
+ */
+class ISrsIngester
+{
+public:
+    virtual ~ISrsIngester() {}
+
+    /**
+     * @brief 初始化参数
+     * @param in 输入RTMP地址
+     * @param out 输出m3u8文件路径
+     * @param log 日志文件路径，后端可以不使用
+     */
+    virtual srs_error_t initialize(std::string in, std::string out, std::string log) = 0;
+
+    // 启动拉流，已启动时忽略
+    virtual srs_error_t start() = 0;
+    // 是否正在拉流，cycle发现异常结束后返回false
+    virtual bool started() = 0;
+    // 检查状态，异常结束时返回错误并恢复为未启动状态
+    virtual srs_error_t cycle() = 0;
+    // 停止拉流并等待结束
+    virtual void stop() = 0;
+    // 通知停止，不等待
+    virtual void fast_stop() = 0;
+    // 立即终止，只在服务退出时使用
+    virtual void fast_kill() = 0;
+
+    // 设置切片格式：ts或fmp4，在start之前调用
+    virtual void set_segment_type(const std::string &type) = 0;
+
+    // 设置异常结束时的通知，在其他线程中调用；不支持的后端忽略，由定时cycle兜底
+    virtual void set_exit_handler(std::function<void()> /*handler*/) {}
+};
@@ -1,12 +1,17 @@
 #include "srs_app_process.hpp"
+#include "srs_app_reaper.hpp"
+#include "../utils/metrics.hpp"
 
 #include <stdlib.h>
 #include <string.h>
 
+#include <chrono>
+
 #ifndef WIN32
 #include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <spawn.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -73,6 +78,7 @@ SrsProcess::SrsProcess()
     is_started = false;
     fast_stopped = false;
     pid = -1;
+    watched = false;
 }
 
 SrsProcess::~SrsProcess() {}
@@ -81,6 +87,8 @@ int SrsProcess::get_pid() { return pid; }
 
 bool SrsProcess::started() { return is_started; }
 
+void SrsProcess::set_exit_handler(std::function<void()> handler) { exit_handler = handler; }
+
 /**
  * 初始化进程参数
  * @param binary 可执行文件路径
@@ -176,48 +184,41 @@ srs_error_t SrsProcess::initialize(string binary, vector<string> argv)
     return err;
 }
 
+#ifndef WIN32
 /**
- * 重定向进程输出到指定文件
- * @param from_file 目标文件路径
+ * 为子进程添加输出重定向
+ * @param actions posix_spawn的文件操作
+ * @param from_file 目标文件路径，为空时使用默认输出
  * @param to_fd 要重定向的文件描述符
+ * @param flags 打开文件的标志
  * @return 成功返回srs_success，失败返回错误码
  */
-srs_error_t srs_redirect_output(string from_file, int to_fd)
+srs_error_t srs_redirect_output(posix_spawn_file_actions_t *actions, string from_file, int to_fd, int flags)
 {
     srs_error_t err = srs_success;
 
-#ifndef WIN32
     // 如果未指定输出文件则使用默认输出
     if (from_file.empty())
     {
         return err;
     }
 
-    // 重定向文件描述符到指定文件
-    int fd = -1;
-    int flags = O_CREAT | O_RDWR | O_APPEND;
+    // 文件在子进程中exec之前打开，失败时posix_spawn返回错误
     mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH;
-
-    if ((fd = ::open(from_file.c_str(), flags, mode)) < 0)
+    if (posix_spawn_file_actions_addopen(actions, to_fd, from_file.c_str(), flags, mode) != 0)
     {
-        srs_warn("open process %d %s failed", to_fd, from_file.c_str());
+        srs_warn("redirect process %d %s failed", to_fd, from_file.c_str());
         return ERROR_FORK_OPEN_LOG;
     }
 
-    if (dup2(fd, to_fd) < 0)
-    {
-        srs_warn("dup2 process %d failed", to_fd);
-        return ERROR_FORK_DUP2_LOG;
-    }
-
-    ::close(fd);
-#endif
-
     return err;
 }
+#endif
 
 /**
  * 启动子进程
+ * 使用posix_spawn(glibc中为clone(CLONE_VM|CLONE_VFORK))，不复制父进程页表，
+ * 启动耗时与父进程内存大小无关；子进程中只执行文件重定向和exec，不调用日志等非异步信号安全的函数
  * @return 成功返回srs_success，失败返回错误码
  */
 srs_error_t SrsProcess::start()
@@ -233,92 +234,65 @@ srs_error_t SrsProcess::start()
     srs_info("fork process: %s", cli.c_str());
 
 #ifndef WIN32
-    // 记录日志信息
-    int cid = 0; // _srs_context->get_id();
-    int ppid = getpid();
-
-    // 创建子进程
-    if ((pid = fork()) < 0)
+    // 在父进程中准备好argv，子进程不再分配内存
+    std::vector<char *> argv;
+    for (int i = 0; i < (int)params.size(); i++)
     {
-        srs_warn("vfork process failed, cli=%s", cli.c_str());
-        return -1;
+        argv.push_back(const_cast<char *>(params[i].c_str()));
     }
-
-    // 子进程处理
-    if (pid == 0)
+    argv.push_back(NULL);
+
+    // 重定向标准输出、标准错误，标准输入重定向到/dev/null
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if ((err = srs_redirect_output(&actions, stdout_file, STDOUT_FILENO, O_CREAT | O_WRONLY | O_APPEND)) != srs_success ||
+        (err = srs_redirect_output(&actions, stderr_file, STDERR_FILENO, O_CREAT | O_WRONLY | O_APPEND)) != srs_success ||
+        (err = srs_redirect_output(&actions, "/dev/null", STDIN_FILENO, O_RDONLY)) != srs_success)
     {
-        // 忽略SIGINT和SIGTERM信号
-        signal(SIGINT, SIG_IGN);
-        signal(SIGTERM, SIG_IGN);
-
-        // 重定向标准输出
-        if ((err = srs_redirect_output(stdout_file, STDOUT_FILENO)) != srs_success)
-        {
-            srs_warn("redirect output. err:%d", err);
-            return err;
-        }
-
-        // 重定向标准错误
-        if ((err = srs_redirect_output(stderr_file, STDERR_FILENO)) != srs_success)
-        {
-            srs_warn("redirect output. err:%d", err);
-            return err;
-        }
-
-        // 重定向标准输入到/dev/null
-        if ((err = srs_redirect_output("/dev/null", STDIN_FILENO)) != srs_success)
-        {
-            srs_warn("redirect output. err:%d", err);
-            return err;
-        }
-
-        // 输出进程基本信息
-        srs_info("process ppid=%d, cid=%d, pid=%d, in=%d, out=%d, err=%d\nprocess binary=%s, cli: %s\nprocess actual "
-                 "cli: %s",
-                 ppid, cid, getpid(), STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, bin.c_str(), cli.c_str(),
-                 actual_cli.c_str());
-
-        // 准备execv参数
-        char **argv = new char *[params.size() + 1];
-        for (int i = 0; i < (int)params.size(); i++)
-        {
-            std::string &p = params[i];
-            char *v = new char[p.length() + 1];
-            argv[i] = strcpy(v, p.data());
-        }
-        argv[params.size()] = NULL;
-
-        // 执行新程序
-        int r0 = execv(bin.c_str(), argv);
-        if (r0 < 0)
-        {
-            srs_warn("fork process failed, errno=%d(%s)", errno, strerror(errno));
-        }
-        exit(r0);
+        posix_spawn_file_actions_destroy(&actions);
+        return err;
     }
 
-    // 父进程处理
-    if (pid > 0)
+    // 子进程使用独立的进程组，终端的Ctrl+C不会直接发给ffmpeg，由本进程负责停止；
+    // 恢复默认的信号掩码和处理方式，不继承父进程线程屏蔽或忽略的信号
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGTERM);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    // 创建子进程，exec失败时同样返回错误
+    auto begin = std::chrono::steady_clock::now();
+    int r0 = posix_spawn(&pid, bin.c_str(), &actions, &attr, argv.data(), environ);
+    auto elapsed = std::chrono::steady_clock::now() - begin;
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    Metrics::getinstance().on_spawn(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(), r0 == 0);
+
+    if (r0 != 0)
     {
-        // 等待子进程启动
-        srs_usleep(00 * SRS_UTIME_MILLISECONDS);
-
-        int status = 0;
-        pid_t p = waitpid(pid, &status, WNOHANG);
-
-        // 检查子进程是否启动失败
-        if ((WIFEXITED(status) && WEXITSTATUS(status) != 0))
-        {
-            printf("child process terminated. exit status is %d\n", WEXITSTATUS(status));
-            return -1;
-        }
-
-        is_started = true;
-        srs_trace("forked process, pid=%d, bin=%s, stdout=%s, stderr=%s, argv=%s", pid, bin.c_str(),
-                  stdout_file.c_str(), stderr_file.c_str(), actual_cli.c_str());
-        return err;
+        pid = -1;
+        srs_warn("spawn process failed, cli=%s, errno=%d(%s)", cli.c_str(), r0, strerror(r0));
+        return ERROR_ENCODER_FORK;
     }
 
+    // 由回收器监听进程退出，退出后立即回收并通知，不支持pidfd时由cycle轮询
+    watched = SrsProcessReaper::getinstance().watch(pid, exit_handler);
+
+    is_started = true;
+    srs_trace("forked process, pid=%d, bin=%s, stdout=%s, stderr=%s, argv=%s", pid, bin.c_str(),
+              stdout_file.c_str(), stderr_file.c_str(), actual_cli.c_str());
 #endif
 
     return err;
@@ -345,21 +319,33 @@ srs_error_t SrsProcess::cycle()
 
 #ifndef WIN32
     int status = 0;
-    pid_t p = waitpid(pid, &status, WNOHANG);
-
-    if (p < 0)
+    if (watched)
     {
-        srs_warn("process waitpid failed, pid=%d", pid);
-        return ERROR_SYSTEM_WAITPID;
+        // 回收器已经处理了退出，这里只查询记录，没有系统调用
+        if (!SrsProcessReaper::getinstance().reaped(pid, status))
+        {
+            return err;
+        }
     }
-
-    if (p == 0)
+    else
     {
-        return err;
+        pid_t p = waitpid(pid, &status, WNOHANG);
+
+        if (p < 0)
+        {
+            srs_warn("process waitpid failed, pid=%d", pid);
+            return ERROR_SYSTEM_WAITPID;
+        }
+
+        if (p == 0)
+        {
+            return err;
+        }
     }
 
     srs_trace("process pid=%d terminate, please restart it.", pid);
     is_started = false;
+    watched = false;
 #endif
 
     return err;
@@ -377,6 +363,16 @@ void SrsProcess::stop()
     }
 
 #ifndef WIN32
+    // 先取消监听，之后由这里等待进程退出；已经被回收时不需要再kill
+    if (watched && SrsProcessReaper::getinstance().unwatch(pid))
+    {
+        watched = false;
+        is_started = false;
+        pid = -1;
+        return;
+    }
+    watched = false;
+
     srs_error_t err = SrsUtil::srs_kill_forced(pid);
     if (err != srs_success)
     {
@@ -437,6 +433,13 @@ void SrsProcess::fast_kill()
         return;
     }
 
+    if (watched && SrsProcessReaper::getinstance().unwatch(pid))
+    {
+        watched = false;
+        return;
+    }
+    watched = false;
+
     if (kill(pid, SIGKILL) < 0)
     {
         ret = ERROR_SYSTEM_KILL;
@@ -2,6 +2,7 @@
 
 #include "../common/srs_common.h"
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -35,6 +36,10 @@ private:
     // Whether SIGTERM send but need to wait or SIGKILL.
     bool fast_stopped;
     pid_t pid;
+    // Whether the exit is watched by SrsProcessReaper, otherwise cycle polls by waitpid.
+    bool watched;
+    // Called in the reaper thread when the process exited.
+    std::function<void()> exit_handler;
 private:
     std::string bin;
     std::string stdout_file;
@@ -56,6 +61,9 @@ public:
     // @param argv the argv for binary path, the argv[0] generally is the binary.
     // @remark the argv[0] must be the binary.
     virtual srs_error_t initialize(std::string binary, std::vector<std::string> argv);
+    // Set the callback when process exited, for the owner to restart it immediately.
+    // @remark the handler is called in the reaper thread, and only when pidfd is supported.
+    virtual void set_exit_handler(std::function<void()> handler);
 public:
     // Start the process, ignore when already started.
     virtual srs_error_t start();
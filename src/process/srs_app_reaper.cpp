@@ -0,0 +1,164 @@
+#include "srs_app_reaper.hpp"
+#include "../common/logger.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <thread>
+
+using namespace std;
+
+// glibc 2.36之前没有pidfd_open的封装
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+static int srs_pidfd_open(pid_t pid)
+{
+    return static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+}
+
+SrsProcessReaper::SrsProcessReaper()
+{
+    m_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epfd < 0)
+    {
+        auto logger = MyLogger::getLogger("reaper");
+        LOG_WARN(logger, "epoll create failed, errno=%d(%s)", errno, strerror(errno));
+    }
+}
+
+SrsProcessReaper::~SrsProcessReaper()
+{
+    // 回收线程与进程同生命周期，这里不关闭句柄
+}
+
+bool SrsProcessReaper::watch(pid_t pid, ExitHandler handler)
+{
+    if (m_epfd < 0 || pid <= 0)
+        return false;
+
+    int pidfd = srs_pidfd_open(pid);
+    if (pidfd < 0)
+    {
+        auto logger = MyLogger::getLogger("reaper");
+        LOG_WARN(logger, "pidfd open failed, pid=%d, errno=%d(%s)", pid, errno, strerror(errno));
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = pidfd;
+    if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, pidfd, &ev) < 0)
+    {
+        ::close(pidfd);
+        return false;
+    }
+
+    m_watches[pidfd] = Watch{pid, handler};
+    m_pid2fd[pid] = pidfd;
+    m_exited.erase(pid);
+
+    // 首次监听时启动后台线程
+    if (!m_started)
+    {
+        m_started = true;
+        std::thread([this]() { run(); }).detach();
+    }
+    return true;
+}
+
+bool SrsProcessReaper::unwatch(pid_t pid)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto iter = m_pid2fd.find(pid);
+    if (iter != m_pid2fd.end())
+    {
+        epoll_ctl(m_epfd, EPOLL_CTL_DEL, iter->second, NULL);
+        ::close(iter->second);
+        m_watches.erase(iter->second);
+        m_pid2fd.erase(iter);
+        return false;
+    }
+
+    return m_exited.erase(pid) > 0;
+}
+
+bool SrsProcessReaper::reaped(pid_t pid, int &status)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto iter = m_exited.find(pid);
+    if (iter == m_exited.end())
+        return false;
+
+    status = iter->second;
+    m_exited.erase(iter);
+    return true;
+}
+
+void SrsProcessReaper::run()
+{
+    struct epoll_event events[64];
+    while (true)
+    {
+        int n = epoll_wait(m_epfd, events, 64, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            auto logger = MyLogger::getLogger("reaper");
+            LOG_ERROR(logger, "epoll wait failed, errno=%d(%s)", errno, strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < n; i++)
+            on_exit(events[i].data.fd);
+    }
+}
+
+void SrsProcessReaper::on_exit(int pidfd)
+{
+    ExitHandler handler;
+    pid_t pid = -1;
+    int status = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // 事件返回后可能已经被unwatch
+        auto iter = m_watches.find(pidfd);
+        if (iter == m_watches.end())
+            return;
+
+        pid = iter->second.pid;
+        pid_t r = ::waitpid(pid, &status, WNOHANG);
+        if (r == 0)
+            return;
+        if (r < 0)
+            status = 0;
+
+        epoll_ctl(m_epfd, EPOLL_CTL_DEL, pidfd, NULL);
+        ::close(pidfd);
+        handler = iter->second.handler;
+        m_watches.erase(iter);
+        m_pid2fd.erase(pid);
+        m_exited[pid] = status;
+    }
+
+    auto logger = MyLogger::getLogger("reaper");
+    if (WIFSIGNALED(status))
+        LOG_INFO(logger, "process pid=%d killed by signal %d", pid, WTERMSIG(status));
+    else
+        LOG_INFO(logger, "process pid=%d exited, status=%d", pid, WEXITSTATUS(status));
+
+    if (handler)
+        handler();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "../common/srs_common.h"
+
+#include <functional>
+#include <map>
+#include <mutex>
+
+/**
+ * @class SrsProcessReaper
+ * @brief 基于pidfd和epoll的子进程回收器
+ *
+ * 每个子进程对应一个pidfd，进程退出时pidfd可读，后台线程立即回收并通知注册者，
+ * 没有进程退出时不产生任何系统调用。内核不支持pidfd(低于5.3)时watch返回false，
+ * 调用者继续使用waitpid轮询。
+ *
+ * 回调在回收线程中执行，执行时不持有回收器的锁。
+ */
+class SrsProcessReaper
+{
+public:
+    using ExitHandler = std::function<void()>;
+
+private:
+    SrsProcessReaper();
+
+    struct Watch
+    {
+        pid_t pid;
+        ExitHandler handler;
+    };
+
+    int m_epfd = -1;
+    std::mutex m_mutex;                  // 保护以下成员
+    bool m_started = false;              // 回收线程是否已启动
+    std::map<int, Watch> m_watches;      // pidfd到进程
+    std::map<pid_t, int> m_pid2fd;       // 进程到pidfd
+    std::map<pid_t, int> m_exited;       // 已回收但调用者还没有取走的进程及其退出状态
+
+    void run();
+    void on_exit(int pidfd);
+
+public:
+    static SrsProcessReaper &getinstance()
+    {
+        static SrsProcessReaper instance;
+        return instance;
+    }
+    ~SrsProcessReaper();
+
+    /**
+     * @brief 开始监听子进程退出
+     * @param handler 进程退出并被回收后调用，可以为空
+     * @return 内核不支持pidfd或创建失败时返回false
+     */
+    bool watch(pid_t pid, ExitHandler handler);
+
+    /**
+     * @brief 取消监听，之后由调用者自己回收进程
+     * @return 进程已经被回收时返回true，同时清除退出记录
+     */
+    bool unwatch(pid_t pid);
+
+    /**
+     * @brief 进程是否已经被回收，不产生系统调用
+     * @param status 退出状态，与waitpid相同
+     * @return 已回收时返回true，同时清除退出记录
+     */
+    bool reaped(pid_t pid, int &status);
+};
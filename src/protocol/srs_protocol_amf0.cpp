@@ -0,0 +1,276 @@
+#include "srs_protocol_amf0.hpp"
+
+#include <string.h>
+
+using namespace std;
+
+// 嵌套层数上限，防止恶意数据导致栈溢出
+#define SRS_AMF0_MAX_DEPTH 16
+
+static void write_u16(std::string &out, uint16_t v)
+{
+    out.push_back(static_cast<char>(v >> 8));
+    out.push_back(static_cast<char>(v));
+}
+
+static void write_utf8(std::string &out, const std::string &v)
+{
+    write_u16(out, static_cast<uint16_t>(v.size()));
+    out.append(v);
+}
+
+static bool read_u16(const char *&p, const char *end, uint16_t &v)
+{
+    if (end - p < 2)
+        return false;
+    v = static_cast<uint16_t>((static_cast<uint8_t>(p[0]) << 8) | static_cast<uint8_t>(p[1]));
+    p += 2;
+    return true;
+}
+
+static bool read_u32(const char *&p, const char *end, uint32_t &v)
+{
+    if (end - p < 4)
+        return false;
+    v = (static_cast<uint32_t>(static_cast<uint8_t>(p[0])) << 24) |
+        (static_cast<uint32_t>(static_cast<uint8_t>(p[1])) << 16) |
+        (static_cast<uint32_t>(static_cast<uint8_t>(p[2])) << 8) | static_cast<uint32_t>(static_cast<uint8_t>(p[3]));
+    p += 4;
+    return true;
+}
+
+static bool read_utf8(const char *&p, const char *end, std::string &v)
+{
+    uint16_t len = 0;
+    if (!read_u16(p, end, len) || end - p < len)
+        return false;
+    v.assign(p, len);
+    p += len;
+    return true;
+}
+
+static bool read_any(SrsAmf0Any &v, const char *&p, const char *end, int depth);
+
+// 读取对象属性，直到遇到空键名和ObjectEnd标记
+static bool read_props(SrsAmf0Any &v, const char *&p, const char *end, int depth)
+{
+    for (;;)
+    {
+        std::string key;
+        if (!read_utf8(p, end, key))
+            return false;
+
+        if (key.empty() && p < end && *p == RTMP_AMF0_ObjectEnd)
+        {
+            p++;
+            return true;
+        }
+
+        SrsAmf0Any value;
+        if (!read_any(value, p, end, depth + 1))
+            return false;
+        v.props.push_back(std::make_pair(key, value));
+    }
+}
+
+static bool read_any(SrsAmf0Any &v, const char *&p, const char *end, int depth)
+{
+    if (p >= end || depth > SRS_AMF0_MAX_DEPTH)
+        return false;
+
+    v = SrsAmf0Any();
+    v.marker = *p++;
+
+    switch (v.marker)
+    {
+    case RTMP_AMF0_Number:
+    {
+        if (end - p < 8)
+            return false;
+        uint64_t bits = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            bits = (bits << 8) | static_cast<uint8_t>(p[i]);
+        }
+        memcpy(&v.number, &bits, 8);
+        p += 8;
+        return true;
+    }
+    case RTMP_AMF0_Boolean:
+        if (p >= end)
+            return false;
+        v.boolean = *p++ != 0;
+        return true;
+    case RTMP_AMF0_String:
+        return read_utf8(p, end, v.str);
+    case RTMP_AMF0_LongString:
+    {
+        uint32_t len = 0;
+        if (!read_u32(p, end, len) || static_cast<uint32_t>(end - p) < len)
+            return false;
+        v.str.assign(p, len);
+        p += len;
+        return true;
+    }
+    case RTMP_AMF0_Object:
+        return read_props(v, p, end, depth);
+    case RTMP_AMF0_EcmaArray:
+    {
+        uint32_t count = 0;
+        if (!read_u32(p, end, count))
+            return false;
+        return read_props(v, p, end, depth);
+    }
+    case RTMP_AMF0_StrictArray:
+    {
+        uint32_t count = 0;
+        if (!read_u32(p, end, count))
+            return false;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            SrsAmf0Any item;
+            if (!read_any(item, p, end, depth + 1))
+                return false;
+            v.items.push_back(item);
+        }
+        return true;
+    }
+    case RTMP_AMF0_Date:
+        // 8字节时间戳加2字节时区
+        if (end - p < 10)
+            return false;
+        p += 10;
+        return true;
+    case RTMP_AMF0_Null:
+    case RTMP_AMF0_Undefined:
+        return true;
+    default:
+        return false;
+    }
+}
+
+SrsAmf0Any SrsAmf0Any::make_number(double v)
+{
+    SrsAmf0Any any;
+    any.marker = RTMP_AMF0_Number;
+    any.number = v;
+    return any;
+}
+
+SrsAmf0Any SrsAmf0Any::make_boolean(bool v)
+{
+    SrsAmf0Any any;
+    any.marker = RTMP_AMF0_Boolean;
+    any.boolean = v;
+    return any;
+}
+
+SrsAmf0Any SrsAmf0Any::make_string(const std::string &v)
+{
+    SrsAmf0Any any;
+    any.marker = RTMP_AMF0_String;
+    any.str = v;
+    return any;
+}
+
+SrsAmf0Any SrsAmf0Any::make_object()
+{
+    SrsAmf0Any any;
+    any.marker = RTMP_AMF0_Object;
+    return any;
+}
+
+SrsAmf0Any SrsAmf0Any::make_null()
+{
+    return SrsAmf0Any();
+}
+
+SrsAmf0Any &SrsAmf0Any::set(const std::string &key, const SrsAmf0Any &value)
+{
+    for (auto &prop : props)
+    {
+        if (prop.first == key)
+        {
+            prop.second = value;
+            return *this;
+        }
+    }
+    props.push_back(std::make_pair(key, value));
+    return *this;
+}
+
+const SrsAmf0Any *SrsAmf0Any::get(const std::string &key) const
+{
+    for (auto &prop : props)
+    {
+        if (prop.first == key)
+            return &prop.second;
+    }
+    return nullptr;
+}
+
+std::string SrsAmf0Any::get_string(const std::string &key) const
+{
+    auto v = get(key);
+    return (v && v->is_string()) ? v->str : std::string();
+}
+
+void SrsAmf0Any::write(std::string &out) const
+{
+    switch (marker)
+    {
+    case RTMP_AMF0_Number:
+    {
+        out.push_back(RTMP_AMF0_Number);
+        uint64_t bits = 0;
+        memcpy(&bits, &number, 8);
+        for (int i = 7; i >= 0; i--)
+        {
+            out.push_back(static_cast<char>(bits >> (i * 8)));
+        }
+        break;
+    }
+    case RTMP_AMF0_Boolean:
+        out.push_back(RTMP_AMF0_Boolean);
+        out.push_back(boolean ? 1 : 0);
+        break;
+    case RTMP_AMF0_String:
+    case RTMP_AMF0_LongString:
+        out.push_back(RTMP_AMF0_String);
+        write_utf8(out, str);
+        break;
+    case RTMP_AMF0_Object:
+    case RTMP_AMF0_EcmaArray:
+        out.push_back(RTMP_AMF0_Object);
+        for (auto &prop : props)
+        {
+            write_utf8(out, prop.first);
+            prop.second.write(out);
+        }
+        write_u16(out, 0);
+        out.push_back(RTMP_AMF0_ObjectEnd);
+        break;
+    default:
+        out.push_back(RTMP_AMF0_Null);
+        break;
+    }
+}
+
+bool SrsAmf0Any::read(const char *&p, const char *end)
+{
+    return read_any(*this, p, end, 0);
+}
+
+bool srs_amf0_read_all(const std::string &data, std::vector<SrsAmf0Any> &values)
+{
+    const char *p = data.data();
+    const char *end = p + data.size();
+    while (p < end)
+    {
+        SrsAmf0Any v;
+        if (!v.read(p, end))
+            return false;
+        values.push_back(v);
+    }
+    return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// AMF0 marker，参考 Action Message Format -- AMF 0
+#define RTMP_AMF0_Number      0x00
+#define RTMP_AMF0_Boolean     0x01
+#define RTMP_AMF0_String      0x02
+#define RTMP_AMF0_Object      0x03
+#define RTMP_AMF0_Null        0x05
+#define RTMP_AMF0_Undefined   0x06
+#define RTMP_AMF0_EcmaArray   0x08
+#define RTMP_AMF0_ObjectEnd   0x09
+#define RTMP_AMF0_StrictArray 0x0A
+#define RTMP_AMF0_Date        0x0B
+#define RTMP_AMF0_LongString  0x0C
+
+/**
+ * @class SrsAmf0Any
+ * @brief AMF0任意类型的值，RTMP命令消息只用到其中很少的类型
+ * Object和EcmaArray的属性按出现顺序保存在props中，StrictArray的元素保存在items中。
+ */
+class SrsAmf0Any
+{
+  public:
+    char marker = RTMP_AMF0_Null;
+    double number = 0;
+    bool boolean = false;
+    std::string str;
+    std::vector<std::pair<std::string, SrsAmf0Any>> props;
+    std::vector<SrsAmf0Any> items;
+
+  public:
+    static SrsAmf0Any make_number(double v);
+    static SrsAmf0Any make_boolean(bool v);
+    static SrsAmf0Any make_string(const std::string &v);
+    static SrsAmf0Any make_object();
+    static SrsAmf0Any make_null();
+
+    bool is_number() const { return marker == RTMP_AMF0_Number; }
+    bool is_string() const { return marker == RTMP_AMF0_String || marker == RTMP_AMF0_LongString; }
+    bool is_object() const { return marker == RTMP_AMF0_Object || marker == RTMP_AMF0_EcmaArray; }
+
+    // 设置或追加对象属性
+    SrsAmf0Any &set(const std::string &key, const SrsAmf0Any &value);
+    // 查找对象属性，不存在返回nullptr
+    const SrsAmf0Any *get(const std::string &key) const;
+    // 属性为字符串时返回其值，否则返回空字符串
+    std::string get_string(const std::string &key) const;
+
+    /**
+     * @brief 编码并追加到out
+     */
+    void write(std::string &out) const;
+
+    /**
+     * @brief 从[p, end)解码一个值，成功后p指向下一个值
+     * @return 数据不完整或格式错误时返回false
+     */
+    bool read(const char *&p, const char *end);
+};
+
+/**
+ * @brief 解码一段数据中的所有AMF0值，例如命令消息的负载
+ * @return 格式错误时返回false，已解码的值保留在values中
+ */
+bool srs_amf0_read_all(const std::string &data, std::vector<SrsAmf0Any> &values);
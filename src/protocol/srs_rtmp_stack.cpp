@@ -0,0 +1,337 @@
+#include "srs_rtmp_stack.hpp"
+
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+
+using namespace std;
+
+uint32_t srs_rtmp_read_u32(const char *p)
+{
+    return (static_cast<uint32_t>(static_cast<uint8_t>(p[0])) << 24) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(p[1])) << 16) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(p[2])) << 8) | static_cast<uint32_t>(static_cast<uint8_t>(p[3]));
+}
+
+uint32_t srs_rtmp_read_u24(const char *p)
+{
+    return (static_cast<uint32_t>(static_cast<uint8_t>(p[0])) << 16) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(p[1])) << 8) | static_cast<uint32_t>(static_cast<uint8_t>(p[2]));
+}
+
+uint16_t srs_rtmp_read_u16(const char *p)
+{
+    return static_cast<uint16_t>((static_cast<uint8_t>(p[0]) << 8) | static_cast<uint8_t>(p[1]));
+}
+
+static void write_u32(std::string &out, uint32_t v)
+{
+    out.push_back(static_cast<char>(v >> 24));
+    out.push_back(static_cast<char>(v >> 16));
+    out.push_back(static_cast<char>(v >> 8));
+    out.push_back(static_cast<char>(v));
+}
+
+static void write_u24(std::string &out, uint32_t v)
+{
+    out.push_back(static_cast<char>(v >> 16));
+    out.push_back(static_cast<char>(v >> 8));
+    out.push_back(static_cast<char>(v));
+}
+
+void SrsRtmpChunkReader::append(const char *data, size_t size)
+{
+    m_buf.append(data, size);
+}
+
+srs_error_t SrsRtmpChunkReader::read_message(SrsRtmpMessage &msg, bool &got)
+{
+    // fmt0~fmt3对应的消息头长度
+    static const size_t mh_sizes[] = {11, 7, 3, 0};
+
+    got = false;
+    srs_error_t err = srs_success;
+
+    while (!got)
+    {
+        const char *p = m_buf.data() + m_pos;
+        size_t left = m_buf.size() - m_pos;
+        if (left < 1)
+            break;
+
+        // 基本头
+        int fmt = (static_cast<uint8_t>(p[0]) >> 6) & 0x03;
+        uint32_t csid = static_cast<uint8_t>(p[0]) & 0x3f;
+        size_t bh_size = 1;
+        if (csid == 0)
+        {
+            if (left < 2)
+                break;
+            csid = 64 + static_cast<uint8_t>(p[1]);
+            bh_size = 2;
+        }
+        else if (csid == 1)
+        {
+            if (left < 3)
+                break;
+            csid = 64 + static_cast<uint8_t>(p[1]) + static_cast<uint8_t>(p[2]) * 256;
+            bh_size = 3;
+        }
+
+        size_t mh_size = mh_sizes[fmt];
+        if (left < bh_size + mh_size)
+            break;
+
+        ChunkStream &cs = m_streams[csid];
+        if (!cs.initialized && fmt > 1)
+        {
+            return ERROR_RTMP_CHUNK_START;
+        }
+
+        // 消息头
+        const char *h = p + bh_size;
+        uint32_t ts_field = fmt <= 2 ? srs_rtmp_read_u24(h) : 0;
+        bool extended = fmt <= 2 ? ts_field == 0xFFFFFF : cs.extended;
+        size_t header_size = bh_size + mh_size + (extended ? 4 : 0);
+        if (left < header_size)
+            break;
+
+        uint32_t length = cs.length;
+        uint8_t type = cs.type;
+        uint32_t stream_id = cs.stream_id;
+        if (fmt <= 1)
+        {
+            length = srs_rtmp_read_u24(h + 3);
+            type = static_cast<uint8_t>(h[6]);
+        }
+        if (fmt == 0)
+        {
+            // 消息流ID为小端
+            stream_id = static_cast<uint8_t>(h[7]) | (static_cast<uint8_t>(h[8]) << 8) |
+                        (static_cast<uint8_t>(h[9]) << 16) | (static_cast<uint32_t>(static_cast<uint8_t>(h[10])) << 24);
+        }
+        if (length > SRS_CONSTS_RTMP_MAX_MESSAGE_SIZE)
+        {
+            return ERROR_RTMP_MSG_INVALID_SIZE;
+        }
+
+        // fmt0和fmt1总是开始一个新消息，丢弃未完成的消息
+        bool new_message = cs.payload.empty() || fmt <= 1;
+        size_t received = new_message ? 0 : cs.payload.size();
+        size_t payload_size = std::min(static_cast<size_t>(m_chunk_size), static_cast<size_t>(length) - received);
+        if (left < header_size + payload_size)
+            break;
+
+        uint32_t ts_value = extended ? srs_rtmp_read_u32(p + bh_size + mh_size) : ts_field;
+        if (new_message)
+        {
+            cs.payload.clear();
+            if (fmt == 0)
+            {
+                cs.timestamp = ts_value;
+                cs.delta = ts_value;
+            }
+            else if (fmt <= 2)
+            {
+                cs.delta = ts_value;
+                cs.timestamp += ts_value;
+            }
+            else
+            {
+                cs.timestamp += cs.delta;
+            }
+            cs.length = length;
+            cs.type = type;
+            cs.stream_id = stream_id;
+        }
+        if (fmt <= 2)
+        {
+            cs.extended = extended;
+        }
+        cs.initialized = true;
+
+        cs.payload.append(p + header_size, payload_size);
+        m_pos += header_size + payload_size;
+
+        if (cs.payload.size() == cs.length)
+        {
+            msg.type = cs.type;
+            msg.timestamp = cs.timestamp;
+            msg.stream_id = cs.stream_id;
+            msg.payload.clear();
+            msg.payload.swap(cs.payload);
+            got = true;
+        }
+    }
+
+    // 回收已解析的数据
+    if (m_pos > 0 && (m_pos == m_buf.size() || m_pos > 64 * 1024))
+    {
+        m_buf.erase(0, m_pos);
+        m_pos = 0;
+    }
+
+    return err;
+}
+
+void SrsRtmpChunkWriter::write(const SrsRtmpMessage &msg, uint32_t csid, std::string &out) const
+{
+    bool extended = msg.timestamp >= 0xFFFFFF;
+    size_t pos = 0;
+    bool first = true;
+
+    do
+    {
+        // 基本头，只使用小于64的分块流ID
+        out.push_back(static_cast<char>(((first ? 0 : 3) << 6) | (csid & 0x3f)));
+        if (first)
+        {
+            write_u24(out, extended ? 0xFFFFFF : msg.timestamp);
+            write_u24(out, static_cast<uint32_t>(msg.payload.size()));
+            out.push_back(static_cast<char>(msg.type));
+            out.push_back(static_cast<char>(msg.stream_id));
+            out.push_back(static_cast<char>(msg.stream_id >> 8));
+            out.push_back(static_cast<char>(msg.stream_id >> 16));
+            out.push_back(static_cast<char>(msg.stream_id >> 24));
+        }
+        if (extended)
+        {
+            write_u32(out, msg.timestamp);
+        }
+
+        size_t size = std::min(static_cast<size_t>(m_chunk_size), msg.payload.size() - pos);
+        out.append(msg.payload, pos, size);
+        pos += size;
+        first = false;
+    } while (pos < msg.payload.size());
+}
+
+bool SrsRtmpUrl::parse(const std::string &url)
+{
+    const std::string schema = "rtmp://";
+    if (url.compare(0, schema.size(), schema))
+        return false;
+
+    auto host_end = url.find('/', schema.size());
+    if (host_end == std::string::npos)
+        return false;
+
+    host = url.substr(schema.size(), host_end - schema.size());
+    port = 1935;
+    auto colon = host.rfind(':');
+    if (colon != std::string::npos)
+    {
+        port = atoi(host.substr(colon + 1).c_str());
+        host = host.substr(0, colon);
+    }
+
+    // 最后一个'/'之前为应用名，之后为流名，查询参数之中可能包含'/'
+    auto path = url.substr(host_end + 1);
+    auto query = path.find('?');
+    auto slash = path.rfind('/', query == std::string::npos ? std::string::npos : query);
+    if (slash == std::string::npos || host.empty() || port <= 0)
+        return false;
+
+    app = path.substr(0, slash);
+    stream = path.substr(slash + 1);
+    tc_url = schema + host + ":" + std::to_string(port) + "/" + app;
+    return !app.empty() && !stream.empty();
+}
+
+static void make_random(std::string &out, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        out.push_back(static_cast<char>(rand() & 0xff));
+    }
+}
+
+void srs_rtmp_make_c0c1(std::string &out)
+{
+    out.push_back(0x03);
+    write_u32(out, static_cast<uint32_t>(time(0)));
+    write_u32(out, 0);
+    make_random(out, RTMP_HANDSHAKE_SIZE - 8);
+}
+
+void srs_rtmp_make_s0s1s2(const char *c1, std::string &out)
+{
+    out.push_back(0x03);
+    // S1
+    write_u32(out, static_cast<uint32_t>(time(0)));
+    write_u32(out, 0);
+    make_random(out, RTMP_HANDSHAKE_SIZE - 8);
+    // S2回显C1
+    out.append(c1, RTMP_HANDSHAKE_SIZE);
+}
+
+SrsRtmpMessage srs_rtmp_make_set_chunk_size(uint32_t size)
+{
+    SrsRtmpMessage msg;
+    msg.type = RTMP_MSG_SetChunkSize;
+    write_u32(msg.payload, size);
+    return msg;
+}
+
+SrsRtmpMessage srs_rtmp_make_window_ack_size(uint32_t size)
+{
+    SrsRtmpMessage msg;
+    msg.type = RTMP_MSG_WindowAcknowledgementSize;
+    write_u32(msg.payload, size);
+    return msg;
+}
+
+SrsRtmpMessage srs_rtmp_make_set_peer_bandwidth(uint32_t size, uint8_t type)
+{
+    SrsRtmpMessage msg;
+    msg.type = RTMP_MSG_SetPeerBandwidth;
+    write_u32(msg.payload, size);
+    msg.payload.push_back(static_cast<char>(type));
+    return msg;
+}
+
+SrsRtmpMessage srs_rtmp_make_acknowledgement(uint32_t sequence)
+{
+    SrsRtmpMessage msg;
+    msg.type = RTMP_MSG_Acknowledgement;
+    write_u32(msg.payload, sequence);
+    return msg;
+}
+
+SrsRtmpMessage srs_rtmp_make_user_control(uint16_t event, uint32_t data, uint32_t extra, bool has_extra)
+{
+    SrsRtmpMessage msg;
+    msg.type = RTMP_MSG_UserControlMessage;
+    msg.payload.push_back(static_cast<char>(event >> 8));
+    msg.payload.push_back(static_cast<char>(event));
+    write_u32(msg.payload, data);
+    if (has_extra)
+    {
+        write_u32(msg.payload, extra);
+    }
+    return msg;
+}
+
+SrsRtmpMessage srs_rtmp_make_command(const std::vector<SrsAmf0Any> &values, uint32_t stream_id)
+{
+    SrsRtmpMessage msg;
+    msg.type = RTMP_MSG_AMF0CommandMessage;
+    msg.stream_id = stream_id;
+    for (auto &v : values)
+    {
+        v.write(msg.payload);
+    }
+    return msg;
+}
+
+bool srs_rtmp_decode_command(const SrsRtmpMessage &msg, std::vector<SrsAmf0Any> &values)
+{
+    // AMF3命令消息的第一个字节为0，之后按AMF0编码
+    std::string payload = msg.payload;
+    if (msg.type == RTMP_MSG_AMF3CommandMessage && !payload.empty())
+        payload.erase(0, 1);
+
+    srs_amf0_read_all(payload, values);
+    return values.size() >= 2 && values[0].is_string() && values[1].is_number();
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "../common/srs_common.h"
+#include "srs_protocol_amf0.hpp"
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// RTMP消息类型
+#define RTMP_MSG_SetChunkSize          0x01
+#define RTMP_MSG_AbortMessage          0x02
+#define RTMP_MSG_Acknowledgement       0x03
+#define RTMP_MSG_UserControlMessage    0x04
+#define RTMP_MSG_WindowAcknowledgementSize 0x05
+#define RTMP_MSG_SetPeerBandwidth      0x06
+#define RTMP_MSG_AudioMessage          0x08
+#define RTMP_MSG_VideoMessage          0x09
+#define RTMP_MSG_AMF3DataMessage       0x0F
+#define RTMP_MSG_AMF3CommandMessage    0x11
+#define RTMP_MSG_AMF0DataMessage       0x12
+#define RTMP_MSG_AMF0CommandMessage    0x14
+#define RTMP_MSG_AggregateMessage      0x16
+
+// 用户控制消息事件类型
+#define SrcPCUCStreamBegin             0x00
+#define SrcPCUCSetBufferLength         0x03
+#define SrcPCUCPingRequest             0x06
+#define SrcPCUCPingResponse            0x07
+
+// 分块流ID
+#define RTMP_CID_ProtocolControl       0x02
+#define RTMP_CID_OverConnection        0x03
+#define RTMP_CID_OverStream            0x05
+#define RTMP_CID_Video                 0x06
+#define RTMP_CID_Audio                 0x07
+
+// 握手数据长度
+#define RTMP_HANDSHAKE_SIZE            1536
+// 默认分块大小
+#define SRS_CONSTS_RTMP_PROTOCOL_CHUNK_SIZE 128
+// 发送时使用的分块大小，减少分块头开销
+#define SRS_CONSTS_RTMP_SRS_CHUNK_SIZE 60000
+// 单个消息的大小上限，防止异常数据占用过多内存
+#define SRS_CONSTS_RTMP_MAX_MESSAGE_SIZE (16 * 1024 * 1024)
+// 默认确认窗口大小
+#define SRS_CONSTS_RTMP_ACK_WINDOW     2500000
+
+/**
+ * @brief RTMP消息
+ */
+struct SrsRtmpMessage
+{
+    uint8_t type = 0;        // 消息类型
+    uint32_t timestamp = 0;  // 时间戳(ms)
+    uint32_t stream_id = 0;  // 消息流ID
+    std::string payload;     // 消息负载
+};
+
+/**
+ * @class SrsRtmpChunkReader
+ * @brief 分块流解析，输入任意长度的数据，输出完整的消息
+ */
+class SrsRtmpChunkReader
+{
+  private:
+    struct ChunkStream
+    {
+        bool initialized = false;
+        bool extended = false;  // 上一个分块头是否带扩展时间戳
+        uint8_t type = 0;
+        uint32_t timestamp = 0;
+        uint32_t delta = 0;
+        uint32_t length = 0;
+        uint32_t stream_id = 0;
+        std::string payload;    // 正在组装的消息
+    };
+
+    std::map<uint32_t, ChunkStream> m_streams; // 分块流ID到状态
+    std::string m_buf;                         // 未解析的数据
+    size_t m_pos = 0;                          // m_buf中已解析的位置
+    uint32_t m_chunk_size = SRS_CONSTS_RTMP_PROTOCOL_CHUNK_SIZE;
+
+  public:
+    void set_chunk_size(uint32_t size) { m_chunk_size = size; }
+
+    // 追加收到的数据
+    void append(const char *data, size_t size);
+
+    /**
+     * @brief 解析出一个完整消息
+     * @param got 解析出消息时为true，数据不足时为false
+     * @return 格式错误返回错误码
+     */
+    srs_error_t read_message(SrsRtmpMessage &msg, bool &got);
+};
+
+/**
+ * @class SrsRtmpChunkWriter
+ * @brief 把消息编码为分块，第一个分块使用fmt0，后续分块使用fmt3
+ */
+class SrsRtmpChunkWriter
+{
+  private:
+    uint32_t m_chunk_size = SRS_CONSTS_RTMP_PROTOCOL_CHUNK_SIZE;
+
+  public:
+    void set_chunk_size(uint32_t size) { m_chunk_size = size; }
+    void write(const SrsRtmpMessage &msg, uint32_t csid, std::string &out) const;
+};
+
+/**
+ * @brief RTMP地址，例如rtmp://host:1935/app/stream?token=xxx
+ */
+struct SrsRtmpUrl
+{
+    std::string host;
+    int port = 1935;
+    std::string app;    // 应用名，可能包含多级路径
+    std::string stream; // 流名，包含查询参数
+    std::string tc_url; // rtmp://host:port/app
+
+    bool parse(const std::string &url);
+};
+
+// 简单握手：C0C1、S0S1S2、C2都不校验摘要，ffmpeg、SRS、nginx-rtmp均支持
+void srs_rtmp_make_c0c1(std::string &out);
+void srs_rtmp_make_s0s1s2(const char *c1, std::string &out);
+
+// 协议控制消息
+SrsRtmpMessage srs_rtmp_make_set_chunk_size(uint32_t size);
+SrsRtmpMessage srs_rtmp_make_window_ack_size(uint32_t size);
+SrsRtmpMessage srs_rtmp_make_set_peer_bandwidth(uint32_t size, uint8_t type);
+SrsRtmpMessage srs_rtmp_make_acknowledgement(uint32_t sequence);
+SrsRtmpMessage srs_rtmp_make_user_control(uint16_t event, uint32_t data, uint32_t extra = 0, bool has_extra = false);
+
+/**
+ * @brief 构造AMF0命令消息
+ * @param values 命令名、事务ID以及后续参数
+ */
+SrsRtmpMessage srs_rtmp_make_command(const std::vector<SrsAmf0Any> &values, uint32_t stream_id = 0);
+
+/**
+ * @brief 解码AMF0/AMF3命令消息
+ * @param values 命令名、事务ID以及后续参数
+ * @return 至少解析出命令名和事务ID时返回true
+ */
+bool srs_rtmp_decode_command(const SrsRtmpMessage &msg, std::vector<SrsAmf0Any> &values);
+
+// 读取大端整数
+uint32_t srs_rtmp_read_u32(const char *p);
+uint32_t srs_rtmp_read_u24(const char *p);
+uint16_t srs_rtmp_read_u16(const char *p);
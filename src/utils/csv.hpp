@@ -4096,8 +4096,9 @@ namespace csv {
 
             start = i;
 
-            // Case: This field is entirely whitespace
-            if (parse_flags[in[start] + 128] >= ParseFlags::DELIMITER) {
+            // Case: This field is entirely whitespace, or the chunk ends
+            // inside leading whitespace (the field continues in the next chunk)
+            if (start == in.size() || parse_flags[in[start] + 128] >= ParseFlags::DELIMITER) {
                 // Back the parser up one character so switch statement
                 // can process the delimiter or newline
                 i--;
@@ -0,0 +1,150 @@
+#include "dir_watcher.hpp"
+#include "../common/logger.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <thread>
+
+using namespace std;
+
+// 关心的事件：文件写完、移入移出、删除
+static const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_DELETE_SELF;
+
+DirWatcher::DirWatcher()
+{
+    m_fd = inotify_init1(IN_CLOEXEC);
+    if (m_fd < 0)
+    {
+        auto logger = MyLogger::getLogger("watcher");
+        LOG_WARN(logger, "inotify init failed, errno=%d(%s)", errno, strerror(errno));
+    }
+}
+
+DirWatcher::~DirWatcher()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+void DirWatcher::add_listener(Listener listener)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_listeners.push_back(listener);
+}
+
+bool DirWatcher::watch(const std::string &dir)
+{
+    if (m_fd < 0)
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_dir2wd.find(dir) != m_dir2wd.end())
+        return true;
+
+    int wd = inotify_add_watch(m_fd, dir.c_str(), WATCH_MASK);
+    if (wd < 0)
+    {
+        auto logger = MyLogger::getLogger("watcher");
+        LOG_WARN(logger, "watch %s failed, errno=%d(%s)", dir.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    // 同一目录的不同写法会得到相同的wd，以第一次的写法为准
+    if (m_wd2dir.find(wd) == m_wd2dir.end())
+        m_wd2dir[wd] = dir;
+    m_dir2wd[dir] = wd;
+
+    // 首次监听时启动后台线程
+    if (!m_started)
+    {
+        m_started = true;
+        std::thread([this]() { run(); }).detach();
+    }
+    return true;
+}
+
+void DirWatcher::unwatch(const std::string &dir)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto iter = m_dir2wd.find(dir);
+    if (iter == m_dir2wd.end())
+        return;
+
+    // wd到目录的映射保留到IN_IGNORED事件到达时再清除
+    inotify_rm_watch(m_fd, iter->second);
+    m_dir2wd.erase(iter);
+}
+
+bool DirWatcher::is_watched(const std::string &dir)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dir2wd.find(dir) != m_dir2wd.end();
+}
+
+void DirWatcher::dispatch(const std::string &dir, const std::string &name, uint32_t mask)
+{
+    vector<Listener> listeners;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        listeners = m_listeners;
+    }
+    for (auto &listener : listeners)
+    {
+        listener(dir, name, mask);
+    }
+}
+
+void DirWatcher::run()
+{
+    char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;)
+    {
+        ssize_t len = ::read(m_fd, buf, sizeof(buf));
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            auto logger = MyLogger::getLogger("watcher");
+            LOG_ERROR(logger, "inotify read failed, errno=%d(%s)", errno, strerror(errno));
+            return;
+        }
+
+        for (char *p = buf; p < buf + len;)
+        {
+            auto event = reinterpret_cast<struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            // 事件队列溢出，通知监听者所有目录都可能已变化
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                dispatch("", "", event->mask);
+                continue;
+            }
+
+            string dir;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto iter = m_wd2dir.find(event->wd);
+                if (iter == m_wd2dir.end())
+                    continue;
+                dir = iter->second;
+
+                // 监听已被移除，清理映射
+                if (event->mask & IN_IGNORED)
+                {
+                    m_wd2dir.erase(iter);
+                    auto it = m_dir2wd.find(dir);
+                    if (it != m_dir2wd.end() && it->second == event->wd)
+                        m_dir2wd.erase(it);
+                }
+            }
+
+            string name = event->len > 0 ? string(event->name) : string();
+            dispatch(dir, name, event->mask);
+        }
+    }
+}
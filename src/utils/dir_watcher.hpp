@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 目录变化监听器，基于inotify实现
+ *
+ * 单个后台线程读取inotify事件，并按注册顺序分发给所有监听者。
+ * 回调在监听线程中执行，监听者需要自行保证回调足够轻量。
+ * 目录被移除监听或被删除时会收到IN_IGNORED事件，name为空。
+ */
+class DirWatcher
+{
+  public:
+    // dir: 发生事件的目录，name: 目录下的文件名，mask: inotify事件掩码
+    using Listener = std::function<void(const std::string &dir, const std::string &name, uint32_t mask)>;
+
+  private:
+    DirWatcher();
+
+    int m_fd = -1;                          // inotify句柄
+    bool m_started = false;                 // 监听线程是否已启动
+    std::mutex m_mutex;                     // 保护以下成员
+    std::map<int, std::string> m_wd2dir;    // watch描述符到目录
+    std::map<std::string, int> m_dir2wd;    // 目录到watch描述符
+    std::vector<Listener> m_listeners;      // 事件监听者
+
+    void run();
+    void dispatch(const std::string &dir, const std::string &name, uint32_t mask);
+
+  public:
+    static DirWatcher &getinstance()
+    {
+        static DirWatcher instance;
+        return instance;
+    }
+    ~DirWatcher();
+
+    /**
+     * @brief 注册事件监听者，需在开始监听目录前注册
+     */
+    void add_listener(Listener listener);
+
+    /**
+     * @brief 开始监听目录，重复监听同一目录会被忽略
+     * @return 成功返回true
+     */
+    bool watch(const std::string &dir);
+
+    /**
+     * @brief 取消监听目录
+     */
+    void unwatch(const std::string &dir);
+
+    /**
+     * @brief 目录是否正在被监听
+     */
+    bool is_watched(const std::string &dir);
+};
@@ -0,0 +1,139 @@
+#include "file_system.hpp"
+#include "../common/logger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vector>
+
+using namespace std;
+
+bool FileSystem::mkdirs(const std::string &path, mode_t mode)
+{
+    if (path.empty())
+        return false;
+
+    // 拆分路径，忽略空的和"."组成部分，prefixes[i]为前i+1级目录
+    bool absolute = path[0] == '/';
+    std::vector<std::string> names;
+    std::vector<std::string> prefixes;
+    std::string prefix = absolute ? "/" : "";
+    for (size_t pos = 0; pos <= path.size();)
+    {
+        size_t end = path.find('/', pos);
+        if (end == std::string::npos)
+            end = path.size();
+        std::string name = path.substr(pos, end - pos);
+        pos = end + 1;
+        if (name.empty() || name == ".")
+            continue;
+
+        if (!prefix.empty() && prefix.back() != '/')
+            prefix += "/";
+        prefix += name;
+        names.push_back(name);
+        prefixes.push_back(prefix);
+    }
+    if (names.empty())
+        return true;
+
+    // 找到缓存中最深的一级已存在的上级目录，最后一级每次都创建，被外部删除后可以重新创建
+    size_t start = names.size() - 1;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while (start > 0 && m_dirs.find(prefixes[start - 1]) == m_dirs.end())
+            start--;
+    }
+
+    int dirfd = AT_FDCWD;
+    if (start > 0)
+        dirfd = ::open(prefixes[start - 1].c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    else if (absolute)
+        dirfd = ::open("/", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0 && dirfd != AT_FDCWD)
+    {
+        // 缓存中的目录已被删除，从头创建
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_dirs.clear();
+        }
+        return start > 0 ? mkdirs(path, mode) : false;
+    }
+
+    // 相对于上一级目录的句柄创建下一级，不需要每次从头解析完整路径
+    bool ok = true;
+    int error = 0;
+    size_t i = start;
+    for (; i < names.size(); i++)
+    {
+        if (::mkdirat(dirfd, names[i].c_str(), mode) < 0 && errno != EEXIST)
+        {
+            ok = false;
+            error = errno;
+            break;
+        }
+        int fd = ::openat(dirfd, names[i].c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            ok = false;
+            error = errno;
+            break;
+        }
+        if (dirfd != AT_FDCWD)
+            ::close(dirfd);
+        dirfd = fd;
+    }
+    if (dirfd != AT_FDCWD)
+        ::close(dirfd);
+
+    if (!ok)
+    {
+        auto logger = MyLogger::getLogger("fs");
+        LOG_WARN(logger, "create dir %s failed, errno=%d(%s)", prefixes[i].c_str(), error, strerror(error));
+    }
+
+    // 只缓存上级目录
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t j = start; j < i && j + 1 < names.size(); j++)
+        m_dirs.insert(prefixes[j]);
+    return ok;
+}
+
+bool FileSystem::ensure_executable(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto iter = m_executables.find(path);
+    if (iter != m_executables.end())
+        return iter->second;
+
+    auto logger = MyLogger::getLogger("fs");
+    bool ok = false;
+    struct stat st;
+    if (::stat(path.c_str(), &st) < 0)
+    {
+        LOG_WARN(logger, "executable %s not found, errno=%d(%s)", path.c_str(), errno, strerror(errno));
+    }
+    else if (!S_ISREG(st.st_mode))
+    {
+        LOG_WARN(logger, "executable %s is not a regular file", path.c_str());
+    }
+    else
+    {
+        // 有读权限的用户同时加上执行权限
+        mode_t exec = (st.st_mode & S_IRUSR ? S_IXUSR : 0) | (st.st_mode & S_IRGRP ? S_IXGRP : 0) |
+                      (st.st_mode & S_IROTH ? S_IXOTH : 0);
+        if ((st.st_mode & exec) != exec && ::chmod(path.c_str(), st.st_mode | exec) < 0)
+        {
+            LOG_WARN(logger, "chmod %s failed, errno=%d(%s)", path.c_str(), errno, strerror(errno));
+        }
+        ok = ::access(path.c_str(), X_OK) == 0;
+        if (!ok)
+            LOG_WARN(logger, "%s is not executable", path.c_str());
+    }
+
+    m_executables[path] = ok;
+    return ok;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+/**
+ * @brief 进程内的文件系统操作，代替通过system()调用mkdir和chmod命令
+ *
+ * 创建目录时从已知存在的最深一级上级目录开始，用mkdirat逐级创建，
+ * 创建成功或已存在的上级目录记录在缓存中，同一父目录下的大量任务只在第一次时逐级创建。
+ * 最后一级目录不缓存，每次都调用mkdirat(已存在时返回EEXIST)，被外部删除后与mkdir -p一样重新创建。
+ */
+class FileSystem
+{
+  private:
+    FileSystem() {}
+
+    std::mutex m_mutex;                        // 保护以下成员
+    std::unordered_set<std::string> m_dirs;    // 已存在的上级目录
+    std::map<std::string, bool> m_executables; // 已检查过的可执行文件及结果
+
+  public:
+    static FileSystem &getinstance()
+    {
+        static FileSystem instance;
+        return instance;
+    }
+
+    /**
+     * @brief 逐级创建目录，与mkdir -p相同
+     * @param path 目录路径，可以是相对路径
+     * @return 成功或目录已存在时返回true
+     */
+    bool mkdirs(const std::string &path, mode_t mode = 0755);
+
+    /**
+     * @brief 检查文件是否可执行，没有执行权限时添加，与chmod +x相同，每个文件只检查一次
+     * @return 文件存在且可执行时返回true
+     */
+    bool ensure_executable(const std::string &path);
+};
@@ -0,0 +1,508 @@
+#pragma once
+
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 简单的JSON值，用于HTTP接口的请求解析和响应生成
+ *
+ * 数字统一保存为double，对象的键按字典序保存，不保留原始顺序。
+ */
+class JsonValue
+{
+  public:
+    enum Type
+    {
+        Null,
+        Bool,
+        Number,
+        String,
+        Array,
+        Object
+    };
+
+    using array_t = std::vector<JsonValue>;
+    using object_t = std::map<std::string, JsonValue>;
+
+  private:
+    Type m_type = Null;
+    bool m_bool = false;
+    double m_number = 0;
+    std::string m_string;
+    array_t m_array;
+    object_t m_object;
+
+  public:
+    JsonValue() {}
+    JsonValue(bool v) : m_type(Bool), m_bool(v) {}
+    JsonValue(int v) : m_type(Number), m_number(v) {}
+    JsonValue(int64_t v) : m_type(Number), m_number(static_cast<double>(v)) {}
+    JsonValue(size_t v) : m_type(Number), m_number(static_cast<double>(v)) {}
+    JsonValue(double v) : m_type(Number), m_number(v) {}
+    JsonValue(const char *v) : m_type(String), m_string(v) {}
+    JsonValue(const std::string &v) : m_type(String), m_string(v) {}
+
+    static JsonValue array() { JsonValue v; v.m_type = Array; return v; }
+    static JsonValue object() { JsonValue v; v.m_type = Object; return v; }
+
+    Type type() const { return m_type; }
+    bool is_null() const { return m_type == Null; }
+    bool is_bool() const { return m_type == Bool; }
+    bool is_number() const { return m_type == Number; }
+    bool is_string() const { return m_type == String; }
+    bool is_array() const { return m_type == Array; }
+    bool is_object() const { return m_type == Object; }
+
+    bool as_bool() const { return m_bool; }
+    double as_number() const { return m_number; }
+    int as_int() const { return static_cast<int>(m_number); }
+    const std::string &as_string() const { return m_string; }
+    const array_t &as_array() const { return m_array; }
+    const object_t &as_object() const { return m_object; }
+
+    /**
+     * @brief 获取对象的成员
+     * @return 不是对象或成员不存在时返回nullptr
+     */
+    const JsonValue *get(const std::string &key) const
+    {
+        if (m_type != Object)
+            return nullptr;
+        auto iter = m_object.find(key);
+        return iter == m_object.end() ? nullptr : &iter->second;
+    }
+
+    // 设置对象的成员，当前值不是对象时先转为空对象
+    JsonValue &set(const std::string &key, const JsonValue &value)
+    {
+        if (m_type != Object)
+            *this = object();
+        m_object[key] = value;
+        return *this;
+    }
+
+    // 在数组末尾添加元素，当前值不是数组时先转为空数组
+    JsonValue &push(const JsonValue &value)
+    {
+        if (m_type != Array)
+            *this = array();
+        m_array.push_back(value);
+        return *this;
+    }
+
+    /**
+     * @brief 解析JSON文本
+     * @param errmsg 失败原因
+     * @return 格式错误时返回false
+     */
+    static bool parse(const std::string &text, JsonValue &out, std::string &errmsg)
+    {
+        Parser parser(text);
+        if (!parser.parse_value(out, 0))
+        {
+            errmsg = parser.error();
+            return false;
+        }
+        parser.skip_ws();
+        if (parser.pos() != text.size())
+        {
+            errmsg = "unexpected data after json value at " + std::to_string(parser.pos());
+            return false;
+        }
+        return true;
+    }
+
+    // 生成紧凑的JSON文本
+    std::string dump() const
+    {
+        std::string out;
+        dump(out);
+        return out;
+    }
+
+    void dump(std::string &out) const
+    {
+        switch (m_type)
+        {
+        case Null:
+            out += "null";
+            break;
+        case Bool:
+            out += m_bool ? "true" : "false";
+            break;
+        case Number:
+            dump_number(out, m_number);
+            break;
+        case String:
+            dump_string(out, m_string);
+            break;
+        case Array:
+            out += '[';
+            for (size_t i = 0; i < m_array.size(); i++)
+            {
+                if (i > 0)
+                    out += ',';
+                m_array[i].dump(out);
+            }
+            out += ']';
+            break;
+        case Object:
+            out += '{';
+            for (auto iter = m_object.begin(); iter != m_object.end(); ++iter)
+            {
+                if (iter != m_object.begin())
+                    out += ',';
+                dump_string(out, iter->first);
+                out += ':';
+                iter->second.dump(out);
+            }
+            out += '}';
+            break;
+        }
+    }
+
+  private:
+    static void dump_number(std::string &out, double v)
+    {
+        // JSON不支持NaN和无穷大
+        if (!std::isfinite(v))
+        {
+            out += "null";
+            return;
+        }
+        char buf[32];
+        if (v == std::floor(v) && std::fabs(v) < 1e15)
+            snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(v));
+        else
+            snprintf(buf, sizeof(buf), "%.17g", v);
+        out += buf;
+    }
+
+    static void dump_string(std::string &out, const std::string &s)
+    {
+        out += '"';
+        for (unsigned char c : s)
+        {
+            switch (c)
+            {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (c < 0x20)
+                {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                }
+                else
+                {
+                    out += static_cast<char>(c);
+                }
+            }
+        }
+        out += '"';
+    }
+
+    // 递归下降解析器，限制嵌套深度，避免恶意请求耗尽栈空间
+    class Parser
+    {
+      private:
+        static const int MAX_DEPTH = 64;
+
+        const std::string &m_text;
+        size_t m_pos = 0;
+        std::string m_error;
+
+        bool fail(const std::string &msg)
+        {
+            if (m_error.empty())
+                m_error = msg + " at " + std::to_string(m_pos);
+            return false;
+        }
+
+        bool expect(const char *word)
+        {
+            for (const char *p = word; *p; p++, m_pos++)
+            {
+                if (m_pos >= m_text.size() || m_text[m_pos] != *p)
+                    return fail("invalid literal");
+            }
+            return true;
+        }
+
+        static void append_utf8(std::string &out, uint32_t cp)
+        {
+            if (cp < 0x80)
+            {
+                out += static_cast<char>(cp);
+            }
+            else if (cp < 0x800)
+            {
+                out += static_cast<char>(0xC0 | (cp >> 6));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+            else if (cp < 0x10000)
+            {
+                out += static_cast<char>(0xE0 | (cp >> 12));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+            else
+            {
+                out += static_cast<char>(0xF0 | (cp >> 18));
+                out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+        }
+
+        bool parse_hex4(uint32_t &cp)
+        {
+            if (m_pos + 4 > m_text.size())
+                return fail("invalid unicode escape");
+            cp = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                char c = m_text[m_pos++];
+                cp <<= 4;
+                if (c >= '0' && c <= '9')
+                    cp |= c - '0';
+                else if (c >= 'a' && c <= 'f')
+                    cp |= c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F')
+                    cp |= c - 'A' + 10;
+                else
+                    return fail("invalid unicode escape");
+            }
+            return true;
+        }
+
+        bool parse_string(std::string &out)
+        {
+            m_pos++; // '"'
+            while (m_pos < m_text.size())
+            {
+                char c = m_text[m_pos++];
+                if (c == '"')
+                    return true;
+                if (static_cast<unsigned char>(c) < 0x20)
+                    return fail("control character in string");
+                if (c != '\\')
+                {
+                    out += c;
+                    continue;
+                }
+
+                if (m_pos >= m_text.size())
+                    break;
+                c = m_text[m_pos++];
+                switch (c)
+                {
+                case '"':
+                case '\\':
+                case '/':
+                    out += c;
+                    break;
+                case 'b':
+                    out += '\b';
+                    break;
+                case 'f':
+                    out += '\f';
+                    break;
+                case 'n':
+                    out += '\n';
+                    break;
+                case 'r':
+                    out += '\r';
+                    break;
+                case 't':
+                    out += '\t';
+                    break;
+                case 'u': {
+                    uint32_t cp = 0;
+                    if (!parse_hex4(cp))
+                        return false;
+                    // 代理对
+                    if (cp >= 0xD800 && cp <= 0xDBFF && m_pos + 1 < m_text.size() && m_text[m_pos] == '\\' &&
+                        m_text[m_pos + 1] == 'u')
+                    {
+                        m_pos += 2;
+                        uint32_t low = 0;
+                        if (!parse_hex4(low))
+                            return false;
+                        if (low < 0xDC00 || low > 0xDFFF)
+                            return fail("invalid surrogate pair");
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    append_utf8(out, cp);
+                    break;
+                }
+                default:
+                    return fail("invalid escape");
+                }
+            }
+            return fail("unterminated string");
+        }
+
+        bool parse_number(JsonValue &out)
+        {
+            size_t start = m_pos;
+            if (m_pos < m_text.size() && m_text[m_pos] == '-')
+                m_pos++;
+            while (m_pos < m_text.size() &&
+                   (isdigit(static_cast<unsigned char>(m_text[m_pos])) || m_text[m_pos] == '.' ||
+                    m_text[m_pos] == 'e' || m_text[m_pos] == 'E' || m_text[m_pos] == '+' || m_text[m_pos] == '-'))
+            {
+                m_pos++;
+            }
+
+            std::string s = m_text.substr(start, m_pos - start);
+            char *end = nullptr;
+            double v = strtod(s.c_str(), &end);
+            if (s.empty() || end != s.c_str() + s.size())
+            {
+                m_pos = start;
+                return fail("invalid number");
+            }
+            out = JsonValue(v);
+            return true;
+        }
+
+      public:
+        explicit Parser(const std::string &text) : m_text(text) {}
+
+        size_t pos() const { return m_pos; }
+        const std::string &error() const { return m_error; }
+
+        void skip_ws()
+        {
+            while (m_pos < m_text.size() &&
+                   (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' || m_text[m_pos] == '\n' || m_text[m_pos] == '\r'))
+            {
+                m_pos++;
+            }
+        }
+
+        bool parse_value(JsonValue &out, int depth)
+        {
+            if (depth > MAX_DEPTH)
+                return fail("nesting too deep");
+
+            skip_ws();
+            if (m_pos >= m_text.size())
+                return fail("unexpected end");
+
+            char c = m_text[m_pos];
+            if (c == 'n')
+            {
+                out = JsonValue();
+                return expect("null");
+            }
+            if (c == 't')
+            {
+                out = JsonValue(true);
+                return expect("true");
+            }
+            if (c == 'f')
+            {
+                out = JsonValue(false);
+                return expect("false");
+            }
+            if (c == '"')
+            {
+                out = JsonValue(std::string());
+                return parse_string(out.m_string);
+            }
+            if (c == '[')
+            {
+                out = JsonValue::array();
+                m_pos++;
+                skip_ws();
+                if (m_pos < m_text.size() && m_text[m_pos] == ']')
+                {
+                    m_pos++;
+                    return true;
+                }
+                while (true)
+                {
+                    out.m_array.push_back(JsonValue());
+                    if (!parse_value(out.m_array.back(), depth + 1))
+                        return false;
+                    skip_ws();
+                    if (m_pos < m_text.size() && m_text[m_pos] == ',')
+                    {
+                        m_pos++;
+                        continue;
+                    }
+                    if (m_pos < m_text.size() && m_text[m_pos] == ']')
+                    {
+                        m_pos++;
+                        return true;
+                    }
+                    return fail("expect ',' or ']'");
+                }
+            }
+            if (c == '{')
+            {
+                out = JsonValue::object();
+                m_pos++;
+                skip_ws();
+                if (m_pos < m_text.size() && m_text[m_pos] == '}')
+                {
+                    m_pos++;
+                    return true;
+                }
+                while (true)
+                {
+                    skip_ws();
+                    if (m_pos >= m_text.size() || m_text[m_pos] != '"')
+                        return fail("expect object key");
+                    std::string key;
+                    if (!parse_string(key))
+                        return false;
+                    skip_ws();
+                    if (m_pos >= m_text.size() || m_text[m_pos] != ':')
+                        return fail("expect ':'");
+                    m_pos++;
+                    if (!parse_value(out.m_object[key], depth + 1))
+                        return false;
+                    skip_ws();
+                    if (m_pos < m_text.size() && m_text[m_pos] == ',')
+                    {
+                        m_pos++;
+                        continue;
+                    }
+                    if (m_pos < m_text.size() && m_text[m_pos] == '}')
+                    {
+                        m_pos++;
+                        return true;
+                    }
+                    return fail("expect ',' or '}'");
+                }
+            }
+            if (c == '-' || isdigit(static_cast<unsigned char>(c)))
+                return parse_number(out);
+
+            return fail("unexpected character");
+        }
+    };
+};
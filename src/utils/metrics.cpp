@@ -0,0 +1,261 @@
+#include "metrics.hpp"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <algorithm>
+#include <map>
+
+using namespace std;
+
+static const char *ENDPOINT_NAMES[Metrics::ENDPOINT_MAX] = {"playlist", "segment", "api", "metrics", "other"};
+static const char *CACHE_RESULT_NAMES[Metrics::CACHE_RESULT_MAX] = {"hit", "miss", "coalesced"};
+
+static void append_format(std::string &out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void append_format(std::string &out, const char *fmt, ...)
+{
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n > 0)
+        out.append(buf, std::min(static_cast<size_t>(n), sizeof(buf) - 1));
+}
+
+static void append_header(std::string &out, const char *name, const char *type, const char *help)
+{
+    append_format(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// 标签值中的反斜杠、双引号和换行需要转义
+static std::string escape_label(const std::string &value)
+{
+    std::string s;
+    s.reserve(value.size());
+    for (char c : value)
+    {
+        if (c == '\\' || c == '"')
+        {
+            s += '\\';
+            s += c;
+        }
+        else if (c == '\n')
+        {
+            s += "\\n";
+        }
+        else
+        {
+            s += c;
+        }
+    }
+    return s;
+}
+
+// 输出一行带stream标签的指标，目标路径长度不限
+static void append_stream(std::string &out, const char *name, const std::string &dest, uint64_t value)
+{
+    out += name;
+    out += "{stream=\"";
+    out += escape_label(dest);
+    out += "\"} ";
+    out += std::to_string(value);
+    out += '\n';
+}
+
+MetricHistogram::MetricHistogram(const std::vector<double> &bounds)
+    : m_bounds(bounds.begin(), bounds.begin() + std::min(bounds.size(), MAX_BUCKETS - 1))
+{
+    for (auto b : m_bounds)
+        m_bounds_us.push_back(static_cast<int64_t>(b * 1000000));
+}
+
+void MetricHistogram::observe(int64_t us)
+{
+    if (us < 0)
+        us = 0;
+    size_t i = 0;
+    while (i < m_bounds_us.size() && us > m_bounds_us[i])
+        i++;
+    m_buckets[i].add();
+    m_sum_us.add(static_cast<uint64_t>(us));
+}
+
+void MetricHistogram::render(std::string &out, const char *name, const char *help) const
+{
+    append_header(out, name, "histogram", help);
+
+    // 各个桶分别读取，计数可能比总数略小，不影响趋势
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < m_bounds.size(); i++)
+    {
+        cumulative += m_buckets[i].get();
+        append_format(out, "%s_bucket{le=\"%g\"} %llu\n", name, m_bounds[i],
+                      static_cast<unsigned long long>(cumulative));
+    }
+    cumulative += m_buckets[m_bounds.size()].get();
+    append_format(out, "%s_bucket{le=\"+Inf\"} %llu\n", name, static_cast<unsigned long long>(cumulative));
+    append_format(out, "%s_sum %.6f\n", name, m_sum_us.get() / 1000000.0);
+    append_format(out, "%s_count %llu\n", name, static_cast<unsigned long long>(cumulative));
+}
+
+Metrics::Metrics()
+    : m_segment_latency({0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5}),
+      m_playlist_latency({0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10}),
+      m_supervision_pass({0.001, 0.005, 0.01, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10}),
+      m_spawn_latency({0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.5})
+{
+}
+
+Metrics::Endpoint Metrics::endpoint_of(const std::string &path)
+{
+    auto ends_with = [&path](const char *suffix, size_t n) {
+        return path.size() >= n && path.compare(path.size() - n, n, suffix) == 0;
+    };
+    if (ends_with(".m3u8", 5))
+        return ENDPOINT_PLAYLIST;
+    if (ends_with(".ts", 3) || ends_with(".m4s", 4) || ends_with(".mp4", 4))
+        return ENDPOINT_SEGMENT;
+    if (path.compare(0, 5, "/api/") == 0 || path == "/api")
+        return ENDPOINT_API;
+    if (path == "/metrics")
+        return ENDPOINT_METRICS;
+    return ENDPOINT_OTHER;
+}
+
+void Metrics::on_http_request(Endpoint endpoint, int status, uint64_t bytes, int64_t latency_us)
+{
+    m_http_requests[endpoint].add();
+    m_http_bytes[endpoint].add(bytes);
+    m_http_status[status >= 100 && status < 600 ? status / 100 : 0].add();
+
+    if (endpoint == ENDPOINT_SEGMENT)
+        m_segment_latency.observe(latency_us);
+    else if (endpoint == ENDPOINT_PLAYLIST)
+        m_playlist_latency.observe(latency_us);
+}
+
+void Metrics::on_supervision_pass(int64_t us, size_t tasks)
+{
+    m_supervision_pass.observe(us);
+    m_supervision_tasks.store(tasks, std::memory_order_relaxed);
+}
+
+void Metrics::on_spawn(int64_t us, bool ok)
+{
+    m_spawn_latency.observe(us);
+    if (!ok)
+        m_spawn_failures.add();
+}
+
+void Metrics::add_stream(const std::shared_ptr<StreamMetrics> &stream)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (stream->registered)
+        return;
+    stream->pos = m_streams.insert(m_streams.end(), stream);
+    stream->registered = true;
+}
+
+void Metrics::remove_stream(const std::shared_ptr<StreamMetrics> &stream)
+{
+    if (!stream)
+        return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (stream->registered)
+    {
+        m_streams.erase(stream->pos);
+        stream->registered = false;
+    }
+}
+
+std::string Metrics::render()
+{
+    std::string out;
+
+    append_header(out, "rtmp2hls_http_requests_total", "counter", "HTTP requests by endpoint.");
+    for (int i = 0; i < ENDPOINT_MAX; i++)
+        append_format(out, "rtmp2hls_http_requests_total{endpoint=\"%s\"} %llu\n", ENDPOINT_NAMES[i],
+                      static_cast<unsigned long long>(m_http_requests[i].get()));
+
+    append_header(out, "rtmp2hls_http_response_bytes_total", "counter", "HTTP response body bytes by endpoint.");
+    for (int i = 0; i < ENDPOINT_MAX; i++)
+        append_format(out, "rtmp2hls_http_response_bytes_total{endpoint=\"%s\"} %llu\n", ENDPOINT_NAMES[i],
+                      static_cast<unsigned long long>(m_http_bytes[i].get()));
+
+    append_header(out, "rtmp2hls_http_responses_total", "counter", "HTTP responses by status class.");
+    for (int i = 1; i < 6; i++)
+        append_format(out, "rtmp2hls_http_responses_total{code=\"%dxx\"} %llu\n", i,
+                      static_cast<unsigned long long>(m_http_status[i].get()));
+
+    m_segment_latency.render(out, "rtmp2hls_segment_serve_seconds", "Time to serve a segment request.");
+    m_playlist_latency.render(out, "rtmp2hls_playlist_serve_seconds",
+                              "Time to serve a playlist request, including on-demand start.");
+    m_supervision_pass.render(out, "rtmp2hls_supervision_pass_seconds", "Duration of a task supervision pass.");
+
+    append_header(out, "rtmp2hls_supervision_pass_tasks", "gauge", "Tasks checked in the last supervision pass.");
+    append_format(out, "rtmp2hls_supervision_pass_tasks %llu\n",
+                  static_cast<unsigned long long>(m_supervision_tasks.load(std::memory_order_relaxed)));
+
+    m_spawn_latency.render(out, "rtmp2hls_process_spawn_seconds", "Time to spawn an ingest child process.");
+    append_header(out, "rtmp2hls_process_spawn_failures_total", "counter", "Failed child process spawns.");
+    append_format(out, "rtmp2hls_process_spawn_failures_total %llu\n",
+                  static_cast<unsigned long long>(m_spawn_failures.get()));
+
+    append_header(out, "rtmp2hls_hls_file_reads_total", "counter",
+                  "HLS file reads by result; miss is a disk read, coalesced waited for a concurrent read.");
+    for (int i = 0; i < CACHE_RESULT_MAX; i++)
+        append_format(out, "rtmp2hls_hls_file_reads_total{result=\"%s\"} %llu\n", CACHE_RESULT_NAMES[i],
+                      static_cast<unsigned long long>(m_cache_lookups[i].get()));
+
+    // 复制后输出，不在输出期间阻塞任务的添加和删除
+    std::vector<std::shared_ptr<StreamMetrics>> streams;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        streams.assign(m_streams.begin(), m_streams.end());
+    }
+
+    std::map<std::string, size_t> states;
+    for (auto &stream : streams)
+    {
+        const char *state = stream->state.load(std::memory_order_relaxed);
+        if (*state)
+            states[state]++;
+    }
+    append_header(out, "rtmp2hls_tasks", "gauge", "Tasks by state.");
+    for (auto &state : states)
+        append_format(out, "rtmp2hls_tasks{state=\"%s\"} %zu\n", state.first.c_str(), state.second);
+
+    append_header(out, "rtmp2hls_task_restarts_total", "counter", "Restarts per task.");
+    for (auto &stream : streams)
+        append_stream(out, "rtmp2hls_task_restarts_total", stream->dest,
+                      stream->restarts.load(std::memory_order_relaxed));
+
+    append_header(out, "rtmp2hls_task_stalls_total", "counter", "Restarts because a task produced no new segment.");
+    for (auto &stream : streams)
+        append_stream(out, "rtmp2hls_task_stalls_total", stream->dest, stream->stalls.load(std::memory_order_relaxed));
+
+    append_header(out, "rtmp2hls_task_last_segment_age_seconds", "gauge",
+                  "Seconds since a running task produced its last segment.");
+    int64_t now = time(nullptr);
+    for (auto &stream : streams)
+    {
+        int64_t last = stream->last_segment.load(std::memory_order_relaxed);
+        if (last > 0)
+            append_stream(out, "rtmp2hls_task_last_segment_age_seconds", stream->dest,
+                          static_cast<uint64_t>(std::max<int64_t>(0, now - last)));
+    }
+
+    append_header(out, "rtmp2hls_stream_http_requests_total", "counter",
+                  "HTTP playlist and segment requests per stream.");
+    for (auto &stream : streams)
+        append_stream(out, "rtmp2hls_stream_http_requests_total", stream->dest, stream->requests.get());
+
+    append_header(out, "rtmp2hls_stream_http_bytes_total", "counter", "HTTP response bytes per stream.");
+    for (auto &stream : streams)
+        append_stream(out, "rtmp2hls_stream_http_bytes_total", stream->dest, stream->bytes.get());
+
+    return out;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 计数器，独占一个缓存行，多个线程同时更新不同计数器时互不影响
+ */
+struct alignas(64) MetricCounter
+{
+    std::atomic<uint64_t> value{0};
+
+    void add(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+/**
+ * @brief 直方图，桶的上界(秒)在构造时确定，观测值按微秒累计
+ * 含有按缓存行对齐的成员，只作为静态对象的成员使用
+ */
+class MetricHistogram
+{
+  public:
+    // 桶数上限，包括+Inf
+    static const size_t MAX_BUCKETS = 16;
+
+    explicit MetricHistogram(const std::vector<double> &bounds);
+
+    // 记录一次耗时(微秒)
+    void observe(int64_t us);
+
+    // 按Prometheus文本格式输出
+    void render(std::string &out, const char *name, const char *help) const;
+
+  private:
+    std::vector<double> m_bounds;
+    std::vector<int64_t> m_bounds_us;
+    MetricCounter m_buckets[MAX_BUCKETS]; // 每个桶的计数，最后一个为+Inf，不累加
+    MetricCounter m_sum_us;
+};
+
+/**
+ * @brief 单个任务(流)的指标，由任务持有，HTTP线程和任务线程只更新原子变量
+ */
+struct StreamMetrics
+{
+    explicit StreamMetrics(const std::string &dest) : dest(dest) {}
+
+    const std::string dest;             // 目标路径，作为stream标签
+    MetricCounter requests;             // HTTP请求数(播放列表和切片)
+    MetricCounter bytes;                // HTTP响应字节数
+    std::atomic<const char *> state{""}; // 最近一次检查时的状态，指向IngestTask::state()返回的常量字符串
+    std::atomic<uint64_t> restarts{0};  // 累计重启次数
+    std::atomic<uint64_t> stalls{0};    // 累计因没有新切片而重启的次数
+    std::atomic<int64_t> last_segment{0}; // 最近一个切片的生成时间，0表示未在运行或还没有切片
+
+    // 在Metrics中的位置，由Metrics加锁访问
+    std::list<std::shared_ptr<StreamMetrics>>::iterator pos;
+    bool registered = false;
+};
+
+/**
+ * @brief 全局指标，/metrics接口按Prometheus文本格式输出
+ *
+ * 请求路径上只更新原子计数器，不加锁。流指标的注册表有单独的锁，
+ * 只在任务添加、删除和输出指标时使用，输出指标不会阻塞HTTP请求和任务检查。
+ */
+class Metrics
+{
+  public:
+    // HTTP请求的类别
+    enum Endpoint
+    {
+        ENDPOINT_PLAYLIST,
+        ENDPOINT_SEGMENT,
+        ENDPOINT_API,
+        ENDPOINT_METRICS,
+        ENDPOINT_OTHER,
+        ENDPOINT_MAX
+    };
+
+    // HLS文件读取的结果
+    enum CacheResult
+    {
+        CACHE_HIT,       // 命中内存缓存
+        CACHE_MISS,      // 读取磁盘
+        CACHE_COALESCED, // 等待同一文件的另一次读取
+        CACHE_RESULT_MAX
+    };
+
+    static Metrics &getinstance()
+    {
+        static Metrics instance;
+        return instance;
+    }
+
+    // 按请求路径判断类别
+    static Endpoint endpoint_of(const std::string &path);
+
+    /**
+     * @brief 记录一次HTTP请求
+     * @param endpoint 请求类别
+     * @param status 响应状态码
+     * @param bytes 响应字节数
+     * @param latency_us 从读到请求行到响应发送完的耗时(微秒)
+     */
+    void on_http_request(Endpoint endpoint, int status, uint64_t bytes, int64_t latency_us);
+
+    // 记录一轮任务检查的耗时和任务数
+    void on_supervision_pass(int64_t us, size_t tasks);
+
+    // 记录一次启动子进程的耗时
+    void on_spawn(int64_t us, bool ok);
+
+    // 记录一次HLS文件读取
+    void on_cache_lookup(CacheResult result) { m_cache_lookups[result].add(); }
+
+    // 注册任务的指标，任务删除时调用remove_stream
+    void add_stream(const std::shared_ptr<StreamMetrics> &stream);
+    void remove_stream(const std::shared_ptr<StreamMetrics> &stream);
+
+    // 按Prometheus文本格式输出全部指标
+    std::string render();
+
+  private:
+    Metrics();
+
+    MetricCounter m_http_requests[ENDPOINT_MAX];
+    MetricCounter m_http_bytes[ENDPOINT_MAX];
+    MetricCounter m_http_status[6]; // 按状态码的百位计数，0为无法识别的状态码
+    MetricHistogram m_segment_latency;
+    MetricHistogram m_playlist_latency;
+    MetricHistogram m_supervision_pass;
+    std::atomic<uint64_t> m_supervision_tasks{0};
+    MetricHistogram m_spawn_latency;
+    MetricCounter m_spawn_failures;
+    MetricCounter m_cache_lookups[CACHE_RESULT_MAX];
+
+    std::mutex m_mutex; // 只保护m_streams
+    std::list<std::shared_ptr<StreamMetrics>> m_streams;
+};
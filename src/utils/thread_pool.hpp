@@ -0,0 +1,98 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief 固定大小的工作线程池
+ *
+ * 任务按提交顺序执行，shutdown后不再接受新任务，已提交的任务会执行完毕。
+ */
+class WorkerPool {
+public:
+    /**
+     * @brief 构造函数，立即创建工作线程
+     * @param n 工作线程数，至少为1
+     */
+    explicit WorkerPool(size_t n) {
+        if (n == 0) {
+            n = 1;
+        }
+        for (size_t i = 0; i < n; i++) {
+            threads_.emplace_back([this] { worker(); });
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     * @brief 析构函数，等待所有任务执行完毕
+     */
+    ~WorkerPool() {
+        shutdown();
+    }
+
+    /**
+     * @brief 提交任务
+     * @return 线程池已关闭时返回false
+     */
+    bool submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> locker(mutex_);
+            if (shutdown_) {
+                return false;
+            }
+            jobs_.push_back(std::move(job));
+        }
+        cond_.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief 停止线程池并等待工作线程退出
+     */
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> locker(mutex_);
+            if (shutdown_) {
+                return;
+            }
+            shutdown_ = true;
+        }
+        cond_.notify_all();
+        for (auto& t : threads_) {
+            t.join();
+        }
+    }
+
+    size_t size() const {
+        return threads_.size();
+    }
+
+private:
+    void worker() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> locker(mutex_);
+                cond_.wait(locker, [this] { return shutdown_ || !jobs_.empty(); });
+                if (jobs_.empty()) {
+                    return;
+                }
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread> threads_;       ///< 工作线程
+    std::list<std::function<void()>> jobs_;  ///< 待执行的任务
+    std::mutex mutex_;                       ///< 保护任务队列
+    std::condition_variable cond_;           ///< 通知工作线程
+    bool shutdown_ = false;                  ///< 是否已关闭
+};
@@ -2,10 +2,9 @@
 #include <functional>
 #include <chrono>
 #include <thread>
-#include <atomic>
-#include <memory>
 #include <mutex>
-#include <condition_variable>
+
+#include "timing_wheel.hpp"
 
 /**
  * @brief 通用定时器类，支持周期性任务执行和定时任务调度
@@ -15,23 +14,23 @@
  * - 支持同步和异步定时任务
  * - 安全的任务取消机制
  * - 线程安全的实现
+ *
+ * 周期任务和异步任务都由TimingWheel调度，不再为每个定时器创建线程，
+ * 周期任务按固定时间点执行，任务耗时不会推迟后续的执行时间。
  */
 class Timer {
 public:
     /**
      * @brief 默认构造函数
-     * 初始化定时器为过期状态，未尝试过期
+     * 初始化定时器为未启动状态
      */
-    Timer() : expired_(true), try_to_expire_(false) {}
+    Timer() {}
 
     /**
-     * @brief 拷贝构造函数
+     * @brief 拷贝构造函数，得到未启动的定时器
      * @param t 源定时器对象
      */
-    Timer(const Timer& t) {
-        expired_ = t.expired_.load();
-        try_to_expire_ = t.try_to_expire_.load();
-    }
+    Timer(const Timer& /*t*/) {}
 
     /**
      * @brief 析构函数
@@ -43,47 +42,29 @@ public:
 
     /**
      * @brief 启动定时器，周期性执行指定任务
-     * @param interval 任务执行间隔(毫秒)
+     * @param interval 任务执行间隔(毫秒)，首次在interval之后执行
      * @param task 需要执行的任务函数
      */
     void StartTimer(int interval, std::function<void()> task) {
-        if (expired_ == false) {
+        std::lock_guard<std::mutex> locker(mutex_);
+        if (handle_.active()) {
             return;
         }
-        expired_ = false;
-        std::thread([this, interval, task]() {
-            while (!try_to_expire_) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(interval));
-                task();
-            }
-            {
-                std::lock_guard<std::mutex> locker(mutex_);
-                expired_ = true;
-                expired_cond_.notify_one();
-            }
-        }).detach();
+        handle_ = TimingWheel::getinstance().schedule_every(interval, task);
     }
 
     /**
      * @brief 停止定时器
-     * 安全地终止正在执行的定时任务
+     * 取消后续执行，并等待正在执行的任务结束
      */
     void Expire() {
-        if (expired_) {
-            return;
-        }
-
-        if (try_to_expire_) {
-            return;
-        }
-        try_to_expire_ = true;
+        TimingWheel::Handle handle;
         {
-            std::unique_lock<std::mutex> locker(mutex_);
-            expired_cond_.wait(locker, [this] { return expired_ == true; });
-            if (expired_ == true) {
-                try_to_expire_ = false;
-            }
+            std::lock_guard<std::mutex> locker(mutex_);
+            handle = handle_;
+            handle_ = TimingWheel::Handle();
         }
+        handle.cancel(true);
     }
 
     /**
@@ -111,15 +92,10 @@ public:
         std::function<typename std::result_of<callable(arguments...)>::type()> task
             (std::bind(std::forward<callable>(f), std::forward<arguments>(args)...));
 
-        std::thread([after, task]() {
-            std::this_thread::sleep_for(std::chrono::milliseconds(after));
-            task();
-        }).detach();
+        TimingWheel::getinstance().schedule(after, [task]() { task(); });
     }
 
 private:
-    std::atomic<bool> expired_;        ///< 定时器是否已过期
-    std::atomic<bool> try_to_expire_;  ///< 是否正在尝试使定时器过期
-    std::mutex mutex_;                 ///< 互斥锁，用于线程同步
-    std::condition_variable expired_cond_; ///< 条件变量，用于等待定时器过期
+    std::mutex mutex_;             ///< 互斥锁，保护handle_
+    TimingWheel::Handle handle_;   ///< 周期任务的句柄
 };
@@ -0,0 +1,240 @@
+#include "timing_wheel.hpp"
+
+using namespace std;
+
+// 执行回调的线程数
+#define TIMING_WHEEL_WORKERS 4
+
+TimingWheel::TimingWheel()
+{
+    m_base = std::chrono::steady_clock::now();
+    m_pool.reset(new WorkerPool(TIMING_WHEEL_WORKERS));
+    std::thread([this]() { run(); }).detach();
+}
+
+void TimingWheel::Handle::cancel(bool wait)
+{
+    auto node = m_node.lock();
+    if (node)
+        TimingWheel::getinstance().cancel(node, wait);
+}
+
+bool TimingWheel::Handle::active() const
+{
+    auto node = m_node.lock();
+    if (!node)
+        return false;
+
+    auto &wheel = TimingWheel::getinstance();
+    std::lock_guard<std::mutex> lock(wheel.m_mutex);
+    return !node->cancelled && node->slot != nullptr;
+}
+
+TimingWheel::Handle TimingWheel::schedule(int64_t delay_ms, Callback callback)
+{
+    return add(delay_ms > 0 ? static_cast<uint64_t>(delay_ms) : 0, 0, callback);
+}
+
+TimingWheel::Handle TimingWheel::schedule_every(int64_t interval_ms, Callback callback, int64_t first_delay_ms)
+{
+    if (interval_ms <= 0)
+        interval_ms = TICK_MS;
+    if (first_delay_ms < 0)
+        first_delay_ms = interval_ms;
+    return add(static_cast<uint64_t>(first_delay_ms), static_cast<uint64_t>(interval_ms), callback);
+}
+
+size_t TimingWheel::size()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count;
+}
+
+TimingWheel::Handle TimingWheel::add(uint64_t delay_ms, uint64_t interval_ms, Callback callback)
+{
+    auto node = std::make_shared<Node>();
+    node->callback = callback;
+    node->interval = (interval_ms + TICK_MS - 1) / TICK_MS;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // 调度线程可能还没有处理到当前时间，不能放进已经处理过的槽
+        node->expire = std::max(current_tick() + (delay_ms + TICK_MS - 1) / TICK_MS, m_tick + 1);
+        add_locked(node);
+        m_count++;
+    }
+    m_cond.notify_one();
+
+    Handle handle;
+    handle.m_node = node;
+    return handle;
+}
+
+void TimingWheel::cancel(const NodePtr &node, bool wait)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    node->cancelled = true;
+    if (node->slot)
+        remove_locked(*node);
+
+    if (wait && node->runner != std::this_thread::get_id())
+        m_idle_cond.wait(lock, [&node]() { return !node->running; });
+}
+
+uint64_t TimingWheel::current_tick() const
+{
+    auto elapsed = std::chrono::steady_clock::now() - m_base;
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() / TICK_MS);
+}
+
+void TimingWheel::add_locked(const NodePtr &node)
+{
+    uint64_t expire = node->expire;
+    uint64_t delta = expire - m_tick;
+
+    Slot *slot = nullptr;
+    if (delta < LEVEL0_SIZE)
+    {
+        slot = &m_level0[expire & (LEVEL0_SIZE - 1)];
+    }
+    else
+    {
+        // 超出范围的定时器先放在最高层的最后一个槽，到时重新分配
+        if (delta >= MAX_DELTA)
+        {
+            delta = MAX_DELTA - 1;
+            expire = m_tick + delta;
+        }
+
+        int level = 0;
+        int shift = LEVEL0_BITS;
+        while (level < LEVELS - 2 && delta >= (1ULL << (shift + LEVEL_BITS)))
+        {
+            level++;
+            shift += LEVEL_BITS;
+        }
+        slot = &m_levels[level][(expire >> shift) & (LEVEL_SIZE - 1)];
+    }
+
+    node->slot = slot;
+    node->pos = slot->insert(slot->end(), node);
+}
+
+void TimingWheel::remove_locked(Node &node)
+{
+    node.slot->erase(node.pos);
+    node.slot = nullptr;
+    m_count--;
+}
+
+void TimingWheel::cascade_locked(int level, uint64_t index)
+{
+    Slot nodes;
+    nodes.swap(m_levels[level][index]);
+    for (auto &node : nodes)
+        add_locked(node);
+}
+
+void TimingWheel::expire_locked(uint64_t tick)
+{
+    Slot nodes;
+    nodes.swap(m_level0[tick & (LEVEL0_SIZE - 1)]);
+    for (auto &node : nodes)
+    {
+        if (node->expire > tick)
+        {
+            add_locked(node);
+            continue;
+        }
+
+        node->slot = nullptr;
+        m_count--;
+        dispatch_locked(node);
+
+        // 周期定时器的下次触发时间只由首次触发时间和周期决定，回调耗时不会累积误差
+        if (node->interval > 0 && !node->cancelled)
+        {
+            node->expire += node->interval;
+            if (node->expire <= tick)
+                node->expire += ((tick - node->expire) / node->interval + 1) * node->interval;
+            add_locked(node);
+            m_count++;
+        }
+    }
+}
+
+void TimingWheel::dispatch_locked(const NodePtr &node)
+{
+    // 上一次回调还没有结束，跳过本次
+    if (node->running || node->cancelled)
+        return;
+
+    node->running = true;
+    auto job = [this, node]() {
+        bool cancelled = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            cancelled = node->cancelled;
+            node->runner = std::this_thread::get_id();
+        }
+
+        if (!cancelled)
+            node->callback();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        node->running = false;
+        node->runner = std::thread::id();
+        m_idle_cond.notify_all();
+    };
+    if (!m_pool->submit(job))
+        node->running = false;
+}
+
+uint64_t TimingWheel::next_event_locked() const
+{
+    if (m_count == 0)
+        return UINT64_MAX;
+
+    // 只需要查找到第0层转完一圈，届时上层的定时器会被重新分配
+    uint64_t boundary = (m_tick / LEVEL0_SIZE + 1) * LEVEL0_SIZE;
+    for (uint64_t tick = m_tick + 1; tick < boundary; tick++)
+    {
+        if (!m_level0[tick & (LEVEL0_SIZE - 1)].empty())
+            return tick;
+    }
+    return boundary;
+}
+
+void TimingWheel::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        uint64_t target = current_tick();
+        while (m_tick < target)
+        {
+            uint64_t tick = ++m_tick;
+
+            // 第0层转完一圈时把上一层对应槽中的定时器重新分配到下层，依次向上
+            if ((tick & (LEVEL0_SIZE - 1)) == 0)
+            {
+                uint64_t index = tick >> LEVEL0_BITS;
+                for (int level = 0; level < LEVELS - 1; level++)
+                {
+                    cascade_locked(level, index & (LEVEL_SIZE - 1));
+                    if ((index & (LEVEL_SIZE - 1)) != 0)
+                        break;
+                    index >>= LEVEL_BITS;
+                }
+            }
+
+            expire_locked(tick);
+        }
+
+        uint64_t next = next_event_locked();
+        if (next == UINT64_MAX)
+            m_cond.wait(lock);
+        else
+            m_cond.wait_until(lock, m_base + std::chrono::milliseconds(next * TICK_MS));
+    }
+}
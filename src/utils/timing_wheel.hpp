@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "thread_pool.hpp"
+
+/**
+ * @brief 分层时间轮定时器
+ *
+ * 一个调度线程管理所有定时器，时间精度为TICK_MS毫秒。第0层256个槽，其余3层各64个槽，
+ * 覆盖约7.7天，更长的定时器先放在最高层，到期前重新分配。添加和取消都是O(1)。
+ * 没有定时器将要到期时调度线程不会醒来。
+ *
+ * 回调在固定大小的线程池中执行，耗时的回调不会推迟其他定时器。
+ * 周期定时器按固定的时间点触发(第n次在首次触发后n*interval)，回调耗时不会累积误差；
+ * 上一次回调还没有结束时跳过本次触发，同一个定时器的回调不会并发执行。
+ *
+ * 时间轮与进程同生命周期，退出时不析构，避免与正在执行的回调互相等待。
+ */
+class TimingWheel
+{
+  public:
+    using Callback = std::function<void()>;
+
+    static const int64_t TICK_MS = 10;
+
+  private:
+    struct Node;
+    using NodePtr = std::shared_ptr<Node>;
+    using Slot = std::list<NodePtr>;
+
+    struct Node
+    {
+        uint64_t expire = 0;       // 到期的tick
+        uint64_t interval = 0;     // 周期(tick)，0表示只触发一次
+        Callback callback;
+        Slot *slot = nullptr;      // 所在的槽，不在时间轮中时为空
+        Slot::iterator pos;        // 在槽中的位置，用于O(1)取消
+        bool cancelled = false;
+        bool running = false;      // 回调正在执行
+        std::thread::id runner;    // 执行回调的线程
+    };
+
+  public:
+    /**
+     * @brief 定时器句柄，用于取消定时器，可以复制，默认构造的句柄不对应任何定时器
+     */
+    class Handle
+    {
+      private:
+        friend class TimingWheel;
+        std::weak_ptr<Node> m_node;
+
+      public:
+        /**
+         * @brief 取消定时器，之后不会再触发
+         * @param wait 回调正在执行时是否等待其结束，在回调内部取消自己时不会等待
+         */
+        void cancel(bool wait = false);
+
+        // 定时器是否还会触发
+        bool active() const;
+    };
+
+  private:
+    static const int LEVEL0_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const int LEVELS = 4;
+    static const uint64_t LEVEL0_SIZE = 1 << LEVEL0_BITS;
+    static const uint64_t LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const uint64_t MAX_DELTA = 1ULL << (LEVEL0_BITS + (LEVELS - 1) * LEVEL_BITS);
+
+    TimingWheel();
+
+    std::chrono::steady_clock::time_point m_base; // tick 0对应的时间
+    std::unique_ptr<WorkerPool> m_pool;           // 执行回调的线程池
+
+    std::mutex m_mutex; // 保护以下成员
+    std::condition_variable m_cond;      // 有新的定时器时唤醒调度线程
+    std::condition_variable m_idle_cond; // 回调结束时唤醒等待取消的线程
+    uint64_t m_tick = 0;                 // 已处理到的tick
+    size_t m_count = 0;                  // 时间轮中的定时器数
+    Slot m_level0[LEVEL0_SIZE];
+    Slot m_levels[LEVELS - 1][LEVEL_SIZE];
+
+    void run();
+    uint64_t current_tick() const;
+    // 距离下一个可能有定时器到期的tick，不超过下一次重新分配上层定时器的时间
+    uint64_t next_event_locked() const;
+    void add_locked(const NodePtr &node);
+    void remove_locked(Node &node);
+    void cascade_locked(int level, uint64_t index);
+    void expire_locked(uint64_t tick);
+    void dispatch_locked(const NodePtr &node);
+    void cancel(const NodePtr &node, bool wait);
+    Handle add(uint64_t delay_ms, uint64_t interval_ms, Callback callback);
+
+  public:
+    static TimingWheel &getinstance()
+    {
+        static TimingWheel *instance = new TimingWheel();
+        return *instance;
+    }
+
+    /**
+     * @brief 添加一次性定时器
+     * @param delay_ms 延迟(毫秒)，向上取整到tick
+     */
+    Handle schedule(int64_t delay_ms, Callback callback);
+
+    /**
+     * @brief 添加周期定时器
+     * @param interval_ms 周期(毫秒)
+     * @param first_delay_ms 首次触发的延迟(毫秒)，小于0时等于周期
+     */
+    Handle schedule_every(int64_t interval_ms, Callback callback, int64_t first_delay_ms = -1);
+
+    // 时间轮中的定时器数
+    size_t size();
+};